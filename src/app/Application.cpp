@@ -4,37 +4,72 @@
  */
 
 #include "Application.h"
+#include "MeshUtils.h"
+#include "RigImage.h"
 #include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
 
 Application::Application()
-    : blendMode(BM_LOG3)
+    : weldSeams(false)
+    , weldTolerance(1e-6)
+    , blendMode(BM_LOG3)
     , tetMode(TM_FACE)
     , numIterations(1)
     , globalRotation(0.0)
     , visualizationMultiplier(1.0)
     , rotationConsistency(false)
+    , temporalCoherence(false)
     , areaWeighted(false)
     , enableARAP(true)
     , visualizeEnergy(false)
+    , localStepTolerance(0.0)
+    , backgroundParametrization(false)
+    , memoryBudgetMB(0.0)
+    , mirrorSymmetry(false)
+    , mirrorAxis(0)
+    , solverDomains(0)
+    , compareBlendModes(false)
     , weightControllerMode(false)
     , selectedControlPoint(-1)
+    , useWeightField(false)
+    , weightFieldMode(WM_HARMONIC_ARAP)
+    , weightFieldDistMode(DM_GEODESIC)
+    , weightFieldRadius(1.0)
+    , stiffnessMode(SM_NONE)
+    , compressionTolerance(0.01)
+    , fitClampWeights(true)
+    , fitSumToOne(false)
+    , bakeInteriorSamples(16)
+    , bakeTolerance(1e-3)
+    , useFrameBudget(false)
+    , frameBudgetMs(33.0)
     , needsRecompute(true)
-    , needsInitialization(true) {
+    , needsInitialization(true)
+    , rebaseIndex(-1) {
 }
 
 Application::~Application() {
 }
 
 bool Application::loadBaseMesh(const std::string& path) {
+    updateRebase(true);
     if (!baseMesh.loadFromFile(path)) {
         std::cerr << "Failed to load base mesh from " << path << std::endl;
         return false;
     }
+    if (weldSeams) {
+        baseMesh.weld(weldTolerance);
+    }
 
     // Clear existing blend meshes and output
     blendMeshes.clear();
     meshWeights.clear();
     outputMesh.clear();
+    basePose.clear();
+    vertexStiffness.resize(0);
+    vertexTree.buildPoints(baseMesh.getVerticesAsVector3d());
 
     needsInitialization = true;
     needsRecompute = true;
@@ -44,6 +79,7 @@ bool Application::loadBaseMesh(const std::string& path) {
 }
 
 int Application::addBlendMesh(const std::string& path) {
+    updateRebase(true);
     Mesh mesh;
     if (!mesh.loadFromFile(path)) {
         std::cerr << "Failed to load blend mesh from " << path << std::endl;
@@ -52,6 +88,7 @@ int Application::addBlendMesh(const std::string& path) {
 
     // Validate topology matches base mesh
     if (baseMesh.isValid()) {
+        mesh.weldLike(baseMesh);
         if (mesh.numVertices() != baseMesh.numVertices() ||
             mesh.numFaces() != baseMesh.numFaces()) {
             std::cerr << "Error: Blend mesh topology doesn't match base mesh" << std::endl;
@@ -74,7 +111,147 @@ int Application::addBlendMesh(const std::string& path) {
     return index;
 }
 
+int Application::addMirroredBlendMesh(int index) {
+    updateRebase(true);
+    if (index < 0 || index >= (int)blendMeshes.size()) {
+        std::cerr << "Invalid blend mesh index: " << index << std::endl;
+        return -1;
+    }
+
+    std::vector<int> mirror;
+    double plane;
+    if (!MeshUtils::findMirrorMap(baseMesh.getVerticesAsVector3d(), mirrorAxis, 1e-4, mirror, plane)) {
+        std::cerr << "Base mesh is not mirror symmetric about axis " << mirrorAxis << std::endl;
+        return -1;
+    }
+
+    const Mesh& source = blendMeshes[index];
+    Mesh mesh = source;
+    for (int v = 0; v < mesh.numVertices(); v++) {
+        mesh.V.row(v) = source.V.row(mirror[v]);
+        mesh.V(v, mirrorAxis) = 2.0 * plane - mesh.V(v, mirrorAxis);
+    }
+    mesh.name = source.name + " (mirrored)";
+
+    blendMeshes.push_back(mesh);
+    meshWeights.push_back(0.0);
+
+    needsInitialization = true;
+    needsRecompute = true;
+
+    int added = (int)blendMeshes.size() - 1;
+    std::cout << "Blend mesh " << added << " added: " << mesh.name << std::endl;
+    return added;
+}
+
+bool Application::replaceBlendMesh(int index, const std::string& path) {
+    updateRebase(true);
+    if (index < 0 || index >= (int)blendMeshes.size()) {
+        std::cerr << "Invalid blend mesh index: " << index << std::endl;
+        return false;
+    }
+
+    Mesh mesh;
+    if (!mesh.loadFromFile(path)) {
+        std::cerr << "Failed to load blend mesh from " << path << std::endl;
+        return false;
+    }
+
+    mesh.weldLike(baseMesh);
+    if (mesh.numVertices() != blendMeshes[index].numVertices() ||
+        mesh.numFaces() != blendMeshes[index].numFaces()) {
+        std::cerr << "Error: Replacement mesh topology doesn't match blend mesh " << index << std::endl;
+        return false;
+    }
+
+    blendMeshes[index] = mesh;
+    if (!needsInitialization) {
+        blender.updateBlendMesh(index, mesh);
+    }
+    needsRecompute = true;
+
+    std::cout << "Blend mesh " << index << " replaced: " << mesh.name << std::endl;
+    return true;
+}
+
+bool Application::setBasePose(const std::string& path) {
+    updateRebase(true);
+    Mesh mesh;
+    if (!mesh.loadFromFile(path)) {
+        std::cerr << "Failed to load base pose from " << path << std::endl;
+        return false;
+    }
+
+    mesh.weldLike(baseMesh);
+    if (mesh.numVertices() != baseMesh.numVertices() || mesh.numFaces() != baseMesh.numFaces()) {
+        std::cerr << "Error: Base pose topology doesn't match base mesh" << std::endl;
+        return false;
+    }
+
+    basePose = mesh;
+    if (!needsInitialization) {
+        blender.setBasePose(basePose.getVerticesAsVector3d());
+    }
+    needsRecompute = true;
+    return true;
+}
+
+void Application::clearBasePose() {
+    updateRebase(true);
+    basePose.clear();
+    if (!needsInitialization) {
+        blender.setBasePose(std::vector<Vector3d>());
+    }
+    needsRecompute = true;
+}
+
+bool Application::rebase(int index) {
+    if (index < 0 || index >= (int)blendMeshes.size()) {
+        std::cerr << "Invalid blend mesh index: " << index << std::endl;
+        return false;
+    }
+    updateRebase(true);
+
+    if (!needsInitialization && blender.rebase(index)) {
+        rebaseIndex = index;
+        return true;
+    }
+
+    // Not initialized, or the engine cannot rebase: initialize with the swapped meshes
+    std::swap(baseMesh, blendMeshes[index]);
+    basePose.clear();
+    vertexTree.buildPoints(baseMesh.getVerticesAsVector3d());
+    needsInitialization = true;
+    needsRecompute = true;
+    std::cout << "Blend mesh " << index << " is the new base mesh" << std::endl;
+    return true;
+}
+
+bool Application::updateRebase(bool wait) {
+    if (rebaseIndex < 0) {
+        return false;
+    }
+    bool applied = blender.finishRebase(wait);
+    if (blender.isRebasing()) {
+        return false;
+    }
+
+    // The engine swapped its meshes, or failed and keeps the old base
+    int index = rebaseIndex;
+    rebaseIndex = -1;
+    std::swap(baseMesh, blendMeshes[index]);
+    basePose.clear();
+    vertexTree.buildPoints(baseMesh.getVerticesAsVector3d());
+    if (!applied) {
+        needsInitialization = true;
+    }
+    needsRecompute = true;
+    std::cout << "Blend mesh " << index << " is the new base mesh" << std::endl;
+    return true;
+}
+
 void Application::removeBlendMesh(int index) {
+    updateRebase(true);
     if (index < 0 || index >= (int)blendMeshes.size()) {
         std::cerr << "Invalid blend mesh index: " << index << std::endl;
         return;
@@ -90,12 +267,16 @@ void Application::removeBlendMesh(int index) {
 }
 
 void Application::clearAll() {
+    updateRebase(true);
     baseMesh.clear();
     blendMeshes.clear();
     outputMesh.clear();
+    compareMeshes.clear();
+    basePose.clear();
     meshWeights.clear();
     controlPoints.clear();
     barycentricWeights.clear();
+    vertexStiffness.resize(0);
 
     needsInitialization = true;
     needsRecompute = true;
@@ -109,10 +290,11 @@ bool Application::exportOutput(const std::string& path) {
         return false;
     }
 
-    return outputMesh.saveToFile(path);
+    return outputMesh.saveToFile(path, &outputWriter);
 }
 
 bool Application::initialize() {
+    updateRebase(true);
     if (!isReadyToBlend()) {
         std::cerr << "Cannot initialize: need base mesh and at least one blend mesh" << std::endl;
         return false;
@@ -131,37 +313,58 @@ bool Application::initialize() {
         return false;
     }
 
-    // Compute tetrahedral structure for all blend meshes
-    for (size_t i = 0; i < blendMeshes.size(); i++) {
-        if (!blendMeshes[i].computeTetStructure(tetMode)) {
-            std::cerr << "Failed to compute tet structure for blend mesh " << i << std::endl;
-            return false;
-        }
-    }
+    // Blend meshes share the base mesh's tet structure; the engine only reads
+    // their vertices, when each one is first parametrized
 
     // Setup NWayBlender engine
     blender.setBlendMode(blendMode);
     blender.setTetMode(tetMode);
     blender.setNumIterations(numIterations);
     blender.setRotationConsistency(rotationConsistency);
+    blender.setTemporalCoherence(temporalCoherence);
     blender.setAreaWeighted(areaWeighted);
+    blender.setMirrorSymmetry(mirrorSymmetry, mirrorAxis);
+    blender.setSolverDomains(solverDomains);
     blender.setInitRotation(globalRotation);
 
+    blender.clearMeshes();
     blender.setBaseMesh(baseMesh);
     for (const auto& mesh : blendMeshes) {
         blender.addBlendMesh(mesh);
     }
 
-    if (!blender.initialize()) {
-        std::cerr << "Failed to initialize NWayBlender engine" << std::endl;
-        return false;
+    if (useWeightField && weightField.getWeights().rows() == baseMesh.numVertices()) {
+        blender.setWeightMask(weightField.getWeights());
+    }
+    applyStiffness();
+    blender.setBasePose(basePose.isValid() ? basePose.getVerticesAsVector3d() : std::vector<Vector3d>());
+
+    // A rig image of the same meshes and settings replaces the factorization
+    // and parametrization; otherwise one process prepares the rig and saves it
+    // under the image lock while the others wait for it and then attach
+    if (rigImage.empty()) {
+        if (!blender.initialize()) {
+            std::cerr << "Failed to initialize NWayBlender engine" << std::endl;
+            return false;
+        }
+    } else if (!blender.attachRig(rigImage)) {
+        RigImage::Lock lock(rigImage);
+        if (!blender.attachRig(rigImage)) {
+            if (!blender.initialize()) {
+                std::cerr << "Failed to initialize NWayBlender engine" << std::endl;
+                return false;
+            }
+            blender.saveRig(rigImage);
+        }
     }
 
     // Initialize output mesh with base mesh
     outputMesh = baseMesh;
+    compareMeshes.clear();
 
     needsInitialization = false;
     needsRecompute = true;
+    frameBudget.reset();
 
     std::cout << "Initialization complete" << std::endl;
     return true;
@@ -179,23 +382,227 @@ bool Application::computeBlend() {
         }
     }
 
+    FrameBudget::Settings full = {numIterations, localStepTolerance, visualizeEnergy};
+    if (!blendWith(full, 0)) {
+        return false;
+    }
+    frameBudget.setRefined(true);
+    return true;
+}
+
+bool Application::computePreviewBlend() {
+    if (!useFrameBudget) {
+        return computeBlend();
+    }
+    if (!isReadyToBlend()) {
+        std::cerr << "Cannot compute blend: not ready" << std::endl;
+        return false;
+    }
+
+    if (needsInitialization) {
+        if (!initialize()) {
+            return false;
+        }
+    }
+
+    frameBudget.setTarget(frameBudgetMs);
+    FrameBudget::Settings full = {numIterations, localStepTolerance, visualizeEnergy};
+    FrameBudget::Settings preview = frameBudget.nextFrame(full);
+    return blendWith(preview, frameBudget.getPreviewLevel());
+}
+
+bool Application::refineBlend() {
+    if (!useFrameBudget || needsRecompute || needsInitialization || !frameBudget.readyToRefine()) {
+        return false;
+    }
+    return computeBlend();
+}
+
+bool Application::blendWith(const FrameBudget::Settings& settings, int previewLevel) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
     // Update blender parameters if changed
     blender.setBlendMode(blendMode);
-    blender.setNumIterations(numIterations);
+    blender.setNumIterations(settings.numIterations);
     blender.setRotationConsistency(rotationConsistency);
+    blender.setTemporalCoherence(temporalCoherence);
     blender.setInitRotation(globalRotation);
+    blender.setLocalStepTolerance(settings.localStepTolerance);
+    blender.setMemoryBudget((size_t)(memoryBudgetMB * 1024.0 * 1024.0));
+
+    // Compute the blend; compared modes are blended with it from one parametrization pass,
+    // the current mode first, and its result becomes the output
+    std::vector<short> modes = comparedModes();
+    if (modes.empty()) {
+        blender.setCompareModes(std::vector<short>());
+        compareMeshes.clear();
+        if (!blender.computeBlend(meshWeights, outputMesh, settings.visualizeEnergy, visualizationMultiplier)) {
+            std::cerr << "Failed to compute blend" << std::endl;
+            return false;
+        }
+    } else {
+        modes.insert(modes.begin(), blendMode);
+        compareMeshes.resize(modes.size() - 1, baseMesh);
+        std::vector<Mesh*> outputs(1, &outputMesh);
+        for (Mesh& mesh : compareMeshes) {
+            outputs.push_back(&mesh);
+        }
+        if (!blender.computeBlendModes(meshWeights, modes, outputs, settings.visualizeEnergy,
+                                       visualizationMultiplier)) {
+            std::cerr << "Failed to compute blend" << std::endl;
+            return false;
+        }
+    }
 
-    // Compute the blend
-    if (!blender.computeBlend(meshWeights, outputMesh, visualizeEnergy, visualizationMultiplier)) {
-        std::cerr << "Failed to compute blend" << std::endl;
-        return false;
+    // Speculatively parametrize the unused targets. Libraries tend to keep
+    // related shapes together, so the ones next to targets in use go first.
+    if (backgroundParametrization) {
+        int numMesh = (int)meshWeights.size();
+        std::vector<int> order(numMesh), distance(numMesh, numMesh);
+        for (int j = 0; j < numMesh; j++) {
+            order[j] = j;
+            for (int k = 0; k < numMesh; k++) {
+                if (meshWeights[k] != 0.0) {
+                    distance[j] = std::min(distance[j], std::abs(j - k));
+                }
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [&distance](int a, int b) {
+            return distance[a] < distance[b];
+        });
+        blender.startBackgroundParametrization(order);
+    } else {
+        blender.stopBackgroundParametrization();
     }
 
+    const BlendTimings& timings = blender.getLastTimings();
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    frameBudget.addBlend(timings, std::max(totalMs - timings.total(), 0.0), previewLevel, settings.visualizeEnergy);
+
     std::cout << "Blend computed successfully" << std::endl;
     needsRecompute = false;
     return true;
 }
 
+bool Application::fitWeightsToMesh(const std::string& path) {
+    if (!isReadyToBlend()) {
+        std::cerr << "Cannot fit weights: need base mesh and at least one blend mesh" << std::endl;
+        return false;
+    }
+
+    Mesh target;
+    if (!target.loadFromFile(path)) {
+        std::cerr << "Failed to load target mesh from " << path << std::endl;
+        return false;
+    }
+    target.weldLike(baseMesh);
+    if (target.numVertices() != baseMesh.numVertices() || target.numFaces() != baseMesh.numFaces()) {
+        std::cerr << "Error: Target mesh topology doesn't match base mesh" << std::endl;
+        return false;
+    }
+
+    if (needsInitialization) {
+        if (!initialize()) {
+            return false;
+        }
+    }
+    blender.setBlendMode(blendMode);
+    blender.setRotationConsistency(rotationConsistency);
+    blender.setInitRotation(globalRotation);
+
+    WeightFitOptions options;
+    if (!fitClampWeights) {
+        options.lowerBound = -HUGE_VAL;
+        options.upperBound = HUGE_VAL;
+    }
+    options.fixSum = fitSumToOne;
+
+    std::vector<double> weights = meshWeights;
+    double rmsError;
+    if (!blender.fitWeights(target, weights, options, &rmsError)) {
+        std::cerr << "Failed to fit weights" << std::endl;
+        return false;
+    }
+
+    meshWeights = weights;
+    needsRecompute = true;
+    std::cout << "Weights fitted to " << target.name << " (RMS error " << rmsError << ")" << std::endl;
+    return true;
+}
+
+bool Application::bakeMorphTargets(const std::string& path) {
+    updateRebase(true);
+    if (!isReadyToBlend()) {
+        std::cerr << "Cannot bake: need base mesh and at least one blend mesh" << std::endl;
+        return false;
+    }
+
+    if (needsInitialization) {
+        if (!initialize()) {
+            return false;
+        }
+    }
+    blender.setBlendMode(blendMode);
+    blender.setNumIterations(numIterations);
+    blender.setRotationConsistency(rotationConsistency);
+    blender.setInitRotation(globalRotation);
+    blender.setLocalStepTolerance(localStepTolerance);
+
+    // Morph targets are relative to the rest pose
+    if (hasBasePose()) {
+        blender.setBasePose(std::vector<Vector3d>());
+    }
+    morphBaker.setInteriorSamples(bakeInteriorSamples);
+    morphBaker.setTolerance(bakeTolerance);
+    bool baked = morphBaker.bake(blender, baseMesh);
+    if (hasBasePose()) {
+        blender.setBasePose(basePose.getVerticesAsVector3d());
+    }
+    if (!baked) {
+        std::cerr << "Failed to bake morph targets" << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> names;
+    for (const auto& mesh : blendMeshes) {
+        names.push_back(mesh.name);
+    }
+    return morphBaker.saveGLB(path, baseMesh, names);
+}
+
+bool Application::compressTargets() {
+    if (!isReadyToBlend()) {
+        std::cerr << "Cannot compress: need base mesh and at least one blend mesh" << std::endl;
+        return false;
+    }
+
+    if (needsInitialization) {
+        if (!initialize()) {
+            return false;
+        }
+    }
+    blender.setBlendMode(blendMode);
+    blender.setRotationConsistency(rotationConsistency);
+    blender.setInitRotation(globalRotation);
+
+    if (!blender.compressTargets(compressionTolerance)) {
+        std::cerr << "Failed to compress blend targets" << std::endl;
+        return false;
+    }
+
+    const std::vector<double>& error = blender.getCompressionError();
+    for (size_t j = 0; j < error.size(); j++) {
+        std::cout << "  Blend mesh " << j << ": relative error " << error[j] << std::endl;
+    }
+    needsRecompute = true;
+    return true;
+}
+
+void Application::clearCompression() {
+    blender.clearCompression();
+    needsRecompute = true;
+}
+
 int Application::addControlPoint(const Eigen::Vector3d& pos) {
     controlPoints.push_back(pos);
     needsRecompute = true;
@@ -287,6 +694,113 @@ void Application::computeBarycentricWeights() {
     std::cout << "Barycentric weights computed" << std::endl;
 }
 
+bool Application::computeWeightField() {
+    if (!baseMesh.isValid()) {
+        std::cerr << "Cannot compute weight field: no base mesh" << std::endl;
+        return false;
+    }
+
+    if (controlPoints.empty()) {
+        std::cout << "No control points to compute weights from" << std::endl;
+        return false;
+    }
+
+    // An unchanged base mesh keeps the heat factorization and the distances of
+    // control points solved before, so only new control points are solved
+    weightField.setMesh(baseMesh.getVerticesAsVector3d(), baseMesh.faceList);
+    weightField.setHandlePoints(controlPoints);
+    weightField.setCacheFile(weightFieldCache);
+    bool ok = (weightFieldMode >= WM_HARMONIC)
+        ? weightField.computeHarmonic(weightFieldMode)
+        : weightField.computeDistanceWeights(weightFieldDistMode, weightFieldMode, weightFieldRadius);
+    if (!ok) {
+        std::cerr << "Failed to compute weight field" << std::endl;
+        return false;
+    }
+
+    // Per-vertex weights: barycentricWeights[i][k] = weight of control point k at vertex i
+    const Eigen::MatrixXd& W = weightField.getWeights();
+    barycentricWeights.resize(W.rows());
+    for (int i = 0; i < (int)W.rows(); i++) {
+        barycentricWeights[i].resize(W.cols());
+        for (int k = 0; k < (int)W.cols(); k++) {
+            barycentricWeights[i][k] = W(i, k);
+        }
+    }
+
+    if (useWeightField) {
+        blender.setWeightMask(W);
+    }
+
+    needsRecompute = true;
+    return true;
+}
+
+void Application::setUseWeightField(bool enable) {
+    useWeightField = enable;
+    if (useWeightField && weightField.getWeights().rows() == baseMesh.numVertices()) {
+        blender.setWeightMask(weightField.getWeights());
+    } else {
+        blender.setWeightMask(Eigen::MatrixXd());
+    }
+    needsRecompute = true;
+}
+
+void Application::paintStiffness(const Eigen::Vector3d& centre, double radius, double value) {
+    if (!baseMesh.isValid() || radius <= 0.0) {
+        return;
+    }
+
+    int n = baseMesh.numVertices();
+    if (vertexStiffness.size() != n) {
+        vertexStiffness = Eigen::VectorXd::Ones(n);
+    }
+    if (vertexTree.numPrim != n) {
+        vertexTree.buildPoints(baseMesh.getVerticesAsVector3d());
+    }
+
+    std::vector<int> idx;
+    std::vector<double> dist;
+    vertexTree.withinRadius(centre, radius, idx, dist);
+    for (size_t k = 0; k < idx.size(); k++) {
+        double t = dist[k] / radius;
+        double falloff = (1.0 - t * t) * (1.0 - t * t);
+        vertexStiffness[idx[k]] += (value - vertexStiffness[idx[k]]) * falloff;
+    }
+
+    stiffnessMode = SM_PAINT;
+    if (!needsInitialization) {
+        applyStiffness();     // otherwise applied by initialize()
+    }
+    needsRecompute = true;
+    std::cout << "Stiffness painted on " << idx.size() << " vertices" << std::endl;
+}
+
+void Application::resetStiffness() {
+    vertexStiffness.resize(0);
+    if (!needsInitialization) {
+        applyStiffness();
+    }
+    needsRecompute = true;
+}
+
+void Application::setStiffnessMode(short mode) {
+    stiffnessMode = mode;
+    if (!needsInitialization) {
+        applyStiffness();
+    }
+    needsRecompute = true;
+}
+
+void Application::applyStiffness() {
+    updateRebase(true);
+    if (stiffnessMode == SM_PAINT && vertexStiffness.size() == baseMesh.numVertices()) {
+        blender.setStiffness(vertexStiffness);
+    } else {
+        blender.setStiffness(Eigen::VectorXd());
+    }
+}
+
 void Application::onMeshWeightChanged(int meshIndex, double weight) {
     if (meshIndex < 0 || meshIndex >= (int)meshWeights.size()) {
         std::cerr << "Invalid mesh index: " << meshIndex << std::endl;
@@ -297,6 +811,18 @@ void Application::onMeshWeightChanged(int meshIndex, double weight) {
     needsRecompute = true;
 }
 
+std::vector<short> Application::comparedModes() const {
+    std::vector<short> modes;
+    if (compareBlendModes) {
+        for (short mode : compareModes) {
+            if (mode != blendMode && std::find(modes.begin(), modes.end(), mode) == modes.end()) {
+                modes.push_back(mode);
+            }
+        }
+    }
+    return modes;
+}
+
 void Application::onBlendModeChanged(short mode) {
     blendMode = mode;
     blender.setBlendMode(mode);
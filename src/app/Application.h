@@ -12,8 +12,13 @@
 #include <string>
 #include <Eigen/Dense>
 #include "Mesh.h"
+#include "MeshWriter.h"
 #include "NWayBlender.h"
 #include "WeightController.h"
+#include "WeightField.h"
+#include "MorphBaker.h"
+#include "FrameBudget.h"
+#include "bvh.h"
 #include "deformerConst.h"
 
 using namespace Eigen;
@@ -30,6 +35,12 @@ public:
     Mesh baseMesh;                              // Reference/base mesh
     std::vector<Mesh> blendMeshes;              // Blend target meshes
     Mesh outputMesh;                            // Real-time blended output
+    Mesh basePose;                              // Posed (e.g. skinned) base the blend is applied on (empty = rest pose)
+    MeshWriter outputWriter;                    // Exports of the output, keeping its serialized faces
+
+    // ========== Seam Welding ==========
+    bool weldSeams;                             // Weld coincident vertices of the base mesh when it is loaded
+    double weldTolerance;                       // Weld distance, relative to the bounding box diagonal
 
     // ========== Blending Parameters ==========
     std::vector<double> meshWeights;            // Weight per blend mesh
@@ -39,9 +50,21 @@ public:
     double globalRotation;                      // Global rotation parameter
     double visualizationMultiplier;             // Energy visualization scale
     bool rotationConsistency;                   // Enable rotation consistency
+    bool temporalCoherence;                     // Keep rotation branches coherent across replaced frames
     bool areaWeighted;                          // Area-weighted blending
     bool enableARAP;                            // Enable ARAP deformation
     bool visualizeEnergy;                       // Show energy colors
+    double localStepTolerance;                  // Adaptive local step threshold (0 = refit every tet)
+    bool backgroundParametrization;             // Parametrize unused blend meshes in the background
+    double memoryBudgetMB;                      // Memory for target parametrizations (0 = unlimited)
+    bool mirrorSymmetry;                        // Share parametrizations of mirror-image blend meshes
+    int mirrorAxis;                             // Mirror axis (0 = x, 1 = y, 2 = z)
+    int solverDomains;                          // Subdomains of the ARAP solve (0 = single factorization)
+
+    // ========== Mode Comparison ==========
+    bool compareBlendModes;                     // Also blend in compareModes, side by side with the output
+    std::vector<short> compareModes;            // Blend modes to compare with blendMode
+    std::vector<Mesh> compareMeshes;            // Blends in comparedModes(), one per mode
 
     // ========== Weight Controller ==========
     std::vector<Eigen::Vector3d> controlPoints; // Control point positions
@@ -49,6 +72,35 @@ public:
     bool weightControllerMode;                  // Enable weight controller
     int selectedControlPoint;                   // -1 if none selected
 
+    // ========== Weight Field ==========
+    bool useWeightField;                        // Mask blend weights per vertex (control point k -> blend mesh k)
+    short weightFieldMode;                      // WM_HARMONIC_ARAP, WM_HARMONIC_COTAN, WM_INV_DISTANCE or WM_CUTOFF_DISTANCE
+    short weightFieldDistMode;                  // DM_EUCLIDEAN or DM_GEODESIC (distance falloff modes only)
+    double weightFieldRadius;                   // Effect radius for WM_CUTOFF_DISTANCE
+    std::string weightFieldCache;               // Cache path for computed fields, one file per key (empty = no cache)
+
+    // ========== Stiffness ==========
+    short stiffnessMode;                        // SM_NONE or SM_PAINT
+    Eigen::VectorXd vertexStiffness;            // Painted per-vertex stiffness (1 = default)
+
+    // ========== Target Compression ==========
+    double compressionTolerance;                // Relative error budget per blend mesh
+
+    // ========== Weight Fitting ==========
+    bool fitClampWeights;                       // Keep fitted weights in [0, 1]
+    bool fitSumToOne;                           // Constrain fitted weights to add up to 1
+
+    // ========== Morph Baking ==========
+    int bakeInteriorSamples;                    // Random interior samples of the weight space
+    double bakeTolerance;                       // Largest vertex error, relative to the bounding box diagonal
+
+    // ========== Frame Budget ==========
+    bool useFrameBudget;                        // Adapt the quality of real-time blends to frameBudgetMs
+    double frameBudgetMs;                       // Target time of a real-time blend and its view update
+
+    // ========== Shared Rig ==========
+    std::string rigImage;                       // Rig image shared with other processes (empty = none)
+
     // ========== State Flags ==========
     bool needsRecompute;                        // Blend needs recomputation
     bool needsInitialization;                   // Blending engine needs initialization
@@ -67,6 +119,11 @@ public:
 
     /**
      * @brief Load base mesh from file
+     *
+     * With weldSeams, vertices duplicated along seams are welded; blend
+     * meshes, poses and fitting targets loaded afterwards are welded the same
+     * way, and exports keep the layout of the files.
+     *
      * @param path File path
      * @return true if successful
      */
@@ -79,6 +136,80 @@ public:
      */
     int addBlendMesh(const std::string& path);
 
+    /**
+     * @brief Replace a blend mesh with new geometry (e.g. the next animation frame)
+     *
+     * Keeps the blending engine initialized; only the replaced mesh is
+     * reparametrized on the next computeBlend().
+     *
+     * @param index Index of mesh to replace
+     * @param path File path
+     * @return true if successful
+     */
+    bool replaceBlendMesh(int index, const std::string& path);
+
+    /**
+     * @brief Add the mirror image of a blend mesh (e.g. the right-side corrective of a left-side one)
+     *
+     * Reflects the blend mesh across the symmetry plane of the base mesh
+     * (perpendicular to mirrorAxis) through the base mesh's mirror vertex map.
+     * With mirrorSymmetry, the engine shares the parametrization of the pair.
+     *
+     * @param index Index of the blend mesh to mirror
+     * @return Index of the added mesh, or -1 if the base mesh is not mirror symmetric
+     */
+    int addMirroredBlendMesh(int index);
+
+    /**
+     * @brief Blend on top of a posed base mesh (e.g. the skinned base of the current frame)
+     *
+     * The blend meshes stay correctives relative to the rest pose of the base
+     * mesh; see NWayBlender::setBasePose(). Changing the pose each frame does
+     * not reinitialize the engine.
+     *
+     * @param path File path of the posed base mesh
+     * @return true if successful
+     */
+    bool setBasePose(const std::string& path);
+
+    /**
+     * @brief Blend on the rest pose again
+     */
+    void clearBasePose();
+
+    /**
+     * @brief Check if blending on top of a posed base mesh
+     */
+    bool hasBasePose() const { return basePose.isValid(); }
+
+    /**
+     * @brief Make a blend mesh the base mesh, and the base mesh a blend mesh in its place
+     *
+     * An initialized engine factorizes the new base in the background and keeps
+     * blending on the old one; updateRebase() swaps the meshes once it is done.
+     * See NWayBlender::rebase(). Clears the base pose.
+     *
+     * @param index Index of the blend mesh to become the base
+     * @return true if the rebase started or the meshes were swapped
+     */
+    bool rebase(int index);
+
+    /**
+     * @brief Apply a rebase in progress once the engine has swapped its base
+     *
+     * Called with wait before any change to the meshes, the pose or the
+     * stiffness, which would otherwise apply to the wrong base.
+     *
+     * @param wait Block until the factorization is done
+     * @return true if the meshes changed
+     */
+    bool updateRebase(bool wait = false);
+
+    /**
+     * @brief Check if a rebase is waiting for its factorization
+     */
+    bool isRebasing() const { return rebaseIndex >= 0; }
+
     /**
      * @brief Remove a blend mesh
      * @param index Index of mesh to remove
@@ -92,7 +223,11 @@ public:
 
     /**
      * @brief Export output mesh to file
-     * @param path Output file path
+     *
+     * Successive exports (e.g. the frames of an animation) only format the
+     * vertices; the faces are serialized by the first one.
+     *
+     * @param path Output file path (.obj, or binary .ply)
      * @return true if successful
      */
     bool exportOutput(const std::string& path);
@@ -112,13 +247,107 @@ public:
     /**
      * @brief Compute the N-way blended mesh
      *
-     * Updates outputMesh based on current weights and parameters.
+     * Updates outputMesh based on current weights and parameters, and with
+     * compareBlendModes the compareMeshes in the same parametrization pass.
      * Called whenever weights or parameters change.
      *
      * @return true if successful
      */
     bool computeBlend();
 
+    /**
+     * @brief Compute the blend at the quality the frame budget allows
+     *
+     * For real-time updates: the iterations, local step tolerance and energy
+     * visualization frequency are picked by FrameBudget from the timings of
+     * the previous frames, up to the full quality of the settings. Same as
+     * computeBlend() without useFrameBudget.
+     *
+     * @return true if successful
+     */
+    bool computePreviewBlend();
+
+    /**
+     * @brief Modes of compareMeshes: compareModes other than blendMode (none unless compareBlendModes)
+     */
+    std::vector<short> comparedModes() const;
+
+    /**
+     * @brief Blend at full quality once the input stopped after preview blends
+     * @return true if the output mesh was refined
+     */
+    bool refineBlend();
+
+    /**
+     * @brief Report the time (ms) of updating the view after a blend
+     */
+    void addViewUpdateTime(double ms) { frameBudget.addViewUpdate(ms); }
+
+    /**
+     * @brief Frame budget controller of the real-time blends
+     */
+    const FrameBudget& getFrameBudget() const { return frameBudget; }
+
+    /**
+     * @brief Compress the blend targets with PCA for large shape libraries
+     *
+     * See NWayBlender::compressTargets(). Prints the approximation error of
+     * each blend mesh. The compression applies to the current blend mode and
+     * blend meshes; it is dropped when they change.
+     *
+     * @return true if successful
+     */
+    bool compressTargets();
+
+    /**
+     * @brief Blend the full target parametrizations again
+     */
+    void clearCompression();
+
+    /**
+     * @brief Check if blending uses compressed targets
+     */
+    bool isCompressed() const { return blender.isCompressed(); }
+
+    /**
+     * @brief Number of principal components of the compressed targets
+     */
+    int numCompressionComponents() const { return blender.numComponents(); }
+
+    /**
+     * @brief Relative approximation error per blend mesh of the compressed targets
+     */
+    const std::vector<double>& getCompressionError() const { return blender.getCompressionError(); }
+
+    /**
+     * @brief Fit the blend weights to a target mesh
+     *
+     * Loads the target, which must match the base mesh topology, and replaces
+     * meshWeights with the weights whose blend best reproduces it (see
+     * NWayBlender::fitWeights). The current weights are the initial guess.
+     *
+     * @param path Path to the target mesh file
+     * @return true if successful
+     */
+    bool fitWeightsToMesh(const std::string& path);
+
+    /**
+     * @brief Bake the blend into linear morph targets and correctives, and save them as .glb
+     *
+     * Samples the blend with the current settings over the weight space and
+     * fits the linear model of MorphBaker. The targets are relative to the
+     * rest pose of the base mesh.
+     *
+     * @param path Output .glb path
+     * @return true if successful
+     */
+    bool bakeMorphTargets(const std::string& path);
+
+    /**
+     * @brief Result of the last bakeMorphTargets()
+     */
+    const MorphBaker& getMorphBaker() const { return morphBaker; }
+
     // ========== Weight Controller ==========
 
     /**
@@ -149,6 +378,48 @@ public:
      */
     void computeBarycentricWeights();
 
+    /**
+     * @brief Compute smooth per-vertex weights from the control points
+     *
+     * Each control point is snapped to the closest base mesh vertex and a
+     * harmonic (or biharmonic) field is solved for all of them at once, or the
+     * weights fall off with the (Euclidean or geodesic) distance to each of them.
+     * The result is stored in barycentricWeights and, if useWeightField is
+     * set, used to mask the weight of blend mesh k by the field of control point k.
+     *
+     * @return true if successful
+     */
+    bool computeWeightField();
+
+    /**
+     * @brief Enable or disable the weight field mask
+     */
+    void setUseWeightField(bool enable);
+
+    // ========== Stiffness Painting ==========
+
+    /**
+     * @brief Paint stiffness with a spherical brush
+     *
+     * Vertices within radius of centre move towards value with a smooth
+     * falloff. Switches stiffnessMode to SM_PAINT.
+     *
+     * @param centre Brush centre
+     * @param radius Brush radius
+     * @param value Target stiffness (1 = default)
+     */
+    void paintStiffness(const Eigen::Vector3d& centre, double radius, double value);
+
+    /**
+     * @brief Reset all vertices to the default stiffness
+     */
+    void resetStiffness();
+
+    /**
+     * @brief Switch between uniform (SM_NONE) and painted (SM_PAINT) stiffness
+     */
+    void setStiffnessMode(short mode);
+
     // ========== Parameter Callbacks ==========
 
     /**
@@ -204,12 +475,47 @@ public:
      */
     const Mesh& getBlendMesh(int index) const { return blendMeshes[index]; }
 
+    /**
+     * @brief Number of blend meshes parametrized so far (the rest wait for a nonzero weight)
+     */
+    int numParametrizedMeshes() { return blender.numParametrizedMeshes(); }
+
+    /**
+     * @brief Number of blend meshes whose parametrization fits in the memory budget
+     */
+    int numCachedMeshes() const { return blender.numCachedMeshes(); }
+
+    /**
+     * @brief Bytes held by target parametrizations
+     */
+    size_t parametrizationBytes() { return blender.parametrizationBytes(); }
+
+    /**
+     * @brief Number of blend meshes sharing the parametrization of their mirror image
+     */
+    int numMirroredMeshes() const { return blender.numMirroredMeshes(); }
+
+    /**
+     * @brief Vertices on the interface between solver subdomains
+     */
+    int getSolverInterfaceSize() const { return blender.getSolverInterfaceSize(); }
+
+    /**
+     * @brief Fraction of polar fits skipped by the adaptive local step in the last blend
+     */
+    double getSkippedFraction() const { return blender.getSkippedFraction(); }
+
     /**
      * @brief Get weight controller instance
      * @return Reference to weight controller
      */
     WeightController& getWeightController() { return weightController; }
 
+    /**
+     * @brief Get weight field generator
+     */
+    const WeightField& getWeightField() const { return weightField; }
+
 private:
     /**
      * @brief Ensure meshWeights vector has correct size
@@ -225,4 +531,41 @@ private:
      * @brief Weight controller instance
      */
     WeightController weightController;
+
+    /**
+     * @brief Harmonic weight field generator
+     */
+    WeightField weightField;
+
+    /**
+     * @brief Linear morph model of the last bake
+     */
+    MorphBaker morphBaker;
+
+    /**
+     * @brief Quality controller of the real-time blends
+     */
+    FrameBudget frameBudget;
+
+    /**
+     * @brief Blend with the given quality settings and record the timings
+     * @param settings Iterations, local step tolerance and energy visualization
+     * @param previewLevel Preview level of the settings (0 at full quality)
+     */
+    bool blendWith(const FrameBudget::Settings& settings, int previewLevel);
+
+    /**
+     * @brief Base mesh vertices for brush queries (rebuilt when the base mesh changes)
+     */
+    BVH vertexTree;
+
+    /**
+     * @brief Blend mesh the engine is rebasing onto (-1 = none)
+     */
+    int rebaseIndex;
+
+    /**
+     * @brief Pass the stiffness of the current mode to the engine
+     */
+    void applyStiffness();
 };
@@ -0,0 +1,156 @@
+/**
+ * @file FrameBudget.cpp
+ * @brief Frame-time budget controller implementation
+ */
+
+#include "FrameBudget.h"
+#include <algorithm>
+
+// Weight of a new measurement in the moving averages
+static const double SMOOTHING = 0.3;
+
+// A better quality than the current one must be predicted below this fraction of the budget
+static const double HEADROOM = 0.85;
+
+static void addSample(double& average, double value) {
+    average = average < 0.0 ? value : (1.0 - SMOOTHING) * average + SMOOTHING * value;
+}
+
+FrameBudget::FrameBudget()
+    : targetMs(33.0)
+    , refineDelayMs(150.0) {
+    reset();
+}
+
+void FrameBudget::reset() {
+    fixedMs = -1.0;
+    viewMs = -1.0;
+    viewEnergyMs = -1.0;
+    solveMs = -1.0;
+    std::fill(localMs, localMs + NUM_LEVELS, -1.0);
+    energyMs = -1.0;
+    frameMs = -1.0;
+    lastBlendMs = 0.0;
+    iterations = 0;
+    level = 0;
+    energyInterval = 1;
+    frameCount = 0;
+    lastEnergy = false;
+    isRefined = true;
+    lastFrame = Clock::now();
+}
+
+double FrameBudget::levelTolerance(int level) {
+    static const double tolerance[NUM_LEVELS] = {0.0, 0.005, 0.02, 0.05};
+    return tolerance[std::max(0, std::min(level, NUM_LEVELS - 1))];
+}
+
+double FrameBudget::predict(int iters, int lev, int interval, bool energy) const {
+    // A level that was not measured yet is assumed to halve the local step
+    // of the nearest finer one; the first frame there corrects it
+    double local = -1.0;
+    for (int l = lev, scale = 1; l >= 0 && local < 0.0; l--, scale *= 2) {
+        if (localMs[l] >= 0.0) {
+            local = localMs[l] / scale;
+        }
+    }
+    for (int l = lev + 1; l < NUM_LEVELS && local < 0.0; l++) {
+        local = localMs[l];
+    }
+    if (local < 0.0) {
+        local = std::max(solveMs, 0.0);
+    }
+
+    double t = std::max(fixedMs, 0.0) + std::max(viewMs, 0.0) + iters * std::max(solveMs, 0.0)
+             + (iters - 1) * local;
+    if (energy) {
+        t += (std::max(energyMs, 0.0) + std::max(viewEnergyMs, 0.0)) / interval;
+    }
+    return t;
+}
+
+void FrameBudget::choose(const Settings& full) {
+    int maxIterations = std::max((int)full.numIterations, 1);
+    if (solveMs < 0.0) {
+        // Nothing measured yet: start at full quality
+        iterations = maxIterations;
+        level = 0;
+        energyInterval = 1;
+        return;
+    }
+
+    // Candidates from the best quality down; the ones before the current
+    // choice are better and need the headroom
+    bool better = true;
+    for (int iters = maxIterations; iters >= 1; iters--) {
+        for (int lev = 0; lev < (iters > 1 ? NUM_LEVELS : 1); lev++) {
+            // Levels finer than the user's tolerance are the same as level 0
+            if (lev > 0 && levelTolerance(lev) <= full.localStepTolerance) {
+                continue;
+            }
+            for (int interval = 1; interval <= (full.visualizeEnergy ? MAX_ENERGY_INTERVAL : 1); interval *= 2) {
+                bool current = iters == iterations && lev == level && interval == energyInterval;
+                double limit = better && !current ? HEADROOM * targetMs : targetMs;
+                if (predict(iters, lev, interval, full.visualizeEnergy) <= limit) {
+                    iterations = iters;
+                    level = lev;
+                    energyInterval = interval;
+                    return;
+                }
+                better = better && !current;
+            }
+        }
+    }
+
+    // Nothing fits: the cheapest choice
+    iterations = 1;
+    level = 0;
+    energyInterval = full.visualizeEnergy ? MAX_ENERGY_INTERVAL : 1;
+}
+
+FrameBudget::Settings FrameBudget::nextFrame(const Settings& full) {
+    choose(full);
+
+    Settings s;
+    s.numIterations = (short)iterations;
+    s.localStepTolerance = std::max(full.localStepTolerance, levelTolerance(level));
+    s.visualizeEnergy = full.visualizeEnergy && frameCount % energyInterval == 0;
+    frameCount++;
+
+    // A frame at full quality needs no refinement
+    isRefined = iterations >= full.numIterations && level == 0 && s.visualizeEnergy == full.visualizeEnergy;
+    return s;
+}
+
+void FrameBudget::addBlend(const BlendTimings& timings, double overheadMs, int previewLevel, bool energy) {
+    addSample(fixedMs, timings.blend + overheadMs);
+    if (timings.iterations > 0) {
+        addSample(solveMs, timings.solve / timings.iterations);
+    }
+    if (timings.iterations > 1) {
+        int lev = std::max(0, std::min(previewLevel, NUM_LEVELS - 1));
+        addSample(localMs[lev], timings.local / (timings.iterations - 1));
+    }
+    if (energy) {
+        addSample(energyMs, timings.energy);
+    }
+    lastEnergy = energy;
+    lastFrame = Clock::now();
+    lastBlendMs = timings.total() - timings.prepare + overheadMs;
+}
+
+void FrameBudget::addViewUpdate(double ms) {
+    // Frames with energy also upload it; the difference to the other frames is its cost
+    if (lastEnergy && viewMs >= 0.0) {
+        addSample(viewEnergyMs, std::max(ms - viewMs, 0.0));
+    } else if (!lastEnergy) {
+        addSample(viewMs, ms);
+    }
+    addSample(frameMs, lastBlendMs + ms);
+    lastFrame = Clock::now();
+}
+
+bool FrameBudget::readyToRefine() const {
+    double idleMs = std::chrono::duration<double, std::milli>(Clock::now() - lastFrame).count();
+    return !isRefined && idleMs >= refineDelayMs;
+}
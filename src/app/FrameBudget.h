@@ -0,0 +1,147 @@
+/**
+ * @file FrameBudget.h
+ * @brief Frame-time budget controller for real-time blending
+ * @section LICENSE The MIT License
+ * @version 1.0
+ * @date 2026
+ */
+
+#pragma once
+
+#include <chrono>
+#include "NWayBlender.h"
+
+/**
+ * @brief Picks the quality of each real-time blend from measured stage timings
+ *
+ * The predicted time of a frame is
+ *
+ *   fixed + iterations * solve + (iterations - 1) * local[level] + energy / energyInterval
+ *
+ * where fixed covers blending the transformations and updating the view,
+ * solve is one global step, local[level] one local step at preview level
+ * `level`, and energy the energy visualization. Each term is a moving average
+ * of its measurements. Preview level l loosens the local step tolerance to
+ * at least levelTolerance(l), so that more polar fits are skipped.
+ *
+ * Each frame gets the best quality predicted to fit the budget: iterations
+ * are kept longest, then the finest preview level, then the most frequent
+ * energy update. A better quality than the current one needs some headroom,
+ * so the controller settles instead of oscillating. Once the input has been
+ * still for a moment, one refinement pass blends at full quality.
+ */
+class FrameBudget {
+public:
+    /**
+     * @brief Blend settings of a frame
+     */
+    struct Settings {
+        short numIterations;            ///< ARAP iterations
+        double localStepTolerance;      ///< Adaptive local step threshold
+        bool visualizeEnergy;           ///< Compute the energy visualization
+    };
+
+    static const int NUM_LEVELS = 4;            ///< Preview levels
+    static const int MAX_ENERGY_INTERVAL = 8;   ///< Energy visualization at least every this many frames
+
+    FrameBudget();
+
+    /**
+     * @brief Set the target time per frame (ms)
+     */
+    void setTarget(double ms) { targetMs = ms; }
+    double getTarget() const { return targetMs; }
+
+    /**
+     * @brief Settings for the next interactive frame
+     *
+     * The refinement waits for a pause after the last of these frames.
+     *
+     * @param full Full quality settings of the user
+     */
+    Settings nextFrame(const Settings& full);
+
+    /**
+     * @brief Record the timings of a blend
+     * @param timings Stage timings of the engine
+     * @param overheadMs Time of the blend outside the engine stages
+     * @param previewLevel Preview level of the blend (0 at full quality)
+     * @param energy The blend computed the energy visualization
+     */
+    void addBlend(const BlendTimings& timings, double overheadMs, int previewLevel, bool energy);
+
+    /**
+     * @brief Record the time of the view update that followed the last blend
+     */
+    void addViewUpdate(double ms);
+
+    /**
+     * @brief Check if the input has been still long enough to refine a preview
+     */
+    bool readyToRefine() const;
+
+    /**
+     * @brief Mark the shown blend as refined (full quality) or as a preview
+     */
+    void setRefined(bool refined) { isRefined = refined; }
+    bool refined() const { return isRefined; }
+
+    /**
+     * @brief Forget the timings, e.g. after the meshes changed
+     */
+    void reset();
+
+    /**
+     * @brief Local step tolerance of a preview level (0 for level 0)
+     */
+    static double levelTolerance(int level);
+
+    int getIterations() const { return iterations; }
+    int getPreviewLevel() const { return level; }
+    int getEnergyInterval() const { return energyInterval; }
+
+    /**
+     * @brief Check if the last blend computed the energy visualization
+     */
+    bool energyUpdated() const { return lastEnergy; }
+
+    /**
+     * @brief Smoothed measured time of the recent frames (ms)
+     */
+    double getFrameTime() const { return frameMs; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    double targetMs;                    ///< Target time per frame
+    double refineDelayMs;               ///< Input stillness before the refinement pass
+
+    // Moving averages of the stage timings (ms, negative = not measured yet)
+    double fixedMs;                     ///< Transformations and overhead
+    double viewMs;                      ///< View update without energy
+    double viewEnergyMs;                ///< Extra view update time with energy
+    double solveMs;                     ///< One global step
+    double localMs[NUM_LEVELS];         ///< One local step per preview level
+    double energyMs;                    ///< Energy visualization in the engine
+    double frameMs;                     ///< Whole frame
+    double lastBlendMs;                 ///< Last blend, without parametrization
+
+    // Current choice
+    int iterations;
+    int level;
+    int energyInterval;
+    long frameCount;
+    bool lastEnergy;                    ///< Last blend computed the energy
+    bool isRefined;
+    Clock::time_point lastFrame;        ///< End of the last interactive frame
+
+    /**
+     * @brief Predicted frame time of a choice
+     */
+    double predict(int iters, int lev, int interval, bool energy) const;
+
+    /**
+     * @brief Pick the best choice that fits the budget
+     */
+    void choose(const Settings& full);
+};
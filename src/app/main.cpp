@@ -7,6 +7,9 @@
  */
 
 #include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <chrono>
 #include <polyscope/polyscope.h>
 #include <polyscope/surface_mesh.h>
 
@@ -18,7 +21,14 @@ Application* app = nullptr;
 // UI state
 static char baseMeshPath[512] = "";
 static char blendMeshPath[512] = "";
+static char replaceMeshPath[512] = "";
+static int replaceMeshIndex = 0;
+static int mirrorMeshIndex = 0;
+static char basePosePath[512] = "";
+static int rebaseMeshIndex = 0;
+static int rebasingIndex = -1;         // Blend mesh being swapped with the base mesh
 static char exportPath[512] = "output.obj";
+static char bakePath[512] = "morphs.glb";
 static bool showBaseMesh = true;
 static bool showBlendMeshes = true;
 static bool showOutputMesh = true;
@@ -33,10 +43,120 @@ static Eigen::Vector2d controlPoint(0.0, 0.0);  // Control point position in nor
 // Real-time update mode
 static bool realtimeUpdate = false;
 
+// Stiffness brush state
+static float brushPosition[3] = {0.0f, 0.0f, 0.0f};
+static float brushRadius = 0.3f;
+static float brushStiffness = 5.0f;
+
+// Weight fitting state
+static char fitMeshPath[512] = "";
+
+// Weight field state
+static float handlePosition[3] = {0.0f, 0.0f, 0.0f};
+static char weightFieldCachePath[512] = "";
+
+// Blend modes offered in the UI (the BM_* values are not contiguous)
+static const short blendModeValues[] = { BM_SRL, BM_LOG3, BM_SQL, BM_SlRL, BM_AFF };
+static const char* blendModeNames[] = { "SRL", "LOG3", "SQL", "SlRL", "AFF" };
+static const int numBlendModes = 5;
+
+// Show a blend result below the base mesh, shifted right by dx
+static void updateBlendResultView(const std::string& name, const Mesh& result, double dx, bool updateEnergy) {
+    Mesh::VertexMatrix V_output = result.V;
+    V_output.col(0).array() += dx;
+    V_output.col(1).array() -= 3.0;  // Offset down in Y
+
+    // Update or create output mesh visualization
+    polyscope::SurfaceMesh* mesh;
+    if (polyscope::hasSurfaceMesh(name)) {
+        mesh = polyscope::getSurfaceMesh(name);
+        mesh->updateVertexPositions(V_output);
+    } else {
+        mesh = polyscope::registerSurfaceMesh(name, V_output, result.F);
+        mesh->setTransparency(outputMeshOpacity);
+        mesh->setEnabled(showOutputMesh);
+    }
+
+    // Update energy visualization if enabled; only the values change between frames
+    if (updateEnergy && app->visualizeEnergy && result.vertexEnergy.size() == result.V.rows()) {
+        auto* energy = dynamic_cast<polyscope::SurfaceVertexScalarQuantity*>(mesh->getQuantity("Energy"));
+        if (energy) {
+            energy->updateData(result.vertexEnergy);
+        } else {
+            mesh->addVertexScalarQuantity("Energy", result.vertexEnergy)->setEnabled(true);
+        }
+    }
+}
+
+// Apply a visibility or opacity change to the output and the compared modes
+template <typename F>
+static void forEachOutputView(F f) {
+    if (polyscope::hasSurfaceMesh("Output Mesh")) {
+        f(polyscope::getSurfaceMesh("Output Mesh"));
+    }
+    std::vector<short> modes = app->comparedModes();
+    for (int k = 0; k < numBlendModes; k++) {
+        std::string name = std::string("Output ") + blendModeNames[k];
+        if (polyscope::hasSurfaceMesh(name) &&
+            std::find(modes.begin(), modes.end(), blendModeValues[k]) != modes.end()) {
+            f(polyscope::getSurfaceMesh(name));
+        }
+    }
+}
+
+// Show the latest blend result, reusing the registered mesh and energy buffers;
+// the energy is only uploaded if the blend computed it
+static void updateOutputMeshView(bool updateEnergy = true) {
+    updateBlendResultView("Output Mesh", app->outputMesh, 0.0, updateEnergy);
+
+    // Compared modes in a row to the right of the output; modes no longer compared are hidden
+    std::vector<short> modes = app->comparedModes();
+    for (int k = 0; k < numBlendModes; k++) {
+        std::string name = std::string("Output ") + blendModeNames[k];
+        size_t m = std::find(modes.begin(), modes.end(), blendModeValues[k]) - modes.begin();
+        if (m < app->compareMeshes.size()) {
+            bool registered = polyscope::hasSurfaceMesh(name);
+            updateBlendResultView(name, app->compareMeshes[m], 3.0 * (m + 1), updateEnergy);
+            if (registered) {
+                polyscope::getSurfaceMesh(name)->setEnabled(showOutputMesh);
+            }
+        } else if (polyscope::hasSurfaceMesh(name)) {
+            polyscope::getSurfaceMesh(name)->setEnabled(false);
+        }
+    }
+}
+
+// Show the base mesh and blend mesh idx after they were swapped by a rebase
+static void updateRebasedMeshView(int idx) {
+    if (polyscope::hasSurfaceMesh("Base Mesh")) {
+        polyscope::getSurfaceMesh("Base Mesh")->updateVertexPositions(app->baseMesh.V);
+    }
+    std::string name = "Blend Mesh " + std::to_string(idx);
+    if (polyscope::hasSurfaceMesh(name)) {
+        Eigen::MatrixXd V_translated = app->getBlendMesh(idx).V;
+        V_translated.col(0).array() += 3.0 * (idx + 1);
+        polyscope::getSurfaceMesh(name)->updateVertexPositions(V_translated);
+    }
+}
+
+// Show a real-time blend and report the time of the view update to the frame budget
+static void updateRealtimeView() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    updateOutputMeshView(app->getFrameBudget().energyUpdated());
+    app->addViewUpdateTime(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
 // Callback function for ImGui UI
 void callback() {
     ImGui::Begin("N-Way Blender");
 
+    // The engine factorizes the new base of a rebase in the background; other
+    // edits of the meshes may have applied it already
+    if (rebasingIndex >= 0 && (app->updateRebase() || !app->isRebasing())) {
+        updateRebasedMeshView(rebasingIndex);
+        rebasingIndex = -1;
+    }
+
     // File operations
     if (ImGui::CollapsingHeader("File", ImGuiTreeNodeFlags_DefaultOpen)) {
         ImGui::Text("Load Base Mesh:");
@@ -58,6 +178,11 @@ void callback() {
                 }
             }
         }
+        ImGui::Checkbox("Weld Seams", &app->weldSeams);
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Weld vertices duplicated along UV and normal seams when the base mesh is loaded,\n"
+                              "so that seams do not tear; exports keep the layout of the file");
+        }
 
         ImGui::Text("Add Blend Mesh:");
         ImGui::InputText("##blendpath", blendMeshPath, 512);
@@ -79,6 +204,71 @@ void callback() {
             }
         }
 
+        if (app->numBlendMeshes() > 0) {
+            ImGui::Text("Mirror Blend Mesh:");
+            ImGui::InputInt("Index##mirror", &mirrorMeshIndex);
+            ImGui::SameLine();
+            if (ImGui::Button("Mirror##blend")) {
+                int idx = app->addMirroredBlendMesh(mirrorMeshIndex);
+                if (idx >= 0) {
+                    const Mesh& mesh = app->getBlendMesh(idx);
+                    Eigen::MatrixXd V_translated = mesh.V;
+                    V_translated.col(0).array() += 3.0 * (idx + 1);
+                    auto* pmesh = polyscope::registerSurfaceMesh("Blend Mesh " + std::to_string(idx),
+                                                                 V_translated, mesh.F);
+                    pmesh->setTransparency(blendMeshOpacity);
+                    pmesh->setEnabled(showBlendMeshes);
+                }
+            }
+
+            ImGui::Text("Replace Blend Mesh (next frame):");
+            ImGui::InputInt("Index##replace", &replaceMeshIndex);
+            ImGui::InputText("##replacepath", replaceMeshPath, 512);
+            ImGui::SameLine();
+            if (ImGui::Button("Replace##blend")) {
+                if (strlen(replaceMeshPath) > 0 && app->replaceBlendMesh(replaceMeshIndex, replaceMeshPath)) {
+                    std::string name = "Blend Mesh " + std::to_string(replaceMeshIndex);
+                    if (polyscope::hasSurfaceMesh(name)) {
+                        Eigen::MatrixXd V_translated = app->getBlendMesh(replaceMeshIndex).V;
+                        V_translated.col(0).array() += 3.0 * (replaceMeshIndex + 1);
+                        polyscope::getSurfaceMesh(name)->updateVertexPositions(V_translated);
+                    }
+                }
+            }
+
+            ImGui::Text("Base Pose (skinned frame):");
+            ImGui::InputText("##posepath", basePosePath, 512);
+            ImGui::SameLine();
+            if (ImGui::Button("Set##pose")) {
+                if (strlen(basePosePath) > 0) {
+                    app->setBasePose(basePosePath);
+                }
+            }
+            if (app->hasBasePose()) {
+                ImGui::SameLine();
+                if (ImGui::Button("Clear##pose")) {
+                    app->clearBasePose();
+                }
+            }
+
+            ImGui::Text("Rebase onto Blend Mesh:");
+            ImGui::InputInt("Index##rebase", &rebaseMeshIndex);
+            ImGui::SameLine();
+            if (app->isRebasing()) {
+                ImGui::TextDisabled("Rebasing...");
+            } else if (ImGui::Button("Rebase##blend") && app->rebase(rebaseMeshIndex)) {
+                if (app->isRebasing()) {
+                    rebasingIndex = rebaseMeshIndex;
+                } else {
+                    updateRebasedMeshView(rebaseMeshIndex);
+                }
+            }
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("Swap the base mesh with a blend mesh; blending continues on the old base\n"
+                                  "while the new one is factorized");
+            }
+        }
+
         if (app && app->isReadyToBlend()) {
             ImGui::Separator();
             ImGui::Text("Export Output:");
@@ -87,13 +277,38 @@ void callback() {
             if (ImGui::Button("Export##output")) {
                 if (strlen(exportPath) > 0) {
                     std::cout << "Exporting output mesh to: " << exportPath << std::endl;
-                    if (app->outputMesh.saveToFile(exportPath)) {
+                    if (app->exportOutput(exportPath)) {
                         std::cout << "Output mesh exported successfully" << std::endl;
                     } else {
                         std::cerr << "Failed to export output mesh" << std::endl;
                     }
                 }
             }
+
+            ImGui::Text("Bake Morph Targets (.glb):");
+            ImGui::InputText("##bakepath", bakePath, 512);
+            ImGui::SameLine();
+            if (ImGui::Button("Bake##morph")) {
+                if (strlen(bakePath) > 0) {
+                    app->bakeMorphTargets(bakePath);
+                }
+            }
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("Fit linear morph targets and corrective shapes to the blend\n"
+                                  "sampled over the weight space, for runtimes that only blend linearly");
+            }
+            if (ImGui::InputInt("Interior Samples", &app->bakeInteriorSamples)) {
+                app->bakeInteriorSamples = std::max(0, app->bakeInteriorSamples);
+            }
+            float bakeTol = (float)app->bakeTolerance;
+            if (ImGui::InputFloat("Bake Tolerance", &bakeTol, 0.0f, 0.0f, "%.1e")) {
+                app->bakeTolerance = std::max(0.0, (double)bakeTol);
+            }
+            const MorphBaker& baker = app->getMorphBaker();
+            if (baker.numTargets() > 0) {
+                ImGui::Text("Baked: %d targets, %d correctives, max error %.2e",
+                            baker.numTargets(), baker.numCorrectives(), baker.getMaxError());
+            }
         }
     }
 
@@ -104,6 +319,9 @@ void callback() {
             ImGui::Text("  %d vertices, %d faces",
                        app->baseMesh.numVertices(),
                        app->baseMesh.numFaces());
+            if (app->baseMesh.isWelded()) {
+                ImGui::Text("  welded from %d vertices", (int)app->baseMesh.weldMap.size());
+            }
         } else {
             ImGui::TextDisabled("No base mesh loaded");
         }
@@ -136,9 +354,7 @@ void callback() {
         }
 
         if (ImGui::Checkbox("Show Output Mesh", &showOutputMesh)) {
-            if (polyscope::hasSurfaceMesh("Output Mesh")) {
-                polyscope::getSurfaceMesh("Output Mesh")->setEnabled(showOutputMesh);
-            }
+            forEachOutputView([](polyscope::SurfaceMesh* mesh) { mesh->setEnabled(showOutputMesh); });
         }
 
         ImGui::Separator();
@@ -160,8 +376,138 @@ void callback() {
         }
 
         if (ImGui::SliderFloat("Output Opacity", &outputMeshOpacity, 0.0f, 1.0f)) {
-            if (polyscope::hasSurfaceMesh("Output Mesh")) {
-                polyscope::getSurfaceMesh("Output Mesh")->setTransparency(outputMeshOpacity);
+            forEachOutputView([](polyscope::SurfaceMesh* mesh) { mesh->setTransparency(outputMeshOpacity); });
+        }
+    }
+
+    // Weight field (spatially varying weights from control points)
+    if (app->baseMesh.isValid()) {
+        if (ImGui::CollapsingHeader("Weight Field")) {
+            ImGui::InputFloat3("Position", handlePosition);
+            if (ImGui::Button("Add Control Point")) {
+                app->addControlPoint(Eigen::Vector3d(handlePosition[0], handlePosition[1], handlePosition[2]));
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Clear Control Points")) {
+                app->controlPoints.clear();
+            }
+            ImGui::Text("Control points: %d", (int)app->controlPoints.size());
+            ImGui::SameLine();
+            ImGui::TextDisabled("(?)");
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("Control point k is snapped to the closest vertex and\n"
+                                  "its field masks the weight of blend mesh k.");
+            }
+
+            const char* field_modes[] = { "Harmonic", "Biharmonic", "Inverse Distance", "Cutoff Distance" };
+            const short field_mode_values[] = { WM_HARMONIC_ARAP, WM_HARMONIC_COTAN, WM_INV_DISTANCE, WM_CUTOFF_DISTANCE };
+            int current_field_mode = 0;
+            for (int i = 0; i < 4; i++) {
+                if (app->weightFieldMode == field_mode_values[i]) current_field_mode = i;
+            }
+            if (ImGui::Combo("Field Type", &current_field_mode, field_modes, 4)) {
+                app->weightFieldMode = field_mode_values[current_field_mode];
+            }
+
+            if (app->weightFieldMode < WM_HARMONIC) {
+                bool geodesic = (app->weightFieldDistMode == DM_GEODESIC);
+                if (ImGui::Checkbox("Geodesic Distance", &geodesic)) {
+                    app->weightFieldDistMode = geodesic ? DM_GEODESIC : DM_EUCLIDEAN;
+                }
+                ImGui::SameLine();
+                ImGui::TextDisabled("(?)");
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("Measure distance along the surface (heat method) so that\n"
+                                      "weights do not bleed across nearby but disconnected regions.");
+                }
+                if (app->weightFieldMode == WM_CUTOFF_DISTANCE) {
+                    float radius = (float)app->weightFieldRadius;
+                    if (ImGui::InputFloat("Radius", &radius)) {
+                        app->weightFieldRadius = radius > 0.0f ? radius : 0.0f;
+                    }
+                }
+            }
+
+            ImGui::InputText("Cache File", weightFieldCachePath, 512);
+
+            if (ImGui::Button("Compute Weight Field")) {
+                app->weightFieldCache = weightFieldCachePath;
+                if (app->computeWeightField() && polyscope::hasSurfaceMesh("Base Mesh")) {
+                    const Eigen::MatrixXd& W = app->getWeightField().getWeights();
+                    for (int k = 0; k < (int)W.cols(); k++) {
+                        Eigen::VectorXd field = W.col(k);
+                        polyscope::getSurfaceMesh("Base Mesh")
+                            ->addVertexScalarQuantity("Weight Field " + std::to_string(k), field);
+                    }
+                }
+            }
+
+            bool useField = app->useWeightField;
+            if (ImGui::Checkbox("Use Weight Field", &useField)) {
+                app->setUseWeightField(useField);
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Target Compression")) {
+            float tol = (float)app->compressionTolerance;
+            if (ImGui::SliderFloat("Error Budget", &tol, 0.0001f, 0.1f, "%.4f")) {
+                app->compressionTolerance = (double)tol;
+            }
+            ImGui::SameLine();
+            ImGui::TextDisabled("(?)");
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("PCA over the target parametrizations: blending costs K instead of N\n"
+                                  "targets per tet. Every target stays within the relative error budget.");
+            }
+            if (ImGui::Button("Compress Targets")) {
+                app->compressTargets();
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Use Full Targets")) {
+                app->clearCompression();
+            }
+            if (app->isCompressed()) {
+                const std::vector<double>& error = app->getCompressionError();
+                double maxError = error.empty() ? 0.0 : *std::max_element(error.begin(), error.end());
+                ImGui::Text("%d components for %d targets, max error %.2e",
+                            app->numCompressionComponents(), app->numBlendMeshes(), maxError);
+            } else {
+                ImGui::TextDisabled("Not compressed");
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Stiffness")) {
+            bool painted = (app->stiffnessMode == SM_PAINT);
+            if (ImGui::Checkbox("Use Painted Stiffness", &painted)) {
+                app->setStiffnessMode(painted ? SM_PAINT : SM_NONE);
+            }
+            ImGui::SameLine();
+            ImGui::TextDisabled("(?)");
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("Stiffer regions resist the blended deformation.\n"
+                                  "Repainting only refactorizes the ARAP system numerically.");
+            }
+
+            ImGui::InputFloat3("Brush Position", brushPosition);
+            ImGui::SliderFloat("Brush Radius", &brushRadius, 0.01f, 2.0f);
+            ImGui::SliderFloat("Brush Stiffness", &brushStiffness, 0.01f, 20.0f);
+
+            bool stiffnessChanged = false;
+            if (ImGui::Button("Apply Brush")) {
+                app->paintStiffness(Eigen::Vector3d(brushPosition[0], brushPosition[1], brushPosition[2]),
+                                    brushRadius, brushStiffness);
+                stiffnessChanged = true;
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Reset Stiffness")) {
+                app->resetStiffness();
+                stiffnessChanged = true;
+            }
+            if (stiffnessChanged && polyscope::hasSurfaceMesh("Base Mesh")) {
+                Eigen::VectorXd stiffness = app->vertexStiffness.size() == app->baseMesh.numVertices()
+                    ? app->vertexStiffness
+                    : Eigen::VectorXd::Ones(app->baseMesh.numVertices());
+                polyscope::getSurfaceMesh("Base Mesh")->addVertexScalarQuantity("Stiffness", stiffness);
             }
         }
     }
@@ -315,13 +661,51 @@ void callback() {
                 }
             }
 
+            // Inverse mode: fit the weights to a sculpted or scanned pose
+            ImGui::Text("Fit Weights to Mesh:");
+            ImGui::InputText("##fitpath", fitMeshPath, 512);
+            ImGui::SameLine();
+            if (ImGui::Button("Fit##weights")) {
+                if (strlen(fitMeshPath) > 0) {
+                    app->fitWeightsToMesh(fitMeshPath);
+                }
+            }
+            ImGui::Checkbox("Clamp to [0,1]", &app->fitClampWeights);
+            ImGui::SameLine();
+            ImGui::Checkbox("Sum to 1", &app->fitSumToOne);
+
             ImGui::Separator();
 
             // Blend mode
-            const char* blend_modes[] = { "SRL", "SSE", "SQL", "LOG3", "LOG4", "SlRL", "AFF" };
-            int current_mode = app->blendMode;
-            if (ImGui::Combo("Blend Mode", &current_mode, blend_modes, 7)) {
-                app->onBlendModeChanged((short)current_mode);
+            int current_mode = (int)(std::find(blendModeValues, blendModeValues + numBlendModes, app->blendMode) -
+                                     blendModeValues);
+            if (ImGui::Combo("Blend Mode", &current_mode, blendModeNames, numBlendModes)) {
+                app->onBlendModeChanged(blendModeValues[current_mode]);
+            }
+
+            // Side-by-side comparison: the checked modes are blended in the same
+            // parametrization pass and shown to the right of the output
+            if (ImGui::Checkbox("Compare Modes", &app->compareBlendModes)) {
+                app->onParameterChanged();
+            }
+            if (app->compareBlendModes) {
+                for (int k = 0; k < numBlendModes; k++) {
+                    std::vector<short>& modes = app->compareModes;
+                    auto it = std::find(modes.begin(), modes.end(), blendModeValues[k]);
+                    bool compared = it != modes.end();
+                    if (k > 0) {
+                        ImGui::SameLine();
+                    }
+                    std::string label = std::string(blendModeNames[k]) + "##compare";
+                    if (ImGui::Checkbox(label.c_str(), &compared)) {
+                        if (compared) {
+                            modes.push_back(blendModeValues[k]);
+                        } else {
+                            modes.erase(it);
+                        }
+                        app->onParameterChanged();
+                    }
+                }
             }
 
             // Tet mode
@@ -349,12 +733,99 @@ void callback() {
                 app->onParameterChanged();
             }
 
+            ImGui::Checkbox("Temporal Coherence", &app->temporalCoherence);
+            ImGui::SameLine();
+            ImGui::TextDisabled("(?)");
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("When a blend mesh is replaced by its next frame, keep each tet's\n"
+                                  "rotation branch close to the previous frame to avoid popping.");
+            }
+
             bool areaWeighted = app->areaWeighted;
             if (ImGui::Checkbox("Area Weighted", &areaWeighted)) {
                 app->areaWeighted = areaWeighted;
                 app->onParameterChanged();
             }
 
+            bool mirror = app->mirrorSymmetry;
+            if (ImGui::Checkbox("Mirror Symmetry", &mirror)) {
+                app->mirrorSymmetry = mirror;
+                app->needsInitialization = true;
+                app->onParameterChanged();
+            }
+            ImGui::SameLine();
+            ImGui::TextDisabled("(?)");
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("Targets that mirror an earlier target (left/right correctives) share\n"
+                                  "its parametrization instead of storing their own.");
+            }
+            if (app->mirrorSymmetry) {
+                const char* axes[] = {"X", "Y", "Z"};
+                if (ImGui::Combo("Mirror Axis", &app->mirrorAxis, axes, 3)) {
+                    app->needsInitialization = true;
+                    app->onParameterChanged();
+                }
+                ImGui::Text("Mirrored targets: %d", app->numMirroredMeshes());
+            }
+
+            ImGui::Checkbox("Background Parametrization", &app->backgroundParametrization);
+            ImGui::SameLine();
+            ImGui::TextDisabled("(?)");
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("Targets are parametrized when their weight first becomes nonzero.\n"
+                                  "This also prepares the unused ones on a background thread.");
+            }
+            ImGui::Text("Parametrized targets: %d / %d", app->numParametrizedMeshes(), app->numBlendMeshes());
+
+            float budget = (float)app->memoryBudgetMB;
+            if (ImGui::InputFloat("Memory Budget (MB)", &budget, 16.0f, 256.0f, "%.0f")) {
+                app->memoryBudgetMB = std::max(0.0, (double)budget);
+                app->onParameterChanged();
+            }
+            ImGui::SameLine();
+            ImGui::TextDisabled("(?)");
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("0 keeps every target's parametrization in memory. Otherwise only the\n"
+                                  "most used targets are kept; the rest are recomputed every blend.");
+            }
+            if (app->memoryBudgetMB > 0.0) {
+                ImGui::Text("Cached targets: %d / %d (%.1f MB)", app->numCachedMeshes(), app->numBlendMeshes(),
+                            app->parametrizationBytes() / (1024.0 * 1024.0));
+            }
+
+            if (ImGui::InputInt("Solver Domains", &app->solverDomains)) {
+                app->solverDomains = std::max(0, app->solverDomains);
+                app->needsInitialization = true;
+                app->onParameterChanged();
+            }
+            ImGui::SameLine();
+            ImGui::TextDisabled("(?)");
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("Split the ARAP solve into subdomains that are factorized and solved\n"
+                                  "in parallel. For large meshes on many cores; 0 factorizes the whole\n"
+                                  "system at once.");
+            }
+            if (app->solverDomains > 1) {
+                ImGui::Text("Interface vertices: %d", app->getSolverInterfaceSize());
+            }
+
+            if (app->numIterations > 1) {
+                float localTol = (float)app->localStepTolerance;
+                if (ImGui::SliderFloat("Local Step Tolerance", &localTol, 0.0f, 0.05f, "%.4f")) {
+                    app->localStepTolerance = (double)localTol;
+                    app->onParameterChanged();
+                }
+                ImGui::SameLine();
+                ImGui::TextDisabled("(?)");
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("Skip refitting rotations of tets that barely moved between iterations.\n"
+                                      "0 refits every tet; a full sweep still runs every few iterations.");
+                }
+                if (app->localStepTolerance > 0.0) {
+                    ImGui::Text("Skipped polar fits: %.1f%%", 100.0 * app->getSkippedFraction());
+                }
+            }
+
             ImGui::Separator();
 
             // Energy visualization
@@ -382,35 +853,43 @@ void callback() {
                                   "Disable for manual control with 'Compute Blend' button.");
             }
 
+            if (realtimeUpdate) {
+                ImGui::Checkbox("Frame Budget", &app->useFrameBudget);
+                ImGui::SameLine();
+                ImGui::TextDisabled("(?)");
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("Lower the iterations, the preview level (looser local step) and the\n"
+                                      "energy update rate while the input changes, to keep each frame within\n"
+                                      "the budget. A full quality pass follows when the input stops.");
+                }
+                if (app->useFrameBudget) {
+                    float frameMs = (float)app->frameBudgetMs;
+                    if (ImGui::SliderFloat("Budget (ms)", &frameMs, 2.0f, 100.0f, "%.1f")) {
+                        app->frameBudgetMs = (double)frameMs;
+                    }
+                    const FrameBudget& budgetState = app->getFrameBudget();
+                    if (budgetState.getFrameTime() >= 0.0) {
+                        ImGui::Text("Frame: %.1f ms, %d iterations, preview level %d",
+                                    budgetState.getFrameTime(), budgetState.getIterations(),
+                                    budgetState.getPreviewLevel());
+                        if (app->visualizeEnergy) {
+                            ImGui::Text("Energy every %d frames", budgetState.getEnergyInterval());
+                        }
+                    }
+                }
+            }
+
             ImGui::Separator();
 
-            // Auto-compute in real-time mode
+            // Auto-compute in real-time mode; with a frame budget, previews
+            // are refined at full quality once the input stops
             if (realtimeUpdate && app->needsRecompute) {
-                if (app->computeBlend()) {
+                if (app->computePreviewBlend()) {
                     app->needsRecompute = false;  // Clear flag after successful blend
-
-                    // Create translated copy for output mesh (position below base mesh)
-                    Eigen::MatrixXd V_output = app->outputMesh.V;
-                    V_output.col(1).array() -= 3.0;  // Offset down in Y
-
-                    // Update or create output mesh visualization
-                    if (polyscope::hasSurfaceMesh("Output Mesh")) {
-                        polyscope::getSurfaceMesh("Output Mesh")->updateVertexPositions(V_output);
-                    } else {
-                        auto* mesh = polyscope::registerSurfaceMesh("Output Mesh",
-                                                                    V_output,
-                                                                    app->outputMesh.F);
-                        mesh->setTransparency(outputMeshOpacity);
-                        mesh->setEnabled(showOutputMesh);
-                    }
-
-                    // Update energy visualization if enabled
-                    if (app->visualizeEnergy && app->outputMesh.vertexEnergy.size() > 0) {
-                        polyscope::getSurfaceMesh("Output Mesh")
-                            ->addVertexScalarQuantity("Energy", app->outputMesh.vertexEnergy)
-                            ->setEnabled(true);
-                    }
+                    updateRealtimeView();
                 }
+            } else if (realtimeUpdate && app->refineBlend()) {
+                updateOutputMeshView();
             }
 
             // Manual compute blend button (only in non-realtime mode)
@@ -421,29 +900,7 @@ void callback() {
                         if (app->computeBlend()) {
                             std::cout << "Blend computation successful" << std::endl;
                             app->needsRecompute = false;  // Clear flag after successful blend
-
-                            // Create translated copy for output mesh (position below base mesh)
-                            Eigen::MatrixXd V_output = app->outputMesh.V;
-                            V_output.col(1).array() -= 3.0;  // Offset down in Y
-
-                            // Update or create output mesh visualization
-                            if (polyscope::hasSurfaceMesh("Output Mesh")) {
-                                polyscope::getSurfaceMesh("Output Mesh")->updateVertexPositions(V_output);
-                            } else {
-                                auto* mesh = polyscope::registerSurfaceMesh("Output Mesh",
-                                                                            V_output,
-                                                                            app->outputMesh.F);
-                                mesh->setTransparency(outputMeshOpacity);
-                                mesh->setEnabled(showOutputMesh);
-                            }
-
-                            // Update energy visualization if enabled
-                            if (app->visualizeEnergy && app->outputMesh.vertexEnergy.size() > 0) {
-                                polyscope::getSurfaceMesh("Output Mesh")
-                                    ->addVertexScalarQuantity("Energy", app->outputMesh.vertexEnergy)
-                                    ->setEnabled(true);
-                                std::cout << "Energy visualization updated" << std::endl;
-                            }
+                            updateOutputMeshView();
                         } else {
                             std::cerr << "Blend computation failed" << std::endl;
                         }
@@ -456,7 +913,11 @@ void callback() {
                 if (app->needsRecompute) {
                     ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "Computing...");
                 } else {
-                    ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "Real-time: Active");
+                    if (app->useFrameBudget && !app->getFrameBudget().refined()) {
+                        ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "Real-time: Preview");
+                    } else {
+                        ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "Real-time: Active");
+                    }
                 }
             }
         }
@@ -479,10 +940,29 @@ int main(int argc, char** argv) {
     polyscope::state::userCallback = callback;
 
     // For testing: load meshes from command line if provided
-    // Usage: ./nway_blender base.obj blend1.obj blend2.obj ...
-    if (argc > 1) {
-        std::cout << "Loading base mesh from: " << argv[1] << std::endl;
-        if (app->loadBaseMesh(argv[1])) {
+    // Usage: ./nway_blender [--weld] [--threads N] [--pin] [--nested] [--rig file] base.obj blend1.obj blend2.obj ...
+    ThreadConfig threads;
+    int firstArg = 1;
+    for (; firstArg < argc; firstArg++) {
+        std::string arg = argv[firstArg];
+        if (arg == "--weld") {
+            app->weldSeams = true;
+        } else if (arg == "--threads" && firstArg + 1 < argc) {
+            threads.numThreads = std::max(0, std::atoi(argv[++firstArg]));
+        } else if (arg == "--pin") {
+            threads.pinThreads = true;
+        } else if (arg == "--nested") {
+            threads.nested = true;
+        } else if (arg == "--rig" && firstArg + 1 < argc) {
+            app->rigImage = argv[++firstArg];
+        } else {
+            break;
+        }
+    }
+    NWayBlender::configureThreads(threads);
+    if (argc > firstArg) {
+        std::cout << "Loading base mesh from: " << argv[firstArg] << std::endl;
+        if (app->loadBaseMesh(argv[firstArg])) {
             // Register base mesh with Polyscope (at origin)
             auto* mesh = polyscope::registerSurfaceMesh("Base Mesh",
                                                         app->baseMesh.V,
@@ -493,7 +973,7 @@ int main(int argc, char** argv) {
             // Load blend meshes if provided
             // Position them in a row to the right
             const double spacing = 3.0;  // Distance between meshes
-            for (int i = 2; i < argc; i++) {
+            for (int i = firstArg + 1; i < argc; i++) {
                 std::cout << "Loading blend mesh from: " << argv[i] << std::endl;
                 int idx = app->addBlendMesh(argv[i]);
                 if (idx >= 0) {
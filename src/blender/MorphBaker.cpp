@@ -0,0 +1,350 @@
+/**
+ * @file MorphBaker.cpp
+ * @brief Morph target baking implementation
+ * @section LICENSE The MIT License
+ * @version 1.0
+ * @date 2026
+ */
+
+#include "MorphBaker.h"
+#include "GltfWriter.h"
+#include <iostream>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <functional>
+
+// Samples blended at once (NWayBlender::computeBlends()); each holds a few
+// lists of the tets while it iterates
+static const int SAMPLE_BATCH = 8;
+
+MorphBaker::MorphBaker()
+    : numInterior(16)
+    , seed(1)
+    , tolerance(1e-3)
+    , maxError(0.0)
+    , rmsError(0.0) {
+}
+
+MorphBaker::~MorphBaker() {
+}
+
+void MorphBaker::setInteriorSamples(int count, unsigned int s) {
+    numInterior = std::max(0, count);
+    seed = s;
+}
+
+double MorphBaker::Driver::value(const std::vector<double>& w) const {
+    double v = oneMinus >= 0 ? 1.0 - w[oneMinus] : 1.0;
+    for (int k : targets) {
+        v *= w[k];
+    }
+    return v;
+}
+
+void MorphBaker::addCandidates(int numMesh, int degree, std::vector<Driver>& candidates) {
+    for (int i = 0; i < numMesh; i++) {
+        // in-between: w_i^(degree-1) (1 - w_i)
+        candidates.push_back(Driver{std::vector<int>(degree - 1, i), i});
+        for (int j = i + 1; j < numMesh; j++) {
+            if (degree == 2) {
+                candidates.push_back(Driver{{i, j}, -1});
+            } else {
+                candidates.push_back(Driver{{i, i, j}, -1});
+                candidates.push_back(Driver{{i, j, j}, -1});
+            }
+        }
+    }
+}
+
+void MorphBaker::makeSamples(int numMesh) {
+    samples.clear();
+    // Corners first: bake() takes the targets from them
+    for (int k = 0; k < numMesh; k++) {
+        std::vector<double> w(numMesh, 0.0);
+        w[k] = 1.0;
+        samples.push_back(w);
+    }
+    for (int k = 0; k < numMesh; k++) {
+        for (double v : {0.25, 0.5, 0.75}) {
+            std::vector<double> w(numMesh, 0.0);
+            w[k] = v;
+            samples.push_back(w);
+        }
+    }
+    for (int i = 0; i < numMesh; i++) {
+        for (int j = i + 1; j < numMesh; j++) {
+            for (auto v : {std::make_pair(1.0, 1.0), std::make_pair(0.5, 0.5),
+                           std::make_pair(1.0, 0.5), std::make_pair(0.5, 1.0)}) {
+                std::vector<double> w(numMesh, 0.0);
+                w[i] = v.first;
+                w[j] = v.second;
+                samples.push_back(w);
+            }
+        }
+    }
+
+    // Interiors: a few active targets, as in typical animation
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.05, 1.0);
+    std::vector<int> order(numMesh);
+    for (int s = 0; s < numInterior; s++) {
+        int maxActive = std::min(numMesh, 4);
+        int active = maxActive < 2 ? maxActive : 2 + (int)(rng() % (unsigned)(maxActive - 1));
+        for (int k = 0; k < numMesh; k++) {
+            order[k] = k;
+        }
+        std::vector<double> w(numMesh, 0.0);
+        for (int a = 0; a < active; a++) {
+            std::swap(order[a], order[a + rng() % (unsigned)(numMesh - a)]);
+            w[order[a]] = uniform(rng);
+        }
+        samples.push_back(w);
+    }
+}
+
+bool MorphBaker::bake(NWayBlender& blender, const Mesh& baseMesh) {
+    int numMesh = blender.numBlendMeshes();
+    int numPts = baseMesh.numVertices();
+    if (numMesh == 0 || numPts == 0) {
+        std::cerr << "MorphBaker::bake() - Need a base mesh and at least one blend mesh" << std::endl;
+        return false;
+    }
+
+    makeSamples(numMesh);
+    int numSample = (int)samples.size();
+    const Mesh::VertexMatrix& base = baseMesh.V;
+    double diag = (base.colwise().maxCoeff() - base.colwise().minCoeff()).norm();
+
+    // Quadratic candidates first, then the cubic ones, with their weight at each sample
+    std::vector<Driver> candidates;
+    addCandidates(numMesh, 2, candidates);
+    int numQuadratic = (int)candidates.size();
+    addCandidates(numMesh, 3, candidates);
+    int numCandidates = (int)candidates.size();
+    Eigen::MatrixXd Phi(numSample, numCandidates);
+    for (int s = 0; s < numSample; s++) {
+        for (int p = 0; p < numCandidates; p++) {
+            Phi(s, p) = candidates[p].value(samples[s]);
+        }
+    }
+
+    // Blend the samples from firstSample a batch at a time (the corners
+    // first, as they give the targets) and pass the residual of the linear
+    // targets of each later batch to use, one row of 3 * numPts per sample
+    targets.assign(numMesh, Eigen::MatrixXd());
+    std::vector<Mesh> outputs(std::min(SAMPLE_BATCH, numSample), baseMesh);
+    auto forEachBatch = [&](int firstSample, const std::function<void(int, const Eigen::MatrixXd&)>& use) {
+        Eigen::MatrixXd residual;
+        for (int first = firstSample, last; first < numSample; first = last) {
+            last = std::min(first + SAMPLE_BATCH, first < numMesh ? numMesh : numSample);
+            std::vector<std::vector<double>> weights(samples.begin() + first, samples.begin() + last);
+            std::vector<Mesh*> out;
+            for (int b = 0; b < last - first; b++) {
+                out.push_back(&outputs[b]);
+            }
+            if (!blender.computeBlends(weights, out)) {
+                std::cerr << "MorphBaker::bake() - Blend of samples " << first << " to " << last - 1
+                          << " failed" << std::endl;
+                return false;
+            }
+            if (first < numMesh) {
+                for (int s = first; s < last; s++) {
+                    targets[s] = outputs[s - first].V - base;
+                }
+                continue;
+            }
+            residual.resize(last - first, 3 * numPts);
+            for (int s = first; s < last; s++) {
+                Eigen::MatrixXd delta = outputs[s - first].V - base;
+                for (int k = 0; k < numMesh; k++) {
+                    if (samples[s][k] != 0.0) {
+                        delta -= samples[s][k] * targets[k];
+                    }
+                }
+                residual.row(s - first) = Eigen::Map<const Eigen::RowVectorXd>(delta.data(), delta.size());
+            }
+            use(first, residual);
+        }
+        return true;
+    };
+
+    // Right-hand sides of the normal equations of all candidates; the
+    // residuals of the corners are zero
+    std::cout << "MorphBaker: Sampling " << numSample << " blends..." << std::endl;
+    Eigen::MatrixXd PhiTR = Eigen::MatrixXd::Zero(numCandidates, 3 * numPts);
+    bool sampled = forEachBatch(0, [&](int first, const Eigen::MatrixXd& residual) {
+        PhiTR.noalias() += Phi.middleRows(first, residual.rows()).transpose() * residual;
+    });
+    if (!sampled) {
+        return false;
+    }
+
+    // Weights of the candidates cols at count samples from first
+    auto design = [&](const std::vector<int>& cols, int first, int count) {
+        Eigen::MatrixXd P(count, cols.size());
+        for (size_t p = 0; p < cols.size(); p++) {
+            P.col(p) = Phi.col(cols[p]).segment(first, count);
+        }
+        return P;
+    };
+    // Least squares fit of the correctives of the candidates cols
+    auto fit = [&](const std::vector<int>& cols, Eigen::MatrixXd& C) {
+        C.resize(cols.size(), 3 * numPts);
+        if (cols.empty()) {
+            return;
+        }
+        for (size_t p = 0; p < cols.size(); p++) {
+            C.row(p) = PhiTR.row(cols[p]);
+        }
+        // Normal equations with a little ridge for drivers the design cannot tell apart
+        Eigen::MatrixXd P = design(cols, 0, numSample);
+        Eigen::MatrixXd N = P.transpose() * P;
+        double ridge = 1e-9 * std::max(1.0, N.diagonal().maxCoeff());
+        N.diagonal().array() += ridge;
+        C = N.ldlt().solve(C);
+    };
+    // Drop correctives that move no vertex by more than the tolerance, and refit the rest
+    auto prune = [&](const std::vector<int>& cols, const Eigen::MatrixXd& C,
+                     std::vector<int>& kept, Eigen::MatrixXd& keptC) {
+        kept.clear();
+        for (size_t p = 0; p < cols.size(); p++) {
+            Eigen::RowVectorXd row = C.row(p);
+            Eigen::Map<const Eigen::MatrixXd> D(row.data(), numPts, 3);
+            if (Phi.col(cols[p]).cwiseAbs().maxCoeff() * D.rowwise().norm().maxCoeff() > tolerance * diag) {
+                kept.push_back(cols[p]);
+            }
+        }
+        if (kept.size() != cols.size()) {
+            fit(kept, keptC);
+        } else {
+            keptC = C;
+        }
+    };
+
+    // Quadratic correctives, and cubic ones if those miss the tolerance. Both
+    // are fitted now; which one is kept depends on the errors below
+    std::vector<int> quadratic(numQuadratic), cubic(numCandidates);
+    for (int p = 0; p < numCandidates; p++) {
+        cubic[p] = p;
+        if (p < numQuadratic) {
+            quadratic[p] = p;
+        }
+    }
+    std::vector<std::vector<int>> fitCols(3);
+    std::vector<Eigen::MatrixXd> fitC(3);
+    fitCols[0] = quadratic;
+    fit(quadratic, fitC[0]);
+    prune(quadratic, fitC[0], fitCols[1], fitC[1]);
+    Eigen::MatrixXd cubicC;
+    fit(cubic, cubicC);
+    prune(cubic, cubicC, fitCols[2], fitC[2]);
+
+    // Largest vertex error over the samples, and the sum of squares, of the
+    // quadratic fit, the pruned quadratic one and the pruned cubic one. The
+    // residuals are not kept, so the samples are blended again; the corners
+    // are exact
+    std::cout << "MorphBaker: Checking the fits on the samples..." << std::endl;
+    std::vector<double> maxSq(3, 0.0), sumSq(3, 0.0);
+    std::vector<double> sampleMax(SAMPLE_BATCH), sampleSq(SAMPLE_BATCH);
+    sampled = forEachBatch(numMesh, [&](int first, const Eigen::MatrixXd& residual) {
+        int count = (int)residual.rows();
+        for (int f = 0; f < 3; f++) {
+            Eigen::MatrixXd error = residual;
+            if (!fitCols[f].empty()) {
+                error.noalias() -= design(fitCols[f], first, count) * fitC[f];
+            }
+            #pragma omp parallel for
+            for (int b = 0; b < count; b++) {
+                sampleMax[b] = 0.0;
+                sampleSq[b] = 0.0;
+                for (int v = 0; v < numPts; v++) {
+                    double sq = error(b, v) * error(b, v) + error(b, numPts + v) * error(b, numPts + v)
+                              + error(b, 2 * numPts + v) * error(b, 2 * numPts + v);
+                    sampleMax[b] = std::max(sampleMax[b], sq);
+                    sampleSq[b] += sq;
+                }
+            }
+            for (int b = 0; b < count; b++) {
+                maxSq[f] = std::max(maxSq[f], sampleMax[b]);
+                sumSq[f] += sampleSq[b];
+            }
+        }
+    });
+    if (!sampled) {
+        return false;
+    }
+    int chosen = std::sqrt(maxSq[0]) / diag <= tolerance ? 1 : 2;
+
+    drivers.clear();
+    correctives.resize(fitCols[chosen].size());
+    for (size_t p = 0; p < fitCols[chosen].size(); p++) {
+        drivers.push_back(candidates[fitCols[chosen][p]]);
+        Eigen::RowVectorXd row = fitC[chosen].row(p);
+        correctives[p] = Eigen::Map<const Eigen::MatrixXd>(row.data(), numPts, 3);
+    }
+    maxError = std::sqrt(maxSq[chosen]) / diag;
+    rmsError = std::sqrt(sumSq[chosen] / ((double)numSample * numPts)) / diag;
+
+    std::cout << "MorphBaker: " << numMesh << " targets and " << correctives.size() << " of "
+              << (chosen == 1 ? numQuadratic : numCandidates) << " correctives, max error " << maxError
+              << ", RMS error " << rmsError << " (relative to the bounding box)" << std::endl;
+    if (maxError > tolerance) {
+        std::cerr << "MorphBaker::bake() - Max error exceeds the tolerance " << tolerance
+                  << "; the blend is not cubic in the weights there" << std::endl;
+    }
+    return true;
+}
+
+Eigen::MatrixXd MorphBaker::evaluate(const Mesh& baseMesh, const std::vector<double>& weights) const {
+    Eigen::MatrixXd X = baseMesh.V;
+    for (size_t k = 0; k < targets.size() && k < weights.size(); k++) {
+        X += weights[k] * targets[k];
+    }
+    if (weights.size() >= targets.size()) {
+        for (size_t p = 0; p < correctives.size(); p++) {
+            X += drivers[p].value(weights) * correctives[p];
+        }
+    }
+    return X;
+}
+
+bool MorphBaker::saveGLB(const std::string& path, const Mesh& baseMesh, const std::vector<std::string>& targetNames) const {
+    if (targets.empty() || targets[0].rows() != baseMesh.numVertices()) {
+        std::cerr << "MorphBaker::saveGLB() - Nothing baked for this mesh" << std::endl;
+        return false;
+    }
+
+    std::vector<Eigen::MatrixXd> deltas;
+    std::vector<std::string> names;
+    for (size_t k = 0; k < targets.size(); k++) {
+        deltas.push_back(baseMesh.unweld(targets[k]));
+        names.push_back(k < targetNames.size() ? targetNames[k] : "target" + std::to_string(k));
+    }
+    std::string extras = "\"correctiveDrivers\":[";
+    for (size_t p = 0; p < correctives.size(); p++) {
+        const Driver& d = drivers[p];
+        deltas.push_back(baseMesh.unweld(correctives[p]));
+        std::string name, list;
+        for (size_t f = 0; f < d.targets.size(); f++) {
+            name += (f ? " x " : "") + names[d.targets[f]];
+            list += (f ? "," : "") + std::to_string(d.targets[f]);
+        }
+        if (d.oneMinus >= 0) {
+            name += " x (1 - " + names[d.oneMinus] + ")";
+        }
+        names.push_back(name);
+        extras += (p ? ",{" : "{") + std::string("\"targets\":[") + list + "]";
+        if (d.oneMinus >= 0) {
+            extras += ",\"oneMinus\":" + std::to_string(d.oneMinus);
+        }
+        extras += "}";
+    }
+    extras += "]";
+
+    if (!GltfWriter::writeMorphGLB(path, baseMesh.unweldedVertices(), baseMesh.unweldedFaces(), deltas, names, extras)) {
+        return false;
+    }
+    std::cout << "Saved " << deltas.size() << " morph targets to " << path << std::endl;
+    return true;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file MorphBaker.h
+ * @brief Bake N-way ARAP blends into linear morph targets and correctives
+ * @section LICENSE The MIT License
+ * @version 1.0
+ * @date 2026
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "Mesh.h"
+#include "NWayBlender.h"
+
+/**
+ * @brief Linear morph target model fitted to the nonlinear blend
+ *
+ * Runtimes that only blend morph targets linearly get, per blend mesh k,
+ * the delta D_k of its ARAP blend at weight 1, and corrective deltas C_p
+ * whose weights are products of blend weights:
+ *
+ *   x(w) = base + sum_k w_k D_k + sum_p phi_p(w) C_p
+ *
+ * phi_p is w_i w_j (and w_i^2 w_j, w_i w_j^2) for combination shapes of
+ * targets i < j, and w_i (1 - w_i) (and w_i^2 (1 - w_i)) for in-between
+ * shapes of target i. All vanish at the corners, which stay exact.
+ *
+ * The blend is sampled over a weight-space design: corners, single targets at
+ * 1/4, 1/2 and 3/4, pairs at (1, 1), (1/2, 1/2), (1, 1/2) and (1/2, 1), and
+ * random interiors with two to four active targets. The quadratic correctives
+ * are fitted to all samples by least squares, and the cubic ones added if
+ * that misses the tolerance. Correctives that move no vertex by more than
+ * the tolerance are then dropped and the rest refitted, so that the set
+ * stays compact.
+ */
+class MorphBaker {
+public:
+    /**
+     * @brief Weight of a corrective: product of the weights of targets (repeats
+     * allowed), times (1 - w_oneMinus) for in-betweens (oneMinus = -1 otherwise)
+     */
+    struct Driver {
+        std::vector<int> targets;
+        int oneMinus;
+        double value(const std::vector<double>& w) const;
+    };
+
+    MorphBaker();
+    ~MorphBaker();
+
+    /**
+     * @brief Set the number of random interior samples and their seed
+     */
+    void setInteriorSamples(int count, unsigned int seed = 1);
+
+    /**
+     * @brief Set the largest vertex error allowed, relative to the bounding box diagonal
+     */
+    void setTolerance(double tol) { tolerance = tol; }
+
+    /**
+     * @brief Sample the blend and fit the morph targets and correctives
+     *
+     * Each sample is the blend of computeBlend() with the engine's current
+     * settings. The samples are blended in batches with computeBlends(),
+     * whose blends are assembled concurrently and solved together, and
+     * twice: once to accumulate the normal equations of the fit, and once
+     * to measure the errors of the fits, so that only the residuals of one
+     * batch are held.
+     *
+     * @param blender Initialized engine
+     * @param baseMesh Base mesh of the engine (output layout of the blends)
+     * @return true if successful
+     */
+    bool bake(NWayBlender& blender, const Mesh& baseMesh);
+
+    /**
+     * @brief Write the base mesh with the morph targets and correctives as binary glTF
+     *
+     * Targets come first, in blend mesh order, followed by the correctives.
+     * mesh.extras holds targetNames and, for each corrective, its driver:
+     * the targets whose weights multiply, and oneMinus for in-betweens.
+     * Welded meshes are written in the layout of their file.
+     *
+     * @param path Output .glb path
+     * @param baseMesh Base mesh passed to bake()
+     * @param targetNames Name of each blend mesh
+     * @return true if successful
+     */
+    bool saveGLB(const std::string& path, const Mesh& baseMesh, const std::vector<std::string>& targetNames) const;
+
+    /**
+     * @brief Evaluate the linear model at a weight vector
+     * @param baseMesh Base mesh passed to bake()
+     * @param weights Per-mesh weights
+     * @return Vertex positions (numPts x 3)
+     */
+    Eigen::MatrixXd evaluate(const Mesh& baseMesh, const std::vector<double>& weights) const;
+
+    int numTargets() const { return (int)targets.size(); }
+    int numCorrectives() const { return (int)correctives.size(); }
+    int numSamples() const { return (int)samples.size(); }
+
+    /**
+     * @brief Largest and RMS vertex error over the samples, relative to the bounding box diagonal
+     */
+    double getMaxError() const { return maxError; }
+    double getRmsError() const { return rmsError; }
+
+    const std::vector<Eigen::MatrixXd>& getTargets() const { return targets; }
+    const std::vector<Eigen::MatrixXd>& getCorrectives() const { return correctives; }
+
+    const std::vector<Driver>& getDrivers() const { return drivers; }
+
+private:
+    int numInterior;                            ///< Random interior samples
+    unsigned int seed;                          ///< Seed of the interior samples
+    double tolerance;                           ///< Relative to the bounding box diagonal
+    std::vector<std::vector<double>> samples;   ///< Weight vectors of the last bake
+    std::vector<Eigen::MatrixXd> targets;       ///< numPts x 3 delta per blend mesh
+    std::vector<Eigen::MatrixXd> correctives;   ///< numPts x 3 delta per corrective
+    std::vector<Driver> drivers;                ///< Weight of each corrective
+    double maxError;
+    double rmsError;
+
+    /**
+     * @brief Build the weight-space design for numMesh targets
+     */
+    void makeSamples(int numMesh);
+
+    /**
+     * @brief Candidate correctives of the given degree (2 or 3)
+     */
+    static void addCandidates(int numMesh, int degree, std::vector<Driver>& candidates);
+};
@@ -5,98 +5,581 @@
 
 #include "NWayBlender.h"
 #include "MeshUtils.h"
+#include "RigImage.h"
+#include "lbfgs.h"
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <chrono>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#endif
 
 // Template helper functions for blending (from original nwayBlender.cpp)
 
+// Weight of mesh j on tet i, modulated by the per-tet mask if mesh j has one
+inline double maskedWeight(const std::vector<double>& weight, const std::vector<std::vector<double>>& mask,
+                           int j, int i) {
+    return (j < (int)mask.size() && !mask[j].empty()) ? weight[j] * mask[j][i] : weight[j];
+}
+
+// Per-mesh data of a parametrization list (see paramLists()): the blend
+// helpers read mesh j's per-tet values from A[j]
+
 template<typename T>
-void blendMatList(const std::vector<std::vector<T>>& A, const std::vector<double>& weight, std::vector<T>& X) {
+void blendMatList(const std::vector<const T*>& A, const std::vector<double>& weight, std::vector<T>& X,
+                  const std::vector<std::vector<double>>& mask) {
     int numMesh = (int)A.size();
     if (numMesh == 0) return;
-    int numTet = (int)A[0].size();
+    int numTet = (int)X.size();
+    #pragma omp parallel for schedule(static)
     for (int i = 0; i < numTet; i++) {
         X[i].setZero();
         for (int j = 0; j < numMesh; j++) {
-            X[i] += weight[j] * A[j][i];
+            if (weight[j] == 0.0) continue;     // may not be parametrized (see prepareParametrization)
+            X[i] += maskedWeight(weight, mask, j, i) * A[j][i];
         }
     }
 }
 
 template<typename T>
-void blendMatLinList(const std::vector<std::vector<T>>& A, const std::vector<double>& weight, std::vector<T>& X) {
+void blendMatLinList(const std::vector<const T*>& A, const std::vector<double>& weight, std::vector<T>& X,
+                     const std::vector<std::vector<double>>& mask) {
     int numMesh = (int)A.size();
     if (numMesh == 0) return;
-    int numTet = (int)A[0].size();
+    int numTet = (int)X.size();
+    #pragma omp parallel for schedule(static)
     for (int i = 0; i < numTet; i++) {
         double sum = 0.0;
         X[i].setZero();
         for (int j = 0; j < numMesh; j++) {
-            X[i] += weight[j] * A[j][i];
-            sum += weight[j];
+            if (weight[j] == 0.0) continue;
+            double w = maskedWeight(weight, mask, j, i);
+            X[i] += w * A[j][i];
+            sum += w;
         }
         X[i] += (1.0 - sum) * T::Identity();
     }
 }
 
-void blendQuatList(const std::vector<std::vector<Vector4d>>& A, const std::vector<double>& weight,
-                  std::vector<Vector4d>& X) {
+void blendQuatList(const std::vector<const Vector4d*>& A, const std::vector<double>& weight,
+                  std::vector<Vector4d>& X, const std::vector<std::vector<double>>& mask,
+                  bool normalize = true) {
     int numMesh = (int)A.size();
     if (numMesh == 0) return;
-    int numTet = (int)A[0].size();
+    int numTet = (int)X.size();
     Vector4d I(0, 0, 0, 1);
+    #pragma omp parallel for schedule(static)
     for (int i = 0; i < numTet; i++) {
         double sum = 0.0;
         X[i].setZero();
         for (int j = 0; j < numMesh; j++) {
-            X[i] += weight[j] * A[j][i];
-            sum += weight[j];
+            if (weight[j] == 0.0) continue;
+            double w = maskedWeight(weight, mask, j, i);
+            X[i] += w * A[j][i];
+            sum += w;
         }
         X[i] += (1.0 - sum) * I;
-        X[i] = X[i].normalized();
+        if (normalize) {
+            X[i] = X[i].normalized();
+        }
+    }
+}
+
+// Mesh j's list of a parametrized quantity: the attached rig image's where it
+// has one, else the own list. Only meshes with a nonzero weight are looked up;
+// the lists of the others may be resized meanwhile by the background
+// parametrization (see prepareParametrization())
+template<typename T>
+static std::vector<const T*> paramLists(const std::vector<std::vector<T>>& own, const std::vector<const T*>& shared,
+                                        const std::vector<double>& weight) {
+    std::vector<const T*> A(own.size(), nullptr);
+    for (size_t j = 0; j < own.size() && j < weight.size(); j++) {
+        if (weight[j] == 0.0) continue;
+        A[j] = (j < shared.size() && shared[j]) ? shared[j] : own[j].data();
+    }
+    return A;
+}
+
+// Streaming PCA of one parametrized quantity over the blend meshes.
+// Each mesh's per-tet list (minus offset) is one vector of length numTet*dim.
+// Meshes are visited once: the part not captured by the current basis is
+// appended as a new direction when it exceeds half the error budget. An SVD of
+// the small coefficient matrix then rotates the basis onto principal
+// directions, and the trailing ones are dropped while every mesh stays within
+// the budget. error[j] receives the relative error of mesh j.
+template<typename T>
+void compressParamList(const std::vector<std::vector<T>>& A, const T& offset, double tolerance,
+                       ParamBasis<T>& P, std::vector<double>& error) {
+    const int dim = T::SizeAtCompileTime;
+    int numMesh = (int)A.size();
+    int numTet = numMesh > 0 ? (int)A[0].size() : 0;
+    int D = numTet * dim;
+
+    std::vector<VectorXd> Q;                    // orthonormal directions
+    std::vector<VectorXd> c(numMesh);           // coefficients in Q
+    std::vector<double> residual(numMesh), norm(numMesh);
+    VectorXd a(D);
+    for (int j = 0; j < numMesh; j++) {
+        for (int i = 0; i < numTet; i++) {
+            Map<Matrix<double, dim, 1>>(a.data() + dim * i) =
+                Map<const Matrix<double, dim, 1>>((A[j][i] - offset).eval().data());
+        }
+        norm[j] = a.norm();
+        c[j] = VectorXd::Zero(Q.size());
+        // project twice for numerical orthogonality
+        for (int pass = 0; pass < 2; pass++) {
+            for (size_t k = 0; k < Q.size(); k++) {
+                double t = Q[k].dot(a);
+                c[j][k] += t;
+                a -= t * Q[k];
+            }
+        }
+        residual[j] = a.norm();
+        if (residual[j] > 0.5 * tolerance * norm[j] && residual[j] > 0.0) {
+            Q.push_back(a / residual[j]);
+            c[j].conservativeResize(Q.size());
+            c[j][Q.size() - 1] = residual[j];
+            residual[j] = 0.0;
+        }
+    }
+
+    // principal directions of the captured part
+    int K0 = (int)Q.size();
+    MatrixXd C = MatrixXd::Zero(K0, numMesh);
+    for (int j = 0; j < numMesh; j++) {
+        C.col(j).head(c[j].size()) = c[j];
+    }
+    MatrixXd U = MatrixXd::Identity(K0, K0);
+    if (K0 > 0) {
+        JacobiSVD<MatrixXd> svd(C, ComputeThinU);
+        U = svd.matrixU();
+    }
+    MatrixXd Cp = U.transpose() * C;            // coefficients in the principal basis
+
+    // smallest K keeping every mesh within the budget
+    int K = K0;
+    while (K > 0) {
+        bool ok = true;
+        for (int j = 0; j < numMesh && ok; j++) {
+            double e2 = residual[j] * residual[j] + Cp.col(j).tail(K0 - K + 1).squaredNorm();
+            ok = std::sqrt(e2) <= tolerance * norm[j];
+        }
+        if (!ok) break;
+        K--;
+    }
+
+    error.resize(numMesh);
+    for (int j = 0; j < numMesh; j++) {
+        double e2 = residual[j] * residual[j] + Cp.col(j).tail(K0 - K).squaredNorm();
+        error[j] = norm[j] > 0.0 ? std::sqrt(e2) / norm[j] : 0.0;
+    }
+
+    P.coef = Cp.topRows(K);
+    P.basis.assign(K, std::vector<T>(numTet));
+    for (int k = 0; k < K; k++) {
+        VectorXd b = VectorXd::Zero(D);
+        for (int l = 0; l < K0; l++) {
+            b += U(l, k) * Q[l];
+        }
+        for (int i = 0; i < numTet; i++) {
+            Map<Matrix<double, dim, 1>>(P.basis[k][i].data()) = b.segment<dim>(dim * i);
+        }
+    }
+}
+
+// Blend through the compressed basis: X = offset + sum_k (coef * weight)_k basis_k
+template<typename T>
+void blendParamBasis(const ParamBasis<T>& P, const std::vector<double>& weight, const T& offset,
+                     std::vector<T>& X) {
+    VectorXd w = Map<const VectorXd>(weight.data(), weight.size());
+    VectorXd cw = P.coef * w;
+    int K = (int)P.basis.size();
+    int numTet = (int)X.size();
+    #pragma omp parallel for
+    for (int i = 0; i < numTet; i++) {
+        X[i] = offset;
+        for (int k = 0; k < K; k++) {
+            X[i] += cw[k] * P.basis[k][i];
+        }
+    }
+}
+
+// Rotation logs of meshes that are not cached: each log of R is (theta + 2 pi k) n,
+// where theta n is the principal log. Only k is kept per tet; logs it cannot
+// represent (R = I has no axis) are marked with explicitBranch and kept whole.
+static const int streamTileGroups = 256;        // tet groups recomputed per tile
+static const double meshUsageDecay = 0.99;      // per blend
+static const signed char explicitBranch = -128;
+
+static signed char logBranchOf(const Matrix3d& X, const Matrix3d& X0) {
+    double theta0 = X0.norm() / M_SQRT2;
+    if (theta0 < 1e-8) {
+        return X.squaredNorm() == 0.0 ? 0 : explicitBranch;
     }
+    double theta = X.cwiseProduct(X0).sum() / (2.0 * theta0);
+    double k = std::round((theta - theta0) / (2.0 * M_PI));
+    return (signed char)std::max(-127.0, std::min(127.0, k));
+}
+
+static Matrix3d logSOBranch(const Matrix3d& R, signed char k) {
+    Matrix3d X = logSO(R);
+    double theta0 = X.norm() / M_SQRT2;
+    if (k == 0 || theta0 < 1e-8) {
+        return X;
+    }
+    return (1.0 + 2.0 * M_PI * k / theta0) * X;
+}
+
+// Mirror images: for the reflection M flipping coordinate axis about the plane
+// x[axis] = plane, the mirror image of the row-vector affine map x -> x GL + L is
+// x -> x (M GL M) + mirrorTranslation(GL, L). Logs, polar factors and rotations
+// are conjugated the same way; the quaternion (v, w) of R becomes (-M v, w).
+static Matrix3d mirrorMatrix(Matrix3d X, int axis) {
+    X.row(axis) *= -1.0;
+    X.col(axis) *= -1.0;
+    return X;
+}
+
+static Vector3d mirrorTranslation(const Matrix3d& GL, const Vector3d& L, int axis, double plane) {
+    Vector3d t = L + 2.0 * plane * GL.row(axis).transpose();
+    t[axis] = 2.0 * plane - t[axis];
+    return t;
+}
+
+static Vector4d mirrorQuat(Vector4d q, int axis) {
+    q.head<3>() = -q.head<3>();
+    q[axis] = -q[axis];
+    return q;
 }
 
 // ========== NWayBlender Implementation ==========
 
 NWayBlender::NWayBlender()
     : numPts(0)
+    , solver(new Laplacian())
+    , memoryBudget(0)
+    , mirrorSymmetry(false)
+    , mirrorAxis(0)
+    , mirrorTolerance(1e-4)
+    , userMirrorPlane(0.0)
+    , mirrorPlane(0.0)
+    , mirrorMaxDist(0.0)
+    , compressedMode(-1)
+    , compressedMeshes(0)
     , blendMode(BM_LOG3)
     , tetMode(TM_FACE)
     , numIterations(1)
     , rotationConsistency(false)
     , areaWeighted(false)
     , initRotationAngle(0.0)
+    , temporalCoherence(false)
+    , temporalJumpAngle(45.0)
+    , localStepTolerance(0.0)
+    , fullSweepInterval(4)
+    , numRefitted(0)
+    , numLocalVisited(0)
     , needsInitialization(true)
     , needsParametrization(true)
-    , numParametrized(0) {
+    , paramStop(false)
+    , rebaseTarget(-1)
+    , rebaseError(0)
+    , rebaseReady(false) {
 }
 
 NWayBlender::~NWayBlender() {
+    stopBackgroundParametrization();
+    cancelRebase();
+    detachRig();
+}
+
+#ifdef __linux__
+// Cores of the process before configureThreads() pinned the OpenMP threads
+static cpu_set_t processCpus;
+static bool threadsPinned = false;
+#endif
+
+// Let a background thread run on any core of the process; threads inherit
+// the pinning of the thread that creates them
+static void unpinCurrentThread() {
+#ifdef __linux__
+    if (threadsPinned) {
+        pthread_setaffinity_np(pthread_self(), sizeof(processCpus), &processCpus);
+    }
+#endif
+}
+
+bool NWayBlender::configureThreads(const ThreadConfig& config) {
+#ifdef _OPENMP
+    omp_set_dynamic(0);
+    if (config.numThreads > 0) {
+        omp_set_num_threads(config.numThreads);
+    }
+    omp_set_max_active_levels(config.nested ? 2 : 1);
+#endif
+    if (!config.pinThreads) {
+        return true;
+    }
+#if defined(__linux__) && defined(_OPENMP)
+    if (!threadsPinned && sched_getaffinity(0, sizeof(processCpus), &processCpus) != 0) {
+        std::cerr << "NWayBlender::configureThreads() - Cannot read the cores of the process" << std::endl;
+        return false;
+    }
+    std::vector<int> cpus;
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &processCpus)) {
+            cpus.push_back(c);
+        }
+    }
+    if (cpus.empty()) {
+        return false;
+    }
+
+    // The runtime keeps its threads between regions of the same size
+    int failed = 0;
+    #pragma omp parallel reduction(+:failed)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[omp_get_thread_num() % cpus.size()], &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            failed++;
+        }
+    }
+    threadsPinned = true;
+    if (failed > 0) {
+        std::cerr << "NWayBlender::configureThreads() - Could not pin " << failed << " threads" << std::endl;
+        return false;
+    }
+    std::cout << "NWayBlender: Pinned " << omp_get_max_threads() << " threads to "
+              << cpus.size() << " cores" << std::endl;
+    return true;
+#else
+    std::cerr << "NWayBlender::configureThreads() - Thread pinning is not supported on this platform" << std::endl;
+    return false;
+#endif
+}
+
+void NWayBlender::setBlendMode(short mode) {
+    if (mode != blendMode) {
+        stopBackgroundParametrization();
+        blendMode = mode;
+        needsParametrization = true;
+    }
+}
+
+void NWayBlender::setCompareModes(const std::vector<short>& modes) {
+    bool added = false;
+    for (short mode : modes) {
+        added = added || !parametrizesMode(mode);
+    }
+    bool removed = false;
+    for (short mode : compareModes) {
+        removed = removed || std::find(modes.begin(), modes.end(), mode) == modes.end();
+    }
+    if (!added && !removed) {
+        return;
+    }
+    stopBackgroundParametrization();
+    compareModes = modes;
+    if (added) {
+        needsParametrization = true;
+        return;
+    }
+    // Free the lists no mode kept uses any more
+    for (size_t j = 0; j < logGL.size(); j++) {
+        if (!parametrizesMode(BM_LOG3)) {
+            std::vector<Matrix3d>().swap(logGL[j]);
+        }
+        if (!parametrizesMode(BM_SQL)) {
+            std::vector<Vector4d>().swap(quat[j]);
+        }
+    }
+}
+
+bool NWayBlender::parametrizesMode(short mode) const {
+    return mode == blendMode || std::find(compareModes.begin(), compareModes.end(), mode) != compareModes.end();
+}
+
+void NWayBlender::setTetMode(short mode) {
+    stopBackgroundParametrization();
+    tetMode = mode;
+    needsInitialization = true;
+}
+
+void NWayBlender::setRotationConsistency(bool enable) {
+    if (enable != rotationConsistency) {
+        stopBackgroundParametrization();
+        rotationConsistency = enable;
+        needsParametrization = true;
+    }
+}
+
+void NWayBlender::setInitRotation(double angle) {
+    if (angle != initRotationAngle) {
+        stopBackgroundParametrization();
+        initRotationAngle = angle;
+        needsParametrization = needsParametrization || rotationConsistency;
+    }
+}
+
+void NWayBlender::setTemporalCoherence(bool enable, double jumpAngle) {
+    if (enable != temporalCoherence || jumpAngle != temporalJumpAngle) {
+        stopBackgroundParametrization();
+        temporalCoherence = enable;
+        temporalJumpAngle = jumpAngle;
+    }
+}
+
+void NWayBlender::setSolverDomains(int numDomains) {
+    if (numDomains != solver->numDomains) {
+        solver->numDomains = numDomains;
+        needsInitialization = true;
+    }
+}
+
+void NWayBlender::setMirrorSymmetry(bool enable, int axis, double tolerance) {
+    if (enable != mirrorSymmetry || axis != mirrorAxis || tolerance != mirrorTolerance) {
+        stopBackgroundParametrization();
+        mirrorSymmetry = enable;
+        mirrorAxis = axis;
+        mirrorTolerance = tolerance;
+        needsInitialization = true;
+    }
+}
+
+void NWayBlender::setMirrorMap(const std::vector<int>& mirror, double plane) {
+    stopBackgroundParametrization();
+    userPtsMirror = mirror;
+    userMirrorPlane = plane;
+    needsInitialization = true;
+}
+
+int NWayBlender::numMirroredMeshes() const {
+    return (int)std::count_if(mirrorSource.begin(), mirrorSource.end(), [](int k) { return k >= 0; });
+}
+
+bool NWayBlender::isMirrorImage(int j, int k) const {
+    if (ptsMirror.empty() || j == k) {
+        return false;
+    }
+    const Mesh::VertexMatrix& Vj = blendMeshes[j].V;
+    const Mesh::VertexMatrix& Vk = blendMeshes[k].V;
+    if (Vj.rows() != numPts || Vk.rows() != numPts) {
+        return false;
+    }
+    double maxDist2 = mirrorMaxDist * mirrorMaxDist;
+    for (int v = 0; v < numPts; v++) {
+        Vector3d p = Vk.row(ptsMirror[v]).transpose();
+        p[mirrorAxis] = 2.0 * mirrorPlane - p[mirrorAxis];
+        if ((Vj.row(v).transpose() - p).squaredNorm() > maxDist2) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void NWayBlender::updateMirrorSource(int index) {
+    if (ptsMirror.empty() || index >= (int)mirrorSource.size()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(paramMutex);
+    // Meshes mirroring this one keep sharing only if they still mirror it
+    bool isSource = false;
+    for (int j = 0; j < (int)mirrorSource.size(); j++) {
+        if (mirrorSource[j] != index) continue;
+        if (isMirrorImage(j, index)) {
+            isSource = true;
+        } else {
+            mirrorSource[j] = -1;
+            paramState[j] = PS_PENDING;
+        }
+    }
+    mirrorSource[index] = -1;
+    for (int k = 0; k < (int)mirrorSource.size() && !isSource; k++) {
+        if (mirrorSource[k] < 0 && isMirrorImage(index, k)) {
+            mirrorSource[index] = k;
+            releaseParametrization(index);
+            std::vector<signed char>().swap(logBranch[index]);
+            std::vector<std::pair<int, Matrix3d>>().swap(logExplicit[index]);
+            break;
+        }
+    }
 }
 
 void NWayBlender::setBaseMesh(const Mesh& mesh) {
+    stopBackgroundParametrization();
+    cancelRebase();
     baseMesh = mesh;
     pts = baseMesh.getVerticesAsVector3d();
     numPts = (int)pts.size();
+    if (ptsMask.rows() != numPts) {
+        ptsMask.resize(0, 0);
+        tetMask.clear();
+    }
+    if (ptsStiffness.size() != numPts) {
+        ptsStiffness.resize(0);
+    }
+    if ((int)basePose.size() != numPts) {
+        basePose.clear();
+    }
     needsInitialization = true;
     needsParametrization = true;
-    numParametrized = 0;
 }
 
 void NWayBlender::addBlendMesh(const Mesh& mesh) {
+    stopBackgroundParametrization();
     blendMeshes.push_back(mesh);
-    needsParametrization = true;
+    clearCompression();
+}
+
+void NWayBlender::updateBlendMesh(int index, const Mesh& mesh) {
+    if (index < 0 || index >= (int)blendMeshes.size()) {
+        std::cerr << "NWayBlender::updateBlendMesh() - Invalid blend mesh index: " << index << std::endl;
+        return;
+    }
+    finishRebase(true);     // the new base may be this mesh
+    stopBackgroundParametrization();
+    blendMeshes[index] = mesh;
+    if (index < (int)paramState.size()) {
+        paramState[index] = PS_PENDING;
+    }
+    // The rig image's lists of this mesh are stale
+    for (auto* shared : {&rigRot, &rigScale}) {
+        if (index < (int)shared->size()) (*shared)[index] = nullptr;
+    }
+    if (index < (int)rigL.size()) rigL[index] = nullptr;
+    if (index < (int)rigQuat.size()) rigQuat[index] = nullptr;
+    updateMirrorSource(index);
+    clearCompression();
 }
 
 void NWayBlender::clearMeshes() {
+    stopBackgroundParametrization();
+    cancelRebase();
+    detachRig();
     baseMesh.clear();
     blendMeshes.clear();
+    paramState.clear();
+    mirrorSource.clear();
+    meshCached.clear();
+    meshUsage.clear();
+    logR.clear();
+    quat.clear();
+    logBranch.clear();
+    logExplicit.clear();
+    clearCompression();
     pts.clear();
     numPts = 0;
+    ptsMask.resize(0, 0);
+    tetMask.clear();
+    ptsStiffness.resize(0);
     needsInitialization = true;
     needsParametrization = true;
-    numParametrized = 0;
 }
 
 bool NWayBlender::initialize() {
@@ -106,152 +589,795 @@ bool NWayBlender::initialize() {
     }
 
     std::cout << "NWayBlender: Initializing with " << blendMeshes.size() << " blend meshes..." << std::endl;
+    stopBackgroundParametrization();
+    cancelRebase();
+    detachRig();
+    setupTetStructure();
+    solver->computeTetMatrixInverse();
+
+    int error = solver->ARAPprecompute();
+    if (error > 0) {
+        std::cerr << "NWayBlender::initialize() - ARAP precompute failed" << std::endl;
+        return false;
+    }
+
+    if (solver->numDomains > 1) {
+        std::cout << "  ARAP solver initialized: " << solver->numDomains << " subdomains, "
+                  << solver->ddSolver.numInterface() << " interface vertices" << std::endl;
+    } else {
+        std::cout << "  ARAP solver initialized" << std::endl;
+        if (solver->parallelSolveTime > 0) {
+            std::cout << "  Triangular solves: " << solver->parallelSolveTime << " ms parallel, "
+                      << solver->serialSolveTime << " ms serial, using "
+                      << (solver->useTriSolver ? "parallel" : "serial") << std::endl;
+        }
+    }
+
+    finishInitialization();
+    return true;
+}
 
+void NWayBlender::setupTetStructure() {
     // Build tetrahedral structure from base mesh
     faceList = baseMesh.faceList;
-    int dim = MeshUtils::buildTetStructure(tetMode, pts, solver.tetList, faceList,
-                                          edgeList, vertexList, solver.tetMatrix, solver.tetWeight);
+    vertexList = baseMesh.vertexList;       // vertex fans, for TM_VERTEX and TM_VFACE
+    int dim = MeshUtils::buildTetStructure(tetMode, pts, solver->tetList, faceList,
+                                          edgeList, vertexList, solver->tetMatrix, solver->tetWeight);
 
     // Remove degenerate tetrahedra
-    solver.dim = Tetrise::removeDegenerate(tetMode, numPts, solver.tetList, faceList,
-                                          edgeList, vertexList, solver.tetMatrix);
+    solver->dim = Tetrise::removeDegenerate(tetMode, numPts, solver->tetList, faceList,
+                                          edgeList, vertexList, solver->tetMatrix);
 
     // Recompute tet matrices after cleanup
-    Tetrise::makeTetMatrix(tetMode, pts, solver.tetList, faceList, edgeList, vertexList,
-                          solver.tetMatrix, solver.tetWeight);
+    Tetrise::makeTetMatrix(tetMode, pts, solver->tetList, faceList, edgeList, vertexList,
+                          solver->tetMatrix, solver->tetWeight);
 
     // Build adjacency list for rotation consistency
-    Tetrise::makeAdjacencyList(tetMode, solver.tetList, edgeList, vertexList, adjacencyList);
+    Tetrise::makeAdjacencyList(tetMode, solver->tetList, edgeList, vertexList, adjacencyList);
 
-    solver.numTet = (int)solver.tetList.size() / 4;
+    solver->numTet = (int)solver->tetList.size() / 4;
+    Tetrise::makeTetGroups(tetMode, solver->numTet, edgeList, vertexList, tetGroupStart);
+
+    // Mirror maps of the base mesh, and the blend meshes that mirror earlier ones
+    ptsMirror.clear();
+    tetMirror.clear();
+    mirrorSource.assign(blendMeshes.size(), -1);
+    if (mirrorSymmetry) {
+        bool symmetric;
+        if ((int)userPtsMirror.size() == numPts) {
+            ptsMirror = userPtsMirror;
+            mirrorPlane = userMirrorPlane;
+            symmetric = true;
+        } else {
+            symmetric = MeshUtils::findMirrorMap(pts, mirrorAxis, mirrorTolerance, ptsMirror, mirrorPlane);
+        }
+        symmetric = symmetric && Tetrise::makeMirrorTetList(tetMode, solver->tetList, ptsMirror, tetMirror);
+        if (symmetric) {
+            Vector3d lo = pts[0], hi = pts[0];
+            for (const auto& p : pts) {
+                lo = lo.cwiseMin(p);
+                hi = hi.cwiseMax(p);
+            }
+            mirrorMaxDist = mirrorTolerance * (hi - lo).norm();
+            for (int j = 0; j < (int)blendMeshes.size(); j++) {
+                for (int k = 0; k < j; k++) {
+                    if (mirrorSource[k] < 0 && isMirrorImage(j, k)) {
+                        mirrorSource[j] = k;
+                        break;
+                    }
+                }
+            }
+            std::cout << "  Mirror symmetric: " << numMirroredMeshes() << " blend meshes share their mirror's parametrization" << std::endl;
+        } else {
+            std::cerr << "NWayBlender::initialize() - Base mesh is not mirror symmetric; mirror symmetry disabled" << std::endl;
+            ptsMirror.clear();
+            tetMirror.clear();
+        }
+    }
 
-    // Compute inverse tet matrices
-    solver.computeTetMatrixInverse();
+    // Vertex -> tet map for energy visualization
+    Tetrise::makePtsTetCSR(tetMode, numPts, solver->tetList, edgeList, ptsTetStart, ptsTetIdx, ptsTetScale);
 
-    std::cout << "  Built " << solver.numTet << " tetrahedra, dim=" << solver.dim << std::endl;
+    std::cout << "  Built " << solver->numTet << " tetrahedra, dim=" << solver->dim << std::endl;
 
     // Setup ARAP solver
     if (!areaWeighted) {
-        solver.tetWeight.clear();
-        solver.tetWeight.resize(solver.numTet, 1.0);
+        solver->tetWeight.clear();
+        solver->tetWeight.resize(solver->numTet, 1.0);
     }
+    baseTetWeight = solver->tetWeight;
+    makeStiffTetWeight(baseTetWeight, solver->tetWeight);
 
     // Set soft constraint at first vertex
-    solver.constraintWeight.resize(1);
-    solver.constraintWeight[0] = std::make_pair(0, 1.0);
-    solver.constraintVal.resize(1, 3);
-    solver.constraintVal(0, 0) = pts[0][0];
-    solver.constraintVal(0, 1) = pts[0][1];
-    solver.constraintVal(0, 2) = pts[0][2];
-
-    int error = solver.ARAPprecompute();
-    if (error > 0) {
-        std::cerr << "NWayBlender::initialize() - ARAP precompute failed" << std::endl;
-        return false;
-    }
+    solver->constraintWeight.resize(1);
+    solver->constraintWeight[0] = std::make_pair(0, 1.0);
+    solver->constraintVal.resize(1, 3);
+    solver->constraintVal(0, 0) = pts[0][0];
+    solver->constraintVal(0, 1) = pts[0][1];
+    solver->constraintVal(0, 2) = pts[0][2];
+}
+
+void NWayBlender::finishInitialization() {
+    updateTetMask();
+    updateBaseDeform();
 
-    std::cout << "  ARAP solver initialized" << std::endl;
+    // Rotation logs of the previous tet structure cannot seed the new one
+    logR.clear();
+    quat.clear();
+    logBranch.clear();
+    logExplicit.clear();
+    clearCompression();
 
     needsInitialization = false;
     needsParametrization = true;
-    numParametrized = 0;
-
-    return true;
 }
 
-void NWayBlender::parametrizeBlendMesh(int meshIndex) {
-    if (meshIndex < 0 || meshIndex >= (int)blendMeshes.size()) {
-        std::cerr << "Invalid blend mesh index: " << meshIndex << std::endl;
+void NWayBlender::setWeightMask(const MatrixXd& mask) {
+    if (mask.size() > 0 && mask.rows() != numPts) {
+        std::cerr << "NWayBlender::setWeightMask() - Mask has " << mask.rows()
+                  << " rows, expected " << numPts << std::endl;
         return;
     }
+    ptsMask = mask;
+    if (!needsInitialization) {
+        updateTetMask();
+    }
+}
 
-    const Mesh& blendMesh = blendMeshes[meshIndex];
-    std::vector<Vector3d> bpts = blendMesh.getVerticesAsVector3d();
+void NWayBlender::updateTetMask() {
+    tetMask.resize(ptsMask.cols());
+    for (int j = 0; j < (int)ptsMask.cols(); j++) {
+        Tetrise::makeTetWeightList(tetMode, solver->tetList, faceList, edgeList, vertexList,
+                                   ptsMask.col(j), tetMask[j]);
+    }
+}
 
-    if ((int)bpts.size() != numPts) {
-        std::cerr << "Blend mesh " << meshIndex << " has incompatible vertex count" << std::endl;
+bool NWayBlender::setBasePose(const std::vector<Vector3d>& posed) {
+    if (!posed.empty() && (int)posed.size() != numPts) {
+        std::cerr << "NWayBlender::setBasePose() - Pose has " << posed.size()
+                  << " vertices, expected " << numPts << std::endl;
+        return false;
+    }
+    basePose = posed;
+    if (!needsInitialization) {
+        updateBaseDeform();
+    }
+    return true;
+}
+
+void NWayBlender::updateBaseDeform() {
+    // The pinned vertex follows the pose
+    const std::vector<Vector3d>& p = basePose.empty() ? pts : basePose;
+    solver->constraintVal.resize(1, 3);
+    solver->constraintVal.row(0) = p[0].transpose();
+    if (basePose.empty()) {
+        baseDeform.clear();
+        baseDeformInverse.clear();
+        solver->regularizationTarget.resize(0, 0);
         return;
     }
 
-    // Compute tet matrices for blend mesh
-    Tetrise::makeTetMatrix(tetMode, bpts, solver.tetList, faceList, edgeList, vertexList, Q, dummy_weight);
+    Tetrise::makeTetMatrix(tetMode, basePose, solver->tetList, faceList, edgeList, vertexList, Q, dummy_weight);
+    baseDeform.resize(solver->numTet);
+    baseDeformInverse.resize(solver->numTet);
+    #pragma omp parallel for
+    for (int i = 0; i < solver->numTet; i++) {
+        baseDeform[i] = solver->tetInverse[i] * Q[i];
+        baseDeformInverse[i] = baseDeform[i].block(0, 0, 3, 3).inverse();
+    }
 
-    // Compute relative transformation per tet
-    logR[meshIndex].resize(solver.numTet);
-    logS[meshIndex].resize(solver.numTet);
-    R[meshIndex].resize(solver.numTet);
-    S[meshIndex].resize(solver.numTet);
-    GL[meshIndex].resize(solver.numTet);
-    L[meshIndex].resize(solver.numTet);
+    // With zero weights the solution is the pose itself, ghost vertices included
+    solver->regularizationTarget = MatrixXd::Zero(solver->dim, 3);
+    for (int i = 0; i < solver->numTet; i++) {
+        for (int j = 0; j < 4; j++) {
+            solver->regularizationTarget.row(solver->tetList[4 * i + j]) = Q[i].block(j, 0, 1, 3);
+        }
+    }
+}
 
-    for (int i = 0; i < solver.numTet; i++) {
-        Matrix4d aff = solver.tetMatrixInverse[i] * Q[i];
-        GL[meshIndex][i] = aff.block(0, 0, 3, 3);
-        L[meshIndex][i] = transPart(aff);
-        parametriseGL(GL[meshIndex][i], logS[meshIndex][i], R[meshIndex][i]);
+bool NWayBlender::setStiffness(const VectorXd& stiffness) {
+    if (stiffness.size() > 0 && stiffness.size() != numPts) {
+        std::cerr << "NWayBlender::setStiffness() - Stiffness has " << stiffness.size()
+                  << " values, expected " << numPts << std::endl;
+        return false;
+    }
+    if (rig && !needsInitialization) {
+        std::cerr << "NWayBlender::setStiffness() - Not available with an attached rig image" << std::endl;
+        return false;
+    }
+    ptsStiffness = stiffness;
+    if (needsInitialization) {
+        return true;    // applied in initialize()
     }
+    finishRebase(true);
 
-    // Parametrize based on blend mode
-    if (blendMode == BM_LOG3) {
-        logGL[meshIndex].resize(solver.numTet);
-        for (int i = 0; i < solver.numTet; i++) {
-            logGL[meshIndex][i] = GL[meshIndex][i].log().eval();
-        }
-    } else if (blendMode == BM_SQL) {
-        quat[meshIndex].resize(solver.numTet);
-        for (int i = 0; i < solver.numTet; i++) {
-            S[meshIndex][i] = expSym(logS[meshIndex][i]);
-            Quaternion<double> q(R[meshIndex][i].transpose());
-            quat[meshIndex][i] << q.x(), q.y(), q.z(), q.w();
-        }
-    } else if (blendMode == BM_SlRL) {
-        for (int i = 0; i < solver.numTet; i++) {
-            S[meshIndex][i] = expSym(logS[meshIndex][i]);
+    std::vector<double> newWeight;
+    makeStiffTetWeight(baseTetWeight, newWeight);
+    std::vector<int> changed;
+    std::vector<double> changedWeight;
+    for (int i = 0; i < solver->numTet; i++) {
+        if (newWeight[i] != solver->tetWeight[i]) {
+            changed.push_back(i);
+            changedWeight.push_back(newWeight[i]);
         }
     }
+    if (changed.empty()) {
+        return true;
+    }
 
-    // Compute rotation consistency if enabled
-    if (rotationConsistency) {
-        computeRotationConsistency(meshIndex);
-    } else {
-        for (int i = 0; i < solver.numTet; i++) {
-            logR[meshIndex][i] = logSO(R[meshIndex][i]);
+    // The sparsity pattern is unchanged, so only the numeric factorization is redone
+    solver->updateTetWeight(changed, changedWeight);
+    if (solver->ARAPrefactorize() > 0) {
+        std::cerr << "NWayBlender::setStiffness() - Refactorization failed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void NWayBlender::makeStiffTetWeight(const std::vector<double>& base, std::vector<double>& tetWeight) const {
+    tetWeight = base;
+    if (ptsStiffness.size() != numPts) {
+        return;
+    }
+    std::vector<double> tetStiffness;
+    Tetrise::makeTetWeightList(tetMode, solver->tetList, faceList, edgeList, vertexList,
+                               ptsStiffness, tetStiffness);
+    for (size_t i = 0; i < tetWeight.size(); i++) {
+        tetWeight[i] *= tetStiffness[i];
+    }
+}
+
+bool NWayBlender::rebase(int targetIndex) {
+    if (needsInitialization) {
+        std::cerr << "NWayBlender::rebase() - Not initialized" << std::endl;
+        return false;
+    }
+    if (targetIndex < 0 || targetIndex >= (int)blendMeshes.size()) {
+        std::cerr << "NWayBlender::rebase() - Invalid blend mesh index: " << targetIndex << std::endl;
+        return false;
+    }
+    if (!ptsMirror.empty()) {
+        std::cerr << "NWayBlender::rebase() - Not available with mirror symmetry" << std::endl;
+        return false;
+    }
+    if (rig) {
+        std::cerr << "NWayBlender::rebase() - Not available with an attached rig image" << std::endl;
+        return false;
+    }
+    if (blendMeshes[targetIndex].numVertices() != numPts) {
+        std::cerr << "NWayBlender::rebase() - Blend mesh " << targetIndex << " has incompatible vertex count" << std::endl;
+        return false;
+    }
+    finishRebase(true);
+    const Vector3d* newPts = blendMeshes[targetIndex].vertexArray();
+
+    // Same tets and pattern, new rest shape
+    std::unique_ptr<Laplacian> next(new Laplacian());
+    next->numDomains = solver->numDomains;
+    next->transWeight = solver->transWeight;
+    next->dim = solver->dim;
+    next->numTet = solver->numTet;
+    next->tetList = solver->tetList;
+    Tetrise::makeTetMatrix(tetMode, newPts, next->tetList, faceList, edgeList, vertexList,
+                          next->tetMatrix, next->tetWeight);
+    for (int i = 0; i < next->numTet; i++) {
+        if (std::abs(next->tetMatrix[i].determinant()) <= EPSILON) {
+            std::cerr << "NWayBlender::rebase() - Blend mesh " << targetIndex << " has degenerate tets" << std::endl;
+            return false;
         }
     }
+    next->computeTetMatrixInverse();
+    if (!areaWeighted) {
+        next->tetWeight.assign(next->numTet, 1.0);
+    }
+    rebaseTetWeight = next->tetWeight;
+    makeStiffTetWeight(rebaseTetWeight, next->tetWeight);
+    next->constraintWeight = solver->constraintWeight;
+    next->constraintVal.resize(1, 3);
+    next->constraintVal.row(0) = newPts[0].transpose();
 
-    std::cout << "  Parametrized blend mesh " << meshIndex << std::endl;
+    rebaseSolver = std::move(next);
+    rebaseTarget = targetIndex;
+    rebaseError = 0;
+    rebaseReady = false;
+    rebaseThread = std::thread([this]() {
+        unpinCurrentThread();
+        rebaseError = rebaseSolver->ARAPprecompute();
+        rebaseReady = true;
+    });
+    std::cout << "NWayBlender: Rebasing onto blend mesh " << targetIndex << "..." << std::endl;
+    return true;
 }
 
-void NWayBlender::computeRotationConsistency(int meshIndex) {
-    // Use BFS traversal to pick consistent rotation branches
-    std::set<int> remain;
-    std::queue<int> later;
+bool NWayBlender::finishRebase(bool wait) {
+    if (!rebaseThread.joinable() || (!wait && !rebaseReady)) {
+        return false;
+    }
+    rebaseThread.join();
+    std::unique_ptr<Laplacian> next = std::move(rebaseSolver);
+    int j = rebaseTarget;
+    rebaseTarget = -1;
+    if (rebaseError > 0) {
+        std::cerr << "NWayBlender::finishRebase() - ARAP precompute failed; keeping the old base" << std::endl;
+        return false;
+    }
 
-    // Initialize with rotation angle
-    Matrix3d initR;
-    double angle = initRotationAngle * M_PI / 180.0;
-    initR << 0, angle, 0,
-             -angle, 0, 0,
-             0, 0, 0;
-    std::vector<Matrix3d> prevSO(solver.numTet, initR);
+    stopBackgroundParametrization();
+    syncParametrizationState();
+    int numTet = solver->numTet;
+    int numMesh = (int)blendMeshes.size();
 
-    // Create adjacency graph to traverse
-    for (int i = 0; i < solver.numTet; i++) {
-        remain.insert(remain.end(), i);
+    // D^-1 per tet: the old base relative to the new one
+    std::vector<Matrix4d> Dinv(numTet);
+    #pragma omp parallel for
+    for (int i = 0; i < numTet; i++) {
+        Dinv[i] = next->tetInverse[i] * solver->tetMatrix[i];
     }
 
-    while (!remain.empty()) {
-        int next;
-        if (!later.empty()) {
-            next = later.front();
-            later.pop();
-            remain.erase(next);
+    // Compose the cached parametrizations; the rest are recomputed when needed
+    std::vector<int> composed;
+    for (int k = 0; k < numMesh; k++) {
+        bool known = k == j || (paramState[k] == PS_DONE && (int)GL[k].size() == numTet);
+        if (meshCached[k] && known) {
+            composed.push_back(k);
         } else {
-            next = *remain.begin();
-            remain.erase(remain.begin());
+            paramState[k] = PS_PENDING;
+            std::vector<signed char>().swap(logBranch[k]);
+            std::vector<std::pair<int, Matrix3d>>().swap(logExplicit[k]);
+        }
+    }
+    std::swap(solver, next);
+    #pragma omp parallel for schedule(dynamic)
+    for (int c = 0; c < (int)composed.size(); c++) {
+        int k = composed[c];
+        GL[k].resize(numTet);
+        L[k].resize(numTet);
+        for (int i = 0; i < numTet; i++) {
+            Matrix4d aff = (k == j) ? Dinv[i] : Matrix4d(Dinv[i] * pad(GL[k][i], L[k][i]));
+            GL[k][i] = aff.block(0, 0, 3, 3);
+            L[k][i] = transPart(aff);
         }
+        parametrizeAffine(k, false);
+        paramState[k] = PS_DONE;
+    }
 
-        logR[meshIndex][next] = logSOc(R[meshIndex][next], prevSO[next]);
+    std::swap(baseMesh, blendMeshes[j]);
+    pts = baseMesh.getVerticesAsVector3d();
+    baseTetWeight.swap(rebaseTetWeight);
+    std::vector<double>().swap(rebaseTetWeight);
+    iterWork.tetDeform.clear();
+    clearCompression();
+    basePose.clear();
+    updateBaseDeform();
+
+    std::cout << "NWayBlender: Rebased onto blend mesh " << j << " (" << composed.size()
+              << " parametrizations composed)" << std::endl;
+    return true;
+}
+
+void NWayBlender::cancelRebase() {
+    // ARAPprecompute() cannot be interrupted
+    if (rebaseThread.joinable()) {
+        rebaseThread.join();
+    }
+    rebaseSolver.reset();
+    rebaseTarget = -1;
+}
+
+void NWayBlender::syncParametrizationState() {
+    int numMesh = (int)blendMeshes.size();
+
+    // Settings changed: every mesh is stale
+    if (needsParametrization) {
+        stopBackgroundParametrization();
+        rigRot.clear();
+        rigScale.clear();
+        rigL.clear();
+        rigQuat.clear();
+        paramState.assign(numMesh, PS_PENDING);
+        clearCompression();
+        needsParametrization = false;
+    }
+    if ((int)paramState.size() == numMesh && (int)logR.size() == numMesh) {
+        return;
+    }
+
+    // Resize parametrization arrays
+    stopBackgroundParametrization();
+    logR.resize(numMesh);
+    logS.resize(numMesh);
+    R.resize(numMesh);
+    S.resize(numMesh);
+    GL.resize(numMesh);
+    logGL.resize(numMesh);
+    quat.resize(numMesh);
+    L.resize(numMesh);
+    logBranch.resize(numMesh);
+    logExplicit.resize(numMesh);
+    paramState.resize(numMesh, PS_PENDING);
+    meshCached.resize(numMesh, 1);
+    meshUsage.resize(numMesh, 0.0);
+    mirrorSource.resize(numMesh, -1);
+}
+
+void NWayBlender::setMemoryBudget(size_t bytes) {
+    if (bytes > 0) {
+        clearCompression();
+    }
+    memoryBudget = bytes;
+}
+
+size_t NWayBlender::meshParametrizationBytes() const {
+    // logR, R, logS, S, GL and L, plus logGL and quat for the modes blending them
+    size_t perTet = 5 * sizeof(Matrix3d) + sizeof(Vector3d);
+    if (parametrizesMode(BM_LOG3)) {
+        perTet += sizeof(Matrix3d);
+    }
+    if (parametrizesMode(BM_SQL)) {
+        perTet += sizeof(Vector4d);
+    }
+    return perTet * solver->numTet;
+}
+
+void NWayBlender::updateMeshCache(const std::vector<double>* weights) {
+    syncParametrizationState();
+    int numMesh = (int)blendMeshes.size();
+    // A mirrored mesh uses (and costs) the parametrization of its source
+    if (weights) {
+        for (int j = 0; j < numMesh; j++) {
+            meshUsage[j] *= meshUsageDecay;
+        }
+        for (int j = 0; j < numMesh; j++) {
+            if ((*weights)[j] != 0.0) {
+                meshUsage[paramSource(j)] += 1.0;
+            }
+        }
+    }
+
+    // Most used first; cached meshes get a bonus of one blend so that two
+    // meshes with similar usage do not swap back and forth
+    std::vector<int> order;
+    std::vector<char> cached(numMesh, 1);
+    for (int j = 0; j < numMesh; j++) {
+        if (paramSource(j) == j) {
+            order.push_back(j);
+            cached[j] = 0;
+        }
+    }
+    int capacity = (int)order.size();
+    size_t meshBytes = meshParametrizationBytes();
+    if (memoryBudget > 0 && meshBytes > 0) {
+        capacity = (int)std::min<size_t>(capacity, memoryBudget / meshBytes);
+    }
+    // While the compression is valid, blends read only its lists
+    if (weights && isCompressed()) {
+        capacity = 0;
+    }
+    auto score = [this](int j) { return meshUsage[j] + (meshCached[j] ? 1.0 : 0.0); };
+    std::stable_sort(order.begin(), order.end(), [&score](int a, int b) { return score(a) > score(b); });
+    for (int r = 0; r < capacity; r++) {
+        cached[order[r]] = 1;
+    }
+    if (cached == meshCached) {
+        return;
+    }
+
+    stopBackgroundParametrization();
+    std::lock_guard<std::mutex> lock(paramMutex);
+    for (int j = 0; j < numMesh; j++) {
+        if (cached[j] == meshCached[j]) continue;
+        meshCached[j] = cached[j];
+        if (paramSource(j) != j) continue;      // holds no parametrization
+        if (cached[j]) {
+            std::vector<signed char>().swap(logBranch[j]);
+            std::vector<std::pair<int, Matrix3d>>().swap(logExplicit[j]);
+            paramState[j] = PS_PENDING;
+        } else {
+            releaseParametrization(j);
+        }
+    }
+}
+
+void NWayBlender::releaseParametrization(int meshIndex) {
+    // Keep the branch of each rotation log, unless they are all principal
+    std::vector<signed char> branch;
+    std::vector<std::pair<int, Matrix3d>> explicitLog;
+    const std::vector<Matrix3d>& logRj = logR[meshIndex];
+    const std::vector<Matrix3d>& Rj = R[meshIndex];
+    if ((rotationConsistency || temporalCoherence) &&
+        (int)logRj.size() == solver->numTet && (int)Rj.size() == solver->numTet) {
+        branch.resize(solver->numTet);
+        bool principal = true;
+        for (int i = 0; i < solver->numTet; i++) {
+            branch[i] = logBranchOf(logRj[i], logSO(Rj[i]));
+            if (branch[i] != explicitBranch &&
+                (logSOBranch(Rj[i], branch[i]) - logRj[i]).norm() > 1e-9 * (1.0 + logRj[i].norm())) {
+                branch[i] = explicitBranch;
+            }
+            if (branch[i] == explicitBranch) {
+                explicitLog.push_back(std::make_pair(i, logRj[i]));
+            }
+            principal = principal && branch[i] == 0;
+        }
+        if (principal) {
+            branch.clear();
+        }
+    }
+    logBranch[meshIndex].swap(branch);
+    logExplicit[meshIndex].swap(explicitLog);
+
+    std::vector<Matrix3d>().swap(logR[meshIndex]);
+    std::vector<Matrix3d>().swap(R[meshIndex]);
+    std::vector<Matrix3d>().swap(logS[meshIndex]);
+    std::vector<Matrix3d>().swap(S[meshIndex]);
+    std::vector<Matrix3d>().swap(GL[meshIndex]);
+    std::vector<Matrix3d>().swap(logGL[meshIndex]);
+    std::vector<Vector3d>().swap(L[meshIndex]);
+    std::vector<Vector4d>().swap(quat[meshIndex]);
+}
+
+int NWayBlender::numCachedMeshes() const {
+    return (int)std::count(meshCached.begin(), meshCached.end(), (char)1);
+}
+
+size_t NWayBlender::parametrizationBytes() {
+    std::lock_guard<std::mutex> lock(paramMutex);
+    size_t bytes = 0;
+    for (size_t j = 0; j < paramState.size() && j < meshCached.size(); j++) {
+        if (paramState[j] != PS_DONE || paramSource((int)j) != (int)j) continue;
+        bytes += meshCached[j] ? meshParametrizationBytes()
+                               : logBranch[j].size() + logExplicit[j].size() * sizeof(logExplicit[j][0]);
+    }
+    return bytes;
+}
+
+void NWayBlender::prepareParametrization(const std::vector<double>* weights) {
+    syncParametrizationState();
+
+    // Parametrize new or modified blend meshes that are needed now
+    for (int m = 0; m < (int)blendMeshes.size(); m++) {
+        if (weights && (*weights)[m] == 0.0) {
+            continue;
+        }
+        int j = paramSource(m);
+        std::unique_lock<std::mutex> lock(paramMutex);
+        // the background thread may be working on it
+        paramDone.wait(lock, [&]() { return paramState[j] != PS_RUNNING; });
+        if (paramState[j] == PS_DONE) {
+            continue;
+        }
+        paramState[j] = PS_RUNNING;
+        lock.unlock();
+        parametrizeBlendMesh(j);
+        lock.lock();
+        paramState[j] = PS_DONE;
+        paramDone.notify_all();
+    }
+}
+
+void NWayBlender::startBackgroundParametrization(const std::vector<int>& order) {
+    if (needsInitialization || paramThread.joinable()) {
+        return;
+    }
+    syncParametrizationState();
+    bool pending = false;
+    for (int j : order) {
+        pending = pending || (j >= 0 && j < (int)paramState.size() && paramState[paramSource(j)] == PS_PENDING);
+    }
+    if (!pending) {
+        return;
+    }
+    paramStop = false;
+    paramThread = std::thread(&NWayBlender::backgroundParametrization, this, order);
+}
+
+void NWayBlender::stopBackgroundParametrization() {
+    if (paramThread.joinable()) {
+        paramStop = true;
+        paramThread.join();
+    }
+}
+
+void NWayBlender::backgroundParametrization(std::vector<int> order) {
+    unpinCurrentThread();
+#ifdef _OPENMP
+    // stay out of the way of the interactive thread
+    omp_set_num_threads(1);
+#endif
+    for (int m : order) {
+        if (paramStop) {
+            break;
+        }
+        std::unique_lock<std::mutex> lock(paramMutex);
+        if (m < 0 || m >= (int)paramState.size()) {
+            continue;
+        }
+        int j = paramSource(m);
+        if (paramState[j] != PS_PENDING) {
+            continue;
+        }
+        paramState[j] = PS_RUNNING;
+        lock.unlock();
+        parametrizeBlendMesh(j);
+        lock.lock();
+        paramState[j] = PS_DONE;
+        paramDone.notify_all();
+    }
+}
+
+int NWayBlender::numParametrizedMeshes() {
+    std::lock_guard<std::mutex> lock(paramMutex);
+    int count = 0;
+    for (int j = 0; j < (int)paramState.size(); j++) {
+        count += paramState[paramSource(j)] == PS_DONE;
+    }
+    return count;
+}
+
+void NWayBlender::parametrizeBlendMesh(int meshIndex) {
+    if (meshIndex < 0 || meshIndex >= (int)blendMeshes.size()) {
+        std::cerr << "Invalid blend mesh index: " << meshIndex << std::endl;
+        return;
+    }
+
+    const Mesh& blendMesh = blendMeshes[meshIndex];
+    const Vector3d* bpts = blendMesh.vertexArray();
+
+    if (blendMesh.numVertices() != numPts) {
+        std::cerr << "Blend mesh " << meshIndex << " has incompatible vertex count" << std::endl;
+        return;
+    }
+
+    // Not cached: blendStreamed() recomputes everything but the rotation branches
+    bool cached = meshCached[meshIndex] != 0;
+    if (!cached && !rotationConsistency) {
+        releaseParametrization(meshIndex);
+        return;
+    }
+
+    // Logs from the previous frame of this mesh, if any, seed the branch choice
+    bool temporal = temporalCoherence && (int)logR[meshIndex].size() == solver->numTet;
+
+    // Compute tet matrices for blend mesh (local storage: may run on the background thread)
+    std::vector<Matrix4d> P;
+    std::vector<double> tetArea;
+    Tetrise::makeTetMatrix(tetMode, bpts, solver->tetList, faceList, edgeList, vertexList, P, tetArea);
+
+    // Compute relative transformation per tet. Per-tet lists are written
+    // first by loops with the static schedule of the blend loops, so that
+    // with pinned threads their pages land on the NUMA node that blends them.
+    GL[meshIndex].resize(solver->numTet);
+    L[meshIndex].resize(solver->numTet);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < solver->numTet; i++) {
+        Matrix4d aff = solver->tetInverse[i] * P[i];
+        GL[meshIndex][i] = aff.block(0, 0, 3, 3);
+        L[meshIndex][i] = transPart(aff);
+    }
+    parametrizeAffine(meshIndex, temporal);
+
+    if (!cached) {
+        releaseParametrization(meshIndex);
+    }
+
+    std::cout << "  Parametrized blend mesh " << meshIndex << std::endl;
+}
+
+void NWayBlender::parametrizeAffine(int meshIndex, bool temporal) {
+    logR[meshIndex].resize(solver->numTet);
+    logS[meshIndex].resize(solver->numTet);
+    R[meshIndex].resize(solver->numTet);
+    S[meshIndex].resize(solver->numTet);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < solver->numTet; i++) {
+        parametriseGL(GL[meshIndex][i], logS[meshIndex][i], R[meshIndex][i]);
+    }
+
+    // Parametrize based on blend mode (and the compared modes, from the same decomposition)
+    if (parametrizesMode(BM_LOG3)) {
+        logGL[meshIndex].resize(solver->numTet);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < solver->numTet; i++) {
+            logGL[meshIndex][i] = GL[meshIndex][i].log().eval();
+        }
+    }
+    if (parametrizesMode(BM_SQL)) {
+        // q and -q give the same rotation; keep the sign of the previous frame
+        bool keepSign = temporal && (int)quat[meshIndex].size() == solver->numTet;
+        quat[meshIndex].resize(solver->numTet);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < solver->numTet; i++) {
+            S[meshIndex][i] = expSym(logS[meshIndex][i]);
+            Quaternion<double> q(R[meshIndex][i].transpose());
+            Vector4d qv(q.x(), q.y(), q.z(), q.w());
+            if (keepSign && qv.dot(quat[meshIndex][i]) < 0) {
+                qv = -qv;
+            }
+            quat[meshIndex][i] = qv;
+        }
+    } else if (parametrizesMode(BM_SlRL)) {
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < solver->numTet; i++) {
+            S[meshIndex][i] = expSym(logS[meshIndex][i]);
+        }
+    }
+
+    // Compute rotation consistency if enabled
+    if (rotationConsistency || temporal) {
+        computeRotationConsistency(meshIndex, temporal);
+    } else {
+        for (int i = 0; i < solver->numTet; i++) {
+            logR[meshIndex][i] = logSO(R[meshIndex][i]);
+        }
+    }
+}
+
+void NWayBlender::computeRotationConsistency(int meshIndex, bool temporal) {
+    // Use BFS traversal to pick consistent rotation branches
+    std::set<int> remain;
+    std::queue<int> later;
+
+    // Initialize with rotation angle
+    Matrix3d initR;
+    double angle = initRotationAngle * M_PI / 180.0;
+    initR << 0, angle, 0,
+             -angle, 0, 0,
+             0, 0, 0;
+    std::vector<Matrix3d> prevSO(solver->numTet, initR);
+
+    if (temporal) {
+        // Take the branch closest to the previous frame's log of the same tet.
+        // Only tets whose rotation jumped by more than temporalJumpAngle go
+        // through the BFS, starting from their coherent neighbours.
+        std::vector<Matrix3d>& logRj = logR[meshIndex];
+        std::vector<char> jumped(solver->numTet, 0);
+        double maxJump = temporalJumpAngle * M_PI / 180.0;
+        #pragma omp parallel for
+        for (int i = 0; i < solver->numTet; i++) {
+            Matrix3d X = logSOc(R[meshIndex][i], logRj[i]);
+            // |X - prev|_F = sqrt(2) * (angle between the axis-angle vectors)
+            if ((X - logRj[i]).norm() > M_SQRT2 * maxJump) {
+                jumped[i] = 1;
+            } else {
+                logRj[i] = X;
+            }
+        }
+        for (int i = 0; i < solver->numTet; i++) {
+            if (jumped[i]) {
+                remain.insert(remain.end(), i);
+            }
+        }
+        for (int i = 0; i < solver->numTet; i++) {
+            if (!jumped[i]) continue;
+            for (size_t k = 0; k < adjacencyList[i].size(); k++) {
+                int f = adjacencyList[i][k];
+                if (!jumped[f]) {
+                    prevSO[i] = logRj[f];
+                    remain.erase(i);
+                    later.push(i);
+                    break;
+                }
+            }
+        }
+    } else {
+        // Create adjacency graph to traverse
+        for (int i = 0; i < solver->numTet; i++) {
+            remain.insert(remain.end(), i);
+        }
+    }
+
+    while (!remain.empty() || !later.empty()) {
+        int next;
+        if (!later.empty()) {
+            next = later.front();
+            later.pop();
+            remain.erase(next);
+        } else {
+            next = *remain.begin();
+            remain.erase(remain.begin());
+        }
+
+        logR[meshIndex][next] = logSOc(R[meshIndex][next], prevSO[next]);
 
         for (size_t k = 0; k < adjacencyList[next].size(); k++) {
             int f = adjacencyList[next][k];
@@ -263,70 +1389,682 @@ void NWayBlender::computeRotationConsistency(int meshIndex) {
     }
 }
 
-void NWayBlender::blendTransformations(const std::vector<double>& weights,
+bool NWayBlender::compressTargets(double tolerance) {
+    if (needsInitialization) {
+        std::cerr << "NWayBlender::compressTargets() - Not initialized" << std::endl;
+        return false;
+    }
+    int numMesh = (int)blendMeshes.size();
+    if (numMesh == 0) {
+        std::cerr << "NWayBlender::compressTargets() - No blend meshes" << std::endl;
+        return false;
+    }
+    if (memoryBudget > 0) {
+        std::cerr << "NWayBlender::compressTargets() - Not available with a memory budget" << std::endl;
+        return false;
+    }
+    if (numMirroredMeshes() > 0) {
+        std::cerr << "NWayBlender::compressTargets() - Not available with mirrored blend meshes" << std::endl;
+        return false;
+    }
+    if (rig) {
+        std::cerr << "NWayBlender::compressTargets() - Not available with an attached rig image" << std::endl;
+        return false;
+    }
+
+    updateMeshCache();
+    prepareParametrization();
+    clearCompression();
+
+    compressionError.assign(numMesh, 0.0);
+    bool ok = true;
+    auto compress = [&](const auto& A, const auto& offset, auto& P) {
+        for (int j = 0; j < numMesh; j++) {
+            ok = ok && (int)A[j].size() == solver->numTet;
+        }
+        if (!ok) return;
+        std::vector<double> err;
+        compressParamList(A, offset, tolerance, P, err);
+        for (int j = 0; j < numMesh; j++) {
+            compressionError[j] = std::max(compressionError[j], err[j]);
+        }
+    };
+    const Matrix3d Z3 = Matrix3d::Zero();
+    const Matrix3d I3 = Matrix3d::Identity();
+
+    compress(L, Vector3d::Zero().eval(), pcaL);
+    if (blendMode == BM_SRL) {
+        compress(logR, Z3, pcaRot);
+        compress(logS, Z3, pcaScale);
+    } else if (blendMode == BM_LOG3) {
+        compress(logGL, Z3, pcaRot);
+    } else if (blendMode == BM_SQL) {
+        compress(S, I3, pcaScale);
+        compress(quat, Vector4d(0, 0, 0, 1), pcaQuat);
+    } else if (blendMode == BM_SlRL) {
+        compress(logR, Z3, pcaRot);
+        compress(S, I3, pcaScale);
+    } else if (blendMode == BM_AFF) {
+        compress(GL, I3, pcaRot);
+    } else {
+        std::cerr << "NWayBlender::compressTargets() - Unsupported blend mode" << std::endl;
+        clearCompression();
+        return false;
+    }
+    if (!ok) {
+        std::cerr << "NWayBlender::compressTargets() - Parametrization unavailable for this blend mode" << std::endl;
+        clearCompression();
+        return false;
+    }
+
+    compressedMode = blendMode;
+    compressedMeshes = numMesh;
+
+    // Every mesh is parametrized now. Drop the full lists as for meshes
+    // outside the memory budget; updateMeshCache() caches them again, and
+    // they are reparametrized, when the compression is not used
+    if (isCompressed()) {
+        stopBackgroundParametrization();
+        std::lock_guard<std::mutex> lock(paramMutex);
+        for (int j = 0; j < numMesh; j++) {
+            meshCached[j] = 0;
+            releaseParametrization(j);
+        }
+    }
+    std::cout << "NWayBlender: Compressed " << numMesh << " blend meshes to "
+              << numComponents() << " components, max error "
+              << *std::max_element(compressionError.begin(), compressionError.end()) << std::endl;
+    return true;
+}
+
+void NWayBlender::clearCompression() {
+    pcaRot.clear();
+    pcaScale.clear();
+    pcaL.clear();
+    pcaQuat.clear();
+    compressedMode = -1;
+    compressedMeshes = 0;
+    compressionError.clear();
+}
+
+bool NWayBlender::isCompressed() const {
+    return compressedMode >= 0 && compressedMode == blendMode &&
+           compressedMeshes == (int)blendMeshes.size() && ptsMask.size() == 0;
+}
+
+int NWayBlender::numComponents() const {
+    return std::max(std::max((int)pcaRot.basis.size(), (int)pcaScale.basis.size()),
+                    std::max((int)pcaL.basis.size(), (int)pcaQuat.basis.size()));
+}
+
+// Sections of a rig image; the parametrizations of blend mesh k are
+// RIG_MESH + 4 * k + RIG_L, ... (see blendedLists())
+enum RigSection {
+    RIG_INFO = 1,
+    RIG_FACTOR = 2,
+    RIG_TET_INVERSE = 3,
+    RIG_MESH = 16
+};
+enum RigList { RIG_L, RIG_ROT, RIG_SCALE, RIG_QUAT };
+
+// Sizes the image was saved with
+struct RigInfo {
+    int numPts;
+    int numTet;
+    int dim;
+    int numMesh;
+    short blendMode;
+    short tetMode;
+};
+
+// Section of a list of numTet values, if the image has it
+template<typename T>
+static const T* rigList(const RigImage& image, unsigned int id, int numTet) {
+    size_t bytes;
+    const char* data = image.section(id, bytes);
+    return (data && bytes == numTet * sizeof(T)) ? (const T*)data : nullptr;
+}
+
+// Add mesh k's list to the image, if it was parametrized
+template<typename T>
+static size_t addRigList(RigImage& image, unsigned int id, const std::vector<std::vector<T>>& own,
+                         const std::vector<const T*>& shared, int k, int numTet) {
+    const T* data = (k < (int)shared.size() && shared[k]) ? shared[k]
+                  : ((int)own[k].size() == numTet ? own[k].data() : nullptr);
+    if (!data) {
+        return 0;
+    }
+    image.add(id, data, numTet * sizeof(T));
+    return numTet * sizeof(T);
+}
+
+void NWayBlender::blendedLists(std::vector<std::vector<Matrix3d>>*& rot, std::vector<std::vector<Matrix3d>>*& scale) {
+    rot = nullptr;
+    scale = nullptr;
+    if (blendMode == BM_SRL) {
+        rot = &logR;
+        scale = &logS;
+    } else if (blendMode == BM_LOG3) {
+        rot = &logGL;
+    } else if (blendMode == BM_SQL) {
+        scale = &S;
+    } else if (blendMode == BM_SlRL) {
+        rot = &logR;
+        scale = &S;
+    } else if (blendMode == BM_AFF) {
+        rot = &GL;
+    }
+}
+
+unsigned long long NWayBlender::rigKey() const {
+    unsigned long long h = 14695981039346656037ULL;
+    auto mix = [&h](const void* data, size_t size) {
+        const unsigned char* p = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++) {
+            h ^= p[i];
+            h *= 1099511628211ULL;
+        }
+    };
+    mix(&blendMode, sizeof(blendMode));
+    mix(&tetMode, sizeof(tetMode));
+    mix(&areaWeighted, sizeof(areaWeighted));
+    mix(&rotationConsistency, sizeof(rotationConsistency));
+    mix(&initRotationAngle, sizeof(initRotationAngle));
+    mix(&solver->transWeight, sizeof(solver->transWeight));
+    mix(baseMesh.V.data(), baseMesh.V.size() * sizeof(double));
+    mix(baseMesh.faceList.data(), baseMesh.faceList.size() * sizeof(int));
+    for (const Mesh& m : blendMeshes) {
+        mix(m.V.data(), m.V.size() * sizeof(double));
+    }
+    mix(ptsStiffness.data(), ptsStiffness.size() * sizeof(double));
+    return h;
+}
+
+bool NWayBlender::saveRig(const std::string& path) {
+    if (needsInitialization) {
+        std::cerr << "NWayBlender::saveRig() - Not initialized" << std::endl;
+        return false;
+    }
+    int numMesh = (int)blendMeshes.size();
+    std::vector<std::vector<Matrix3d>>* rot;
+    std::vector<std::vector<Matrix3d>>* scale;
+    blendedLists(rot, scale);
+    if (!rot && !scale) {
+        std::cerr << "NWayBlender::saveRig() - Unsupported blend mode" << std::endl;
+        return false;
+    }
+    if (memoryBudget > 0) {
+        std::cerr << "NWayBlender::saveRig() - Not available with a memory budget" << std::endl;
+        return false;
+    }
+    if (numMirroredMeshes() > 0) {
+        std::cerr << "NWayBlender::saveRig() - Not available with mirrored blend meshes" << std::endl;
+        return false;
+    }
+    if (solver->numDomains > 1) {
+        std::cerr << "NWayBlender::saveRig() - Not available with solver domains" << std::endl;
+        return false;
+    }
+    finishRebase(true);
+
+    // The factor as the triangular solves store it, also when they were
+    // slower than the serial ones here
+    TriSolver local;
+    const TriSolver* factor = &solver->triSolver;
+    if (!factor->ready()) {
+#ifdef _SuiteSparse
+        std::cerr << "NWayBlender::saveRig() - Not available with CHOLMOD" << std::endl;
+        return false;
+#else
+        int numThreads = 1;
+#ifdef _OPENMP
+        numThreads = omp_get_max_threads();
+#endif
+        local.setup(solver->solver, numThreads);
+        factor = &local;
+#endif
+    }
+
+    updateMeshCache();
+    prepareParametrization();
+
+    int numTet = solver->numTet;
+    RigInfo info = {numPts, numTet, solver->dim, numMesh, blendMode, tetMode};
+    RigImage image;
+    image.add(RIG_INFO, &info, sizeof(info));
+    image.add(RIG_FACTOR, factor->data(), factor->bytes());
+    image.add(RIG_TET_INVERSE, solver->tetInverse, numTet * sizeof(Matrix4d));
+    size_t total = factor->bytes() + numTet * sizeof(Matrix4d);
+
+    // A mesh that could not be parametrized (incompatible) is left out
+    for (int k = 0; k < numMesh; k++) {
+        unsigned int id = RIG_MESH + 4 * k;
+        total += addRigList(image, id + RIG_L, L, rigL, k, numTet);
+        if (rot) {
+            total += addRigList(image, id + RIG_ROT, *rot, rigRot, k, numTet);
+        }
+        if (scale) {
+            total += addRigList(image, id + RIG_SCALE, *scale, rigScale, k, numTet);
+        }
+        if (blendMode == BM_SQL) {
+            total += addRigList(image, id + RIG_QUAT, quat, rigQuat, k, numTet);
+        }
+    }
+    if (!image.write(path, rigKey())) {
+        return false;
+    }
+
+    std::cout << "NWayBlender: Saved rig image " << path << " ("
+              << total / (1024.0 * 1024.0) << " MB)" << std::endl;
+    return true;
+}
+
+bool NWayBlender::attachRig(const std::string& path) {
+    if (!baseMesh.isValid()) {
+        std::cerr << "NWayBlender::attachRig() - No valid base mesh" << std::endl;
+        return false;
+    }
+    std::vector<std::vector<Matrix3d>>* rot;
+    std::vector<std::vector<Matrix3d>>* scale;
+    blendedLists(rot, scale);
+    if (!rot && !scale) {
+        std::cerr << "NWayBlender::attachRig() - Unsupported blend mode" << std::endl;
+        return false;
+    }
+    if (memoryBudget > 0 || mirrorSymmetry || solver->numDomains > 1) {
+        std::cerr << "NWayBlender::attachRig() - Not available with a memory budget, mirror symmetry or solver domains" << std::endl;
+        return false;
+    }
+
+    stopBackgroundParametrization();
+    cancelRebase();
+    detachRig();
+    std::unique_ptr<RigImage> image(new RigImage());
+    if (!image->attach(path)) {
+        return false;
+    }
+    int numMesh = (int)blendMeshes.size();
+    size_t bytes;
+    const RigInfo* info = (const RigInfo*)image->section(RIG_INFO, bytes);
+    if (image->getKey() != rigKey() || !info || bytes != sizeof(RigInfo) || info->numPts != numPts ||
+        info->numMesh != numMesh || info->blendMode != blendMode || info->tetMode != tetMode) {
+        std::cerr << "NWayBlender::attachRig() - " << path << " was saved from other meshes or settings" << std::endl;
+        return false;
+    }
+
+    // The tet structure is cheap to rebuild and must match the image's; its inverses are the image's
+    setupTetStructure();
+    int numTet = solver->numTet;
+    if (info->numTet != numTet || info->dim != solver->dim) {
+        std::cerr << "NWayBlender::attachRig() - " << path << " has another tet structure" << std::endl;
+        needsInitialization = true;
+        return false;
+    }
+    const char* factor = image->section(RIG_FACTOR, bytes);
+    const Matrix4d* inverse = rigList<Matrix4d>(*image, RIG_TET_INVERSE, numTet);
+    if (!factor || !inverse || solver->ARAPattach(factor, bytes, inverse) > 0) {
+        std::cerr << "NWayBlender::attachRig() - " << path << " has no usable factor" << std::endl;
+        needsInitialization = true;
+        return false;
+    }
+
+    rig = std::move(image);
+    finishInitialization();
+    syncParametrizationState();
+
+    // Lists of the meshes the image has; the others are parametrized when needed
+    rigL.assign(numMesh, nullptr);
+    rigRot.assign(rot ? numMesh : 0, nullptr);
+    rigScale.assign(scale ? numMesh : 0, nullptr);
+    rigQuat.assign(blendMode == BM_SQL ? numMesh : 0, nullptr);
+    int numShared = 0;
+    for (int k = 0; k < numMesh; k++) {
+        unsigned int id = RIG_MESH + 4 * k;
+        const Vector3d* meshL = rigList<Vector3d>(*rig, id + RIG_L, numTet);
+        const Matrix3d* meshRot = rot ? rigList<Matrix3d>(*rig, id + RIG_ROT, numTet) : nullptr;
+        const Matrix3d* meshScale = scale ? rigList<Matrix3d>(*rig, id + RIG_SCALE, numTet) : nullptr;
+        const Vector4d* meshQuat = blendMode == BM_SQL ? rigList<Vector4d>(*rig, id + RIG_QUAT, numTet) : nullptr;
+        if (!meshL || (rot && !meshRot) || (scale && !meshScale) || (blendMode == BM_SQL && !meshQuat)) {
+            continue;
+        }
+        rigL[k] = meshL;
+        if (rot) rigRot[k] = meshRot;
+        if (scale) rigScale[k] = meshScale;
+        if (blendMode == BM_SQL) rigQuat[k] = meshQuat;
+        paramState[k] = PS_DONE;
+        numShared++;
+    }
+
+    std::cout << "NWayBlender: Attached rig image " << path << " (" << numTet << " tetrahedra, "
+              << numShared << " of " << numMesh << " blend meshes parametrized)" << std::endl;
+    return true;
+}
+
+void NWayBlender::detachRig() {
+    if (!rig) {
+        return;
+    }
+    // The solver solves with the image's factor and tet inverses
+    solver->triSolver.clear();
+    solver->useTriSolver = false;
+    solver->tetInverse = nullptr;
+    needsInitialization = true;
+    rigRot.clear();
+    rigScale.clear();
+    rigL.clear();
+    rigQuat.clear();
+    rig.reset();
+}
+
+void NWayBlender::blendTransformations(short mode,
+                                      const std::vector<double>& weights,
                                       std::vector<Matrix3d>& AR,
                                       std::vector<Matrix3d>& AS,
-                                      std::vector<Vector3d>& AL) {
+                                      std::vector<Vector3d>& AL,
+                                      bool allowCompressed) {
+    const Matrix3d I3 = Matrix3d::Identity();
+    bool compressed = allowCompressed && mode == blendMode && isCompressed();
+
+    // Meshes that are not cached are added by blendStreamed(), mirrored ones
+    // by blendMirrored()
+    std::vector<double> cachedWeights(weights);
+    bool indirect = false;
+    for (int j = 0; j < (int)meshCached.size() && !compressed; j++) {
+        if (weights[j] != 0.0 && (!meshCached[j] || paramSource(j) != j)) {
+            cachedWeights[j] = 0.0;
+            indirect = true;
+        }
+    }
+    std::vector<Vector4d> Aq;
+
     // Blend translation
-    blendMatList(L, weights, AL);
+    if (compressed) {
+        blendParamBasis(pcaL, weights, Vector3d::Zero().eval(), AL);
+    } else {
+        blendMatList(paramLists(L, rigL, cachedWeights), cachedWeights, AL, tetMask);
+    }
 
-    if (blendMode == BM_SRL) {
+    if (mode == BM_SRL) {
         // Blend log rotations and log symmetric parts
-        blendMatList(logR, weights, AR);
-        blendMatList(logS, weights, AS);
+        if (compressed) {
+            blendParamBasis(pcaRot, weights, Matrix3d::Zero().eval(), AR);
+            blendParamBasis(pcaScale, weights, Matrix3d::Zero().eval(), AS);
+        } else {
+            blendMatList(paramLists(logR, rigRot, cachedWeights), cachedWeights, AR, tetMask);
+            blendMatList(paramLists(logS, rigScale, cachedWeights), cachedWeights, AS, tetMask);
+        }
+        if (indirect) {
+            blendStreamed(mode, weights, AR, AS, AL, Aq);
+            blendMirrored(mode, weights, AR, AS, AL, Aq);
+        }
         #pragma omp parallel for
-        for (int i = 0; i < solver.numTet; i++) {
+        for (int i = 0; i < solver->numTet; i++) {
             AR[i] = expSO(AR[i]);
             AS[i] = expSym(AS[i]);
         }
-    } else if (blendMode == BM_LOG3) {
+    } else if (mode == BM_LOG3) {
         // Blend log matrices
-        blendMatList(logGL, weights, AR);
+        if (compressed) {
+            blendParamBasis(pcaRot, weights, Matrix3d::Zero().eval(), AR);
+        } else {
+            blendMatList(paramLists(logGL, rigRot, cachedWeights), cachedWeights, AR, tetMask);
+        }
+        if (indirect) {
+            blendStreamed(mode, weights, AR, AS, AL, Aq);
+            blendMirrored(mode, weights, AR, AS, AL, Aq);
+        }
         #pragma omp parallel for
-        for (int i = 0; i < solver.numTet; i++) {
+        for (int i = 0; i < solver->numTet; i++) {
             AR[i] = AR[i].exp().eval();
             AS[i] = Matrix3d::Identity();
         }
-    } else if (blendMode == BM_SQL) {
+    } else if (mode == BM_SQL) {
         // Blend quaternions and scale
-        std::vector<Vector4d> Aq(solver.numTet);
-        blendMatLinList(S, weights, AS);
-        blendQuatList(quat, weights, Aq);
+        Aq.resize(solver->numTet);
+        if (compressed) {
+            blendParamBasis(pcaScale, weights, I3, AS);
+            blendParamBasis(pcaQuat, weights, Vector4d(0, 0, 0, 1), Aq);
+            for (int i = 0; i < solver->numTet; i++) {
+                Aq[i].normalize();
+            }
+        } else {
+            blendMatLinList(paramLists(S, rigScale, cachedWeights), cachedWeights, AS, tetMask);
+            blendQuatList(paramLists(quat, rigQuat, cachedWeights), cachedWeights, Aq, tetMask, !indirect);
+        }
+        if (indirect) {
+            blendStreamed(mode, weights, AR, AS, AL, Aq);
+            blendMirrored(mode, weights, AR, AS, AL, Aq);
+            for (int i = 0; i < solver->numTet; i++) {
+                Aq[i].normalize();
+            }
+        }
         #pragma omp parallel for
-        for (int i = 0; i < solver.numTet; i++) {
+        for (int i = 0; i < solver->numTet; i++) {
             Quaternion<double> Q(Aq[i]);
             AR[i] = Q.matrix().transpose();
         }
-    } else if (blendMode == BM_SlRL) {
+    } else if (mode == BM_SlRL) {
         // Blend log rotations and scale linearly
-        blendMatList(logR, weights, AR);
-        blendMatLinList(S, weights, AS);
+        if (compressed) {
+            blendParamBasis(pcaRot, weights, Matrix3d::Zero().eval(), AR);
+            blendParamBasis(pcaScale, weights, I3, AS);
+        } else {
+            blendMatList(paramLists(logR, rigRot, cachedWeights), cachedWeights, AR, tetMask);
+            blendMatLinList(paramLists(S, rigScale, cachedWeights), cachedWeights, AS, tetMask);
+        }
+        if (indirect) {
+            blendStreamed(mode, weights, AR, AS, AL, Aq);
+            blendMirrored(mode, weights, AR, AS, AL, Aq);
+        }
         #pragma omp parallel for
-        for (int i = 0; i < solver.numTet; i++) {
+        for (int i = 0; i < solver->numTet; i++) {
             AR[i] = expSO(AR[i]);
         }
-    } else if (blendMode == BM_AFF) {
+    } else if (mode == BM_AFF) {
         // Linear blending
-        blendMatLinList(GL, weights, AR);
-        for (int i = 0; i < solver.numTet; i++) {
+        if (compressed) {
+            blendParamBasis(pcaRot, weights, I3, AR);
+        } else {
+            blendMatLinList(paramLists(GL, rigRot, cachedWeights), cachedWeights, AR, tetMask);
+        }
+        if (indirect) {
+            blendStreamed(mode, weights, AR, AS, AL, Aq);
+            blendMirrored(mode, weights, AR, AS, AL, Aq);
+        }
+        #pragma omp parallel for
+        for (int i = 0; i < solver->numTet; i++) {
             AS[i] = Matrix3d::Identity();
         }
     }
 }
 
-void NWayBlender::computeEnergy(const std::vector<Vector3d>& newPts,
+void NWayBlender::blendStreamed(short mode,
+                                const std::vector<double>& weights,
+                                std::vector<Matrix3d>& AR,
+                                std::vector<Matrix3d>& AS,
+                                std::vector<Vector3d>& AL,
+                                std::vector<Vector4d>& Aq) {
+    const Matrix3d I3 = Matrix3d::Identity();
+    const Vector4d I4(0, 0, 0, 1);
+    int numGroups = (int)tetGroupStart.size() - 1;
+    int numTiles = (numGroups + streamTileGroups - 1) / streamTileGroups;
+
+    for (int j = 0; j < (int)blendMeshes.size(); j++) {
+        int src = paramSource(j);
+        if (meshCached[src] || weights[j] == 0.0) continue;
+        const Vector3d* bpts = blendMeshes[src].vertexArray();
+        const std::vector<signed char>& branch = logBranch[src];
+        const std::vector<std::pair<int, Matrix3d>>& explicitLog = logExplicit[src];
+        bool principal = (int)branch.size() != solver->numTet;
+        bool mirror = src != j;
+        auto conj = [&](const Matrix3d& X) { return mirror ? mirrorMatrix(X, mirrorAxis) : X; };
+
+        // Tiles cover whole tet groups, which share their fourth vertex. A mirrored
+        // mesh adds tet i of its source to tet tetMirror[i]; as that is a
+        // permutation, tiles still write disjoint tets.
+        #pragma omp parallel
+        {
+            std::vector<Matrix4d> P;
+            std::vector<double> tetArea;
+            Matrix3d GLi, logSi, Ri;
+            #pragma omp for schedule(dynamic)
+            for (int t = 0; t < numTiles; t++) {
+                int g0 = t * streamTileGroups;
+                int g1 = std::min(numGroups, g0 + streamTileGroups);
+                int first = tetGroupStart[g0];
+                int count = tetGroupStart[g1] - first;
+                P.resize(count);
+                tetArea.resize(count);
+                Tetrise::makeGroupRangeTetMatrix(tetMode, bpts, solver->tetList, edgeList, vertexList,
+                                                 tetGroupStart, g0, g1, P.data(), tetArea.data());
+
+                for (int k = 0; k < count; k++) {
+                    int i = first + k;
+                    int dst = mirror ? tetMirror[i] : i;
+                    double w = maskedWeight(weights, tetMask, j, dst);
+                    Matrix4d aff = solver->tetInverse[i] * P[k];
+                    GLi = aff.block(0, 0, 3, 3);
+                    Vector3d Li = transPart(aff);
+                    AL[dst] += w * (mirror ? mirrorTranslation(GLi, Li, mirrorAxis, mirrorPlane) : Li);
+                    if (mode == BM_LOG3) {
+                        AR[dst] += w * conj(GLi.log().eval());
+                    } else if (mode == BM_AFF) {
+                        AR[dst] += w * (conj(GLi) - I3);
+                    } else {
+                        parametriseGL(GLi, logSi, Ri);
+                        if (mode == BM_SQL) {
+                            AS[dst] += w * (conj(expSym(logSi)) - I3);
+                            Quaternion<double> q(Ri.transpose());
+                            Vector4d qv(q.x(), q.y(), q.z(), q.w());
+                            Aq[dst] += w * ((mirror ? mirrorQuat(qv, mirrorAxis) : qv) - I4);
+                        } else {
+                            Matrix3d logRi;
+                            if (principal) {
+                                logRi = logSO(Ri);
+                            } else if (branch[i] != explicitBranch) {
+                                logRi = logSOBranch(Ri, branch[i]);
+                            } else {
+                                auto e = std::lower_bound(explicitLog.begin(), explicitLog.end(),
+                                    std::make_pair(i, Matrix3d()),
+                                    [](const std::pair<int, Matrix3d>& a, const std::pair<int, Matrix3d>& b) {
+                                        return a.first < b.first;
+                                    });
+                                logRi = e->second;
+                            }
+                            AR[dst] += w * conj(logRi);
+                            if (mode == BM_SRL) {
+                                AS[dst] += w * conj(logSi);
+                            } else {
+                                AS[dst] += w * (conj(expSym(logSi)) - I3);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void NWayBlender::blendMirrored(short mode,
+                                const std::vector<double>& weights,
+                                std::vector<Matrix3d>& AR,
+                                std::vector<Matrix3d>& AS,
+                                std::vector<Vector3d>& AL,
+                                std::vector<Vector4d>& Aq) {
+    const Matrix3d I3 = Matrix3d::Identity();
+    const Vector4d I4(0, 0, 0, 1);
+    const int a = mirrorAxis;
+
+    for (int j = 0; j < (int)blendMeshes.size(); j++) {
+        int k = paramSource(j);
+        if (k == j || !meshCached[k] || weights[j] == 0.0) continue;
+        #pragma omp parallel for
+        for (int i = 0; i < solver->numTet; i++) {
+            int t = tetMirror[i];
+            double w = maskedWeight(weights, tetMask, j, i);
+            AL[i] += w * mirrorTranslation(GL[k][t], L[k][t], a, mirrorPlane);
+            if (mode == BM_SRL) {
+                AR[i] += w * mirrorMatrix(logR[k][t], a);
+                AS[i] += w * mirrorMatrix(logS[k][t], a);
+            } else if (mode == BM_LOG3) {
+                AR[i] += w * mirrorMatrix(logGL[k][t], a);
+            } else if (mode == BM_SQL) {
+                AS[i] += w * (mirrorMatrix(S[k][t], a) - I3);
+                Aq[i] += w * (mirrorQuat(quat[k][t], a) - I4);
+            } else if (mode == BM_SlRL) {
+                AR[i] += w * mirrorMatrix(logR[k][t], a);
+                AS[i] += w * (mirrorMatrix(S[k][t], a) - I3);
+            } else if (mode == BM_AFF) {
+                AR[i] += w * (mirrorMatrix(GL[k][t], a) - I3);
+            }
+        }
+    }
+}
+
+void NWayBlender::computeEnergy(const Vector3d* newPts,
                                const std::vector<Matrix3d>& AS,
                                std::vector<Matrix3d>& AR,
-                               std::vector<double>& tetEnergy) {
-    Tetrise::makeTetMatrix(tetMode, newPts, solver.tetList, faceList, edgeList, vertexList, Q, dummy_weight);
+                               IterationWorkspace& work,
+                               VectorXd* vertexEnergy,
+                               double multiplier) {
+    std::vector<Matrix4d>& Q = work.Q;
+    std::vector<Matrix3d>& tetDeform = work.tetDeform;
+    std::vector<double>& tetEnergy = work.tetEnergy;
+    Tetrise::makeTetMatrix(tetMode, newPts, solver->tetList, faceList, edgeList, vertexList, Q, work.tetArea);
 
-    Matrix3d S, Rfit;
-    #pragma omp parallel for private(S, Rfit)
-    for (int i = 0; i < solver.numTet; i++) {
-        polarHigham((solver.tetMatrixInverse[i] * Q[i]).block(0, 0, 3, 3), S, Rfit);
-        AR[i] = Rfit;
-        tetEnergy[i] = (S - AS[i]).squaredNorm();
+    if (vertexEnergy) {
+        vertexEnergy->resize(numPts);
     }
+
+    // Adaptive local step: tets whose deformation gradient moved less than
+    // localStepTolerance (relative) since their last refit keep their rotation
+    // and energy. The first step of each blend and every fullSweepInterval-th
+    // step refit everything.
+    bool fullSweep = localStepTolerance <= 0.0 || fullSweepInterval <= 1 ||
+                     work.localStepCount % fullSweepInterval == 0 ||
+                     (int)tetDeform.size() != solver->numTet;
+    work.localStepCount++;
+    tetDeform.resize(solver->numTet);
+    tetEnergy.resize(solver->numTet);
+    double tol2 = localStepTolerance * localStepTolerance;
+    int refitted = 0;
+    bool posed = !baseDeform.empty();
+
+    #pragma omp parallel
+    {
+        Matrix3d F, S, Rfit;
+        #pragma omp for reduction(+:refitted)
+        for (int i = 0; i < solver->numTet; i++) {
+            F = (solver->tetInverse[i] * Q[i]).block(0, 0, 3, 3);
+            if (posed) {
+                F = F * baseDeformInverse[i];   // back to the rest frame of the targets
+            }
+            if (!fullSweep && (F - tetDeform[i]).squaredNorm() <= tol2 * tetDeform[i].squaredNorm()) {
+                continue;
+            }
+            tetDeform[i] = F;
+            polarHigham(F, S, Rfit);
+            AR[i] = Rfit;
+            tetEnergy[i] = (S - AS[i]).squaredNorm();
+            refitted++;
+        }
+
+        // Average over incident tets (the implicit barrier above makes tetEnergy complete)
+        if (vertexEnergy) {
+            double* out = vertexEnergy->data();
+            #pragma omp for
+            for (int v = 0; v < numPts; v++) {
+                double e = 0.0;
+                for (int k = ptsTetStart[v]; k < ptsTetStart[v + 1]; k++) {
+                    e += ptsTetScale[k] * tetEnergy[ptsTetIdx[k]];
+                }
+                out[v] = multiplier * e;
+            }
+        }
+    }
+
+    numRefitted += refitted;
+    numLocalVisited += solver->numTet;
 }
 
 bool NWayBlender::computeBlend(const std::vector<double>& weights,
@@ -349,76 +2087,461 @@ bool NWayBlender::computeBlend(const std::vector<double>& weights,
         return false;
     }
 
-    // Resize parametrization arrays
-    logR.resize(numMesh);
-    logS.resize(numMesh);
-    R.resize(numMesh);
-    S.resize(numMesh);
-    GL.resize(numMesh);
-    logGL.resize(numMesh);
-    quat.resize(numMesh);
-    L.resize(numMesh);
+    // Milliseconds since the previous call
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point stageStart = Clock::now();
+    auto lap = [&stageStart]() {
+        Clock::time_point now = Clock::now();
+        double ms = std::chrono::duration<double, std::milli>(now - stageStart).count();
+        stageStart = now;
+        return ms;
+    };
+    lastTimings = BlendTimings();
 
-    // Parametrize any new or modified blend meshes
-    for (int j = numParametrized; j < numMesh; j++) {
-        parametrizeBlendMesh(j);
-    }
-    numParametrized = numMesh;
+    // Only meshes with a nonzero weight are needed for this blend
+    updateMeshCache(&weights);
+    prepareParametrization(&weights);
+    lastTimings.prepare = lap();
 
     // Blend transformations
-    std::vector<Matrix3d> AR(solver.numTet);
-    std::vector<Matrix3d> AS(solver.numTet);
-    std::vector<Vector3d> AL(solver.numTet);
+    std::vector<Matrix3d> AR(solver->numTet);
+    std::vector<Matrix3d> AS(solver->numTet);
+    std::vector<Vector3d> AL(solver->numTet);
 
-    blendTransformations(weights, AR, AS, AL);
+    blendTransformations(blendMode, weights, AR, AS, AL);
+    lastTimings.blend = lap();
 
-    // Prepare for ARAP iteration
-    std::vector<Vector3d> new_pts(numPts);
-    std::vector<Matrix4d> A(solver.numTet);
-    std::vector<double> tetEnergy(solver.numTet);
+    // Prepare for ARAP iteration; the iterates are written to the output mesh directly
+    if (output.numVertices() != numPts) {
+        output.V.resize(numPts, 3);
+    }
+    const Vector3d* new_pts = output.vertexArray();
+    std::vector<Matrix4d> A(solver->numTet);
+    iterWork.localStepCount = 0;
+    numRefitted = 0;
+    numLocalVisited = 0;
 
     // Iterate to determine vertex positions
+    bool posed = !baseDeform.empty();
     for (int k = 0; k < numIterations; k++) {
-        // Compose target matrices
-        for (int i = 0; i < solver.numTet; i++) {
+        // Compose target matrices, followed by the base pose
+        for (int i = 0; i < solver->numTet; i++) {
             A[i] = pad(AS[i] * AR[i], AL[i]);
+            if (posed) {
+                A[i] = A[i] * baseDeform[i];
+            }
         }
 
         // Solve ARAP
-        solver.ARAPSolve(A);
+        solver->ARAPSolve(A);
 
         // Extract new vertex positions
-        for (int i = 0; i < numPts; i++) {
-            new_pts[i][0] = solver.Sol(i, 0);
-            new_pts[i][1] = solver.Sol(i, 1);
-            new_pts[i][2] = solver.Sol(i, 2);
+        output.V = solver->Sol.topRows(numPts);
+        lastTimings.solve += lap();
+        lastTimings.iterations++;
+
+        // If iterating, recompute rotations; on the last iteration, the
+        // visualized vertex energy is reduced in the same pass
+        if (k + 1 < numIterations) {
+            computeEnergy(new_pts, AS, AR, iterWork);
+            lastTimings.local += lap();
+        } else if (visualizeEnergy) {
+            computeEnergy(new_pts, AS, AR, iterWork, &output.vertexEnergy, visualizationMultiplier);
+            lastTimings.energy = lap();
         }
+    }
 
-        // If iterating or visualizing, recompute rotations
-        if (k + 1 < numIterations || visualizeEnergy) {
-            computeEnergy(new_pts, AS, AR, tetEnergy);
+    return true;
+}
+
+bool NWayBlender::computeBlends(const std::vector<std::vector<double>>& weights,
+                               const std::vector<Mesh*>& outputs) {
+    if (needsInitialization) {
+        std::cerr << "NWayBlender::computeBlends() - Not initialized" << std::endl;
+        return false;
+    }
+
+    int numMesh = (int)blendMeshes.size();
+    if (numMesh == 0) {
+        std::cerr << "NWayBlender::computeBlends() - No blend meshes" << std::endl;
+        return false;
+    }
+
+    int numBlends = (int)weights.size();
+    if (numBlends == 0 || (int)outputs.size() != numBlends) {
+        std::cerr << "NWayBlender::computeBlends() - Need one output mesh per weight vector" << std::endl;
+        return false;
+    }
+
+    for (const std::vector<double>& w : weights) {
+        if ((int)w.size() != numMesh) {
+            std::cerr << "NWayBlender::computeBlends() - Weight count mismatch" << std::endl;
+            return false;
         }
     }
 
-    // Update output mesh
-    output.updateFromVector3d(new_pts);
+    // Milliseconds since the previous call
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point stageStart = Clock::now();
+    auto lap = [&stageStart]() {
+        Clock::time_point now = Clock::now();
+        double ms = std::chrono::duration<double, std::milli>(now - stageStart).count();
+        stageStart = now;
+        return ms;
+    };
+    lastTimings = BlendTimings();
 
-    // Compute vertex energy for visualization
-    if (visualizeEnergy) {
-        Tetrise::makePtsWeightList(tetMode, numPts, solver.tetList, faceList, edgeList,
-                                   vertexList, tetEnergy, ptsEnergy);
+    // The meshes with a nonzero weight in any of the blends
+    std::vector<double> used(numMesh, 0.0);
+    for (const std::vector<double>& w : weights) {
+        for (int j = 0; j < numMesh; j++) {
+            if (w[j] != 0.0) {
+                used[j] = 1.0;
+            }
+        }
+    }
+    updateMeshCache(&used);
+    prepareParametrization(&used);
+    lastTimings.prepare = lap();
+
+    std::vector<short> modes(numBlends, blendMode);
+    std::vector<const std::vector<double>*> blendWeights(numBlends);
+    for (int b = 0; b < numBlends; b++) {
+        blendWeights[b] = &weights[b];
+    }
+    iterateBlends(modes, blendWeights, outputs, false, 1.0);
+    return true;
+}
 
-        // Scale energy for visualization
-        for (int i = 0; i < numPts; i++) {
-            ptsEnergy[i] *= visualizationMultiplier;
+bool NWayBlender::computeBlendModes(const std::vector<double>& weights,
+                                    const std::vector<short>& modes,
+                                    const std::vector<Mesh*>& outputs,
+                                    bool visualizeEnergy,
+                                    double visualizationMultiplier) {
+    if (needsInitialization) {
+        std::cerr << "NWayBlender::computeBlendModes() - Not initialized" << std::endl;
+        return false;
+    }
+
+    int numMesh = (int)blendMeshes.size();
+    if (numMesh == 0) {
+        std::cerr << "NWayBlender::computeBlendModes() - No blend meshes" << std::endl;
+        return false;
+    }
+
+    if ((int)weights.size() != numMesh) {
+        std::cerr << "NWayBlender::computeBlendModes() - Weight count mismatch" << std::endl;
+        return false;
+    }
+
+    int numModes = (int)modes.size();
+    if (numModes == 0 || (int)outputs.size() != numModes) {
+        std::cerr << "NWayBlender::computeBlendModes() - Need one output mesh per mode" << std::endl;
+        return false;
+    }
+
+    for (short mode : modes) {
+        if (mode != BM_SRL && mode != BM_LOG3 && mode != BM_SQL && mode != BM_SlRL && mode != BM_AFF) {
+            std::cerr << "NWayBlender::computeBlendModes() - Unsupported blend mode " << mode << std::endl;
+            return false;
+        }
+        if (isRigAttached() && mode != blendMode) {
+            std::cerr << "NWayBlender::computeBlendModes() - The attached rig only holds blend mode "
+                      << blendMode << std::endl;
+            return false;
+        }
+    }
+
+    // Milliseconds since the previous call; stages add up over the modes
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point stageStart = Clock::now();
+    auto lap = [&stageStart]() {
+        Clock::time_point now = Clock::now();
+        double ms = std::chrono::duration<double, std::milli>(now - stageStart).count();
+        stageStart = now;
+        return ms;
+    };
+    lastTimings = BlendTimings();
+
+    // One parametrization pass for all the modes
+    setCompareModes(modes);
+    updateMeshCache(&weights);
+    prepareParametrization(&weights);
+    lastTimings.prepare = lap();
+
+    std::vector<const std::vector<double>*> modeWeights(numModes, &weights);
+    iterateBlends(modes, modeWeights, outputs, visualizeEnergy, visualizationMultiplier);
+    return true;
+}
+
+void NWayBlender::iterateBlends(const std::vector<short>& modes,
+                                const std::vector<const std::vector<double>*>& weights,
+                                const std::vector<Mesh*>& outputs,
+                                bool visualizeEnergy,
+                                double visualizationMultiplier) {
+    int numBlends = (int)modes.size();
+
+    // Milliseconds since the previous call; stages add up over the blends
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point stageStart = Clock::now();
+    auto lap = [&stageStart]() {
+        Clock::time_point now = Clock::now();
+        double ms = std::chrono::duration<double, std::milli>(now - stageStart).count();
+        stageStart = now;
+        return ms;
+    };
+
+    // Blend transformations, one workspace per blend
+    std::vector<std::vector<Matrix3d>> AR(numBlends, std::vector<Matrix3d>(solver->numTet));
+    std::vector<std::vector<Matrix3d>> AS(numBlends, std::vector<Matrix3d>(solver->numTet));
+    std::vector<std::vector<Vector3d>> AL(numBlends, std::vector<Vector3d>(solver->numTet));
+    for (int b = 0; b < numBlends; b++) {
+        blendTransformations(modes[b], *weights[b], AR[b], AS[b], AL[b]);
+    }
+    lastTimings.blend = lap();
+
+    batchWork.resize(numBlends);
+    for (int b = 0; b < numBlends; b++) {
+        batchWork[b].localStepCount = 0;
+        if (outputs[b]->numVertices() != numPts) {
+            outputs[b]->V.resize(numPts, 3);
         }
+    }
+    std::vector<std::vector<Matrix4d>> A(numBlends, std::vector<Matrix4d>(solver->numTet));
+    MatrixXd B(solver->dim, 3 * numBlends);
+    numRefitted = 0;
+    numLocalVisited = 0;
 
-        // Store in output mesh
-        output.vertexEnergy.resize(numPts);
-        for (int i = 0; i < numPts; i++) {
-            output.vertexEnergy[i] = ptsEnergy[i];
+    // The blends iterate in lockstep: their right-hand sides are assembled
+    // concurrently and solved with the shared factorization in one call
+    bool posed = !baseDeform.empty();
+    for (int k = 0; k < numIterations; k++) {
+        #pragma omp parallel for schedule(dynamic)
+        for (int b = 0; b < numBlends; b++) {
+            for (int i = 0; i < solver->numTet; i++) {
+                A[b][i] = pad(AS[b][i] * AR[b][i], AL[b][i]);
+                if (posed) {
+                    A[b][i] = A[b][i] * baseDeform[i];
+                }
+            }
+            B.middleCols(3 * b, 3) = solver->ARAPrhs(A[b]);
+        }
+        MatrixXd X = solver->systemSolveBlocks(B, 3);
+        for (int b = 0; b < numBlends; b++) {
+            outputs[b]->V = X.block(0, 3 * b, numPts, 3);
         }
+        lastTimings.solve += lap();
+        lastTimings.iterations++;
+
+        for (int b = 0; b < numBlends; b++) {
+            const Vector3d* new_pts = outputs[b]->vertexArray();
+            if (k + 1 < numIterations) {
+                computeEnergy(new_pts, AS[b], AR[b], batchWork[b]);
+            } else if (visualizeEnergy) {
+                computeEnergy(new_pts, AS[b], AR[b], batchWork[b], &outputs[b]->vertexEnergy,
+                              visualizationMultiplier);
+            }
+        }
+        if (k + 1 < numIterations) {
+            lastTimings.local += lap();
+        } else if (visualizeEnergy) {
+            lastTimings.energy = lap();
+        }
+    }
+}
+
+// Derivative of the unit quaternion -> rotation matrix map (Eigen's toRotationMatrix())
+// with respect to the coefficient c of q = (x, y, z, w)
+static Matrix3d dRotationdQuat(const Vector4d& q, int c) {
+    double x = q[0], y = q[1], z = q[2], w = q[3];
+    Matrix3d D;
+    switch (c) {
+        case 0: D <<    0,  2*y,  2*z,   2*y, -4*x, -2*w,   2*z,  2*w, -4*x; break;
+        case 1: D << -4*y,  2*x,  2*w,   2*x,    0,  2*z,  -2*w,  2*z, -4*y; break;
+        case 2: D << -4*z, -2*w,  2*x,   2*w, -4*z,  2*y,   2*x,  2*y,    0; break;
+        default: D <<   0, -2*z,  2*y,   2*z,    0, -2*x,  -2*y,  2*x,    0; break;
+    }
+    return D;
+}
+
+double NWayBlender::fitObjective(const Mesh::VertexMatrix& target, const VectorXd& w, VectorXd& grad) {
+    int numMesh = (int)blendMeshes.size();
+    int numTet = solver->numTet;
+    std::vector<double> weights(w.data(), w.data() + numMesh);
+
+    // Forward: the first global step of computeBlend()
+    std::vector<Matrix3d> AR(numTet), AS(numTet);
+    std::vector<Vector3d> AL(numTet);
+    blendTransformations(blendMode, weights, AR, AS, AL, false);  // the gradient is exact for the full data
+    std::vector<Matrix4d> A(numTet);
+    bool posed = !baseDeform.empty();
+    for (int i = 0; i < numTet; i++) {
+        A[i] = pad(AS[i] * AR[i], AL[i]);
+        if (posed) {
+            A[i] = A[i] * baseDeform[i];
+        }
+    }
+    solver->ARAPSolve(A);
+
+    // Residual, up to the global translation pinned by the soft constraint
+    MatrixXd res(numPts, 3);
+    for (int i = 0; i < numPts; i++) {
+        res.row(i) = solver->Sol.row(i) - target.row(i);
+    }
+    RowVector3d shift = res.colwise().mean();
+    res.rowwise() -= shift;
+    double f = 0.5 * res.squaredNorm();
+
+    // Adjoint: the system matrix is symmetric, so its factorization solves for lambda as well
+    MatrixXd rhs = MatrixXd::Zero(solver->dim, 3);
+    rhs.topRows(numPts) = res;
+    MatrixXd lambda = solver->systemSolve(rhs);
+
+    // Per tet, df/dA_i = tetWeight_i * diag * tetMatrixInverse_i * lambda_i, then chain through the blend
+    Matrix4d diag = Matrix4d::Identity();
+    diag(3, 3) = solver->transWeight;
+    std::vector<double> unit(numMesh, 1.0);
+    const Vector4d qI(0, 0, 0, 1);
+    MatrixXd tetGrad(numTet, numMesh);
+
+    #pragma omp parallel for
+    for (int i = 0; i < numTet; i++) {
+        Matrix<double, 4, 3> lam;
+        for (int r = 0; r < 4; r++) {
+            lam.row(r) = lambda.row(solver->tetList[4 * i + r]);
+        }
+        Matrix<double, 4, 3> Y = solver->tetWeight[i] * diag * solver->tetInverse[i] * lam;
+        if (posed) {
+            Y = Y * baseDeform[i].block(0, 0, 3, 3).transpose();    // through A * D
+        }
+        Matrix3d YM = Y.topRows(3);
+        Vector3d YL = Y.row(3).transpose();
+        Matrix3d YS = YM * AR[i].transpose();   // A = AS * AR
+        Matrix3d YR = AS[i].transpose() * YM;
+
+        // Pull the sensitivities back through exp (or the quaternion normalisation) once per tet
+        Matrix3d XR = Matrix3d::Zero(), XS = Matrix3d::Zero();
+        Vector4d v = Vector4d::Zero();
+        double sum = 0.0;
+        for (int j = 0; j < numMesh; j++) {
+            double wj = maskedWeight(weights, tetMask, j, i);
+            if (blendMode == BM_SRL || blendMode == BM_SlRL) XR += wj * logR[j][i];
+            if (blendMode == BM_SRL) XS += wj * logS[j][i];
+            if (blendMode == BM_LOG3) XR += wj * logGL[j][i];
+            if (blendMode == BM_SQL) v += wj * quat[j][i];
+            sum += wj;
+        }
+        Matrix3d ZR = Matrix3d::Zero(), ZS = Matrix3d::Zero();
+        Vector4d gv = Vector4d::Zero();
+        if (blendMode == BM_SRL || blendMode == BM_SlRL || blendMode == BM_LOG3) {
+            ZR = expFrechet(XR.transpose(), YR);
+        }
+        if (blendMode == BM_SRL) {
+            ZS = expFrechet(XS.transpose(), YS);
+        }
+        if (blendMode == BM_SQL) {
+            v += (1.0 - sum) * qI;
+            double vn = v.norm();
+            Vector4d q = v / vn;
+            Vector4d gq;
+            Matrix3d YRt = YR.transpose();      // AR is the transpose of the quaternion's matrix
+            for (int c = 0; c < 4; c++) {
+                gq[c] = YRt.cwiseProduct(dRotationdQuat(q, c)).sum();
+            }
+            gv = (gq - q * q.dot(gq)) / vn;
+        }
+
+        for (int j = 0; j < numMesh; j++) {
+            double g = YL.dot(L[j][i]);
+            switch (blendMode) {
+                case BM_SRL:
+                    g += ZR.cwiseProduct(logR[j][i]).sum() + ZS.cwiseProduct(logS[j][i]).sum();
+                    break;
+                case BM_LOG3:
+                    g += ZR.cwiseProduct(logGL[j][i]).sum();
+                    break;
+                case BM_SlRL:
+                    g += ZR.cwiseProduct(logR[j][i]).sum() + YS.cwiseProduct(S[j][i] - Matrix3d::Identity()).sum();
+                    break;
+                case BM_SQL:
+                    g += gv.dot(quat[j][i] - qI) + YS.cwiseProduct(S[j][i] - Matrix3d::Identity()).sum();
+                    break;
+                case BM_AFF:
+                    g += YM.cwiseProduct(GL[j][i] - Matrix3d::Identity()).sum();
+                    break;
+            }
+            tetGrad(i, j) = maskedWeight(unit, tetMask, j, i) * g;
+        }
+    }
+    grad = tetGrad.colwise().sum().transpose();
+    return f;
+}
+
+bool NWayBlender::fitWeights(const Mesh& target,
+                             std::vector<double>& weights,
+                             const WeightFitOptions& options,
+                             double* rmsError) {
+    if (needsInitialization) {
+        std::cerr << "NWayBlender::fitWeights() - Not initialized" << std::endl;
+        return false;
+    }
+
+    int numMesh = (int)blendMeshes.size();
+    if (numMesh == 0) {
+        std::cerr << "NWayBlender::fitWeights() - No blend meshes" << std::endl;
+        return false;
+    }
+
+    if (rig) {
+        std::cerr << "NWayBlender::fitWeights() - Not available with an attached rig image" << std::endl;
+        return false;
+    }
+
+    if (target.numVertices() != numPts) {
+        std::cerr << "NWayBlender::fitWeights() - Target has " << target.numVertices()
+                  << " vertices, expected " << numPts << std::endl;
+        return false;
+    }
+
+    if (blendMode != BM_SRL && blendMode != BM_LOG3 && blendMode != BM_SQL &&
+        blendMode != BM_SlRL && blendMode != BM_AFF) {
+        std::cerr << "NWayBlender::fitWeights() - Unsupported blend mode " << blendMode << std::endl;
+        return false;
+    }
+    if (memoryBudget > 0) {
+        std::cerr << "NWayBlender::fitWeights() - Not available with a memory budget" << std::endl;
+        return false;
+    }
+    if (numMirroredMeshes() > 0) {
+        std::cerr << "NWayBlender::fitWeights() - Not available with mirrored blend meshes" << std::endl;
+        return false;
+    }
+
+    updateMeshCache();
+    prepareParametrization();
+
+    VectorXd w = VectorXd::Zero(numMesh);
+    if ((int)weights.size() == numMesh) {
+        w = Map<const VectorXd>(weights.data(), numMesh);
+    }
+
+    LBFGS optimizer;
+    optimizer.maxIter = options.maxIterations;
+    optimizer.tol = options.tolerance;
+    optimizer.setBounds(numMesh, options.lowerBound, options.upperBound);
+    optimizer.fixSum = options.fixSum;
+    optimizer.sum = options.sum;
+
+    auto objective = [&](const VectorXd& x, VectorXd& g) { return fitObjective(target.V, x, g); };
+    double f = optimizer.minimize(objective, w);
+
+    weights.assign(w.data(), w.data() + numMesh);
+    double rms = std::sqrt(2.0 * f / numPts);
+    if (rmsError) {
+        *rmsError = rms;
     }
 
+    std::cout << "NWayBlender: Fitted " << numMesh << " weights in " << optimizer.numIter
+              << " iterations (" << optimizer.numEval << " evaluations), RMS error " << rms << std::endl;
     return true;
 }
@@ -16,17 +16,81 @@
 #include <vector>
 #include <set>
 #include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <string>
 
 using namespace Eigen;
 using namespace AffineLib;
 using namespace Tetrise;
 
+/**
+ * @brief Options for NWayBlender::fitWeights()
+ */
+struct WeightFitOptions {
+    double lowerBound;      ///< Lower bound on each weight (-HUGE_VAL for none)
+    double upperBound;      ///< Upper bound on each weight (HUGE_VAL for none)
+    bool fixSum;            ///< Constrain the weights to add up to sum
+    double sum;             ///< Target sum when fixSum is set
+    int maxIterations;      ///< L-BFGS iterations
+    double tolerance;       ///< Stop when the projected gradient or the relative decrease is below this
+
+    WeightFitOptions()
+        : lowerBound(0.0), upperBound(1.0), fixSum(false), sum(1.0),
+          maxIterations(100), tolerance(1e-10) {}
+};
+
+/**
+ * @brief Process-wide threading settings, see NWayBlender::configureThreads()
+ */
+struct ThreadConfig {
+    int numThreads;         ///< OpenMP threads (0 = runtime default)
+    bool pinThreads;        ///< Pin OpenMP thread i to the i-th core the process may run on
+    bool nested;            ///< Let parallel loops inside parallel regions spawn threads
+
+    ThreadConfig() : numThreads(0), pinThreads(false), nested(false) {}
+};
+
+/**
+ * @brief Wall-clock time (ms) of the stages of the last NWayBlender::computeBlend()
+ */
+struct BlendTimings {
+    double prepare;         ///< Parametrization of targets that just became active
+    double blend;           ///< Blending the transformations
+    double solve;           ///< All global steps
+    double local;           ///< Local steps between iterations
+    double energy;          ///< Energy visualization
+    int iterations;         ///< Global steps performed
+
+    BlendTimings() : prepare(0.0), blend(0.0), solve(0.0), local(0.0), energy(0.0), iterations(0) {}
+
+    double total() const { return prepare + blend + solve + local + energy; }
+};
+
+/**
+ * @brief Low-rank approximation of a per-tet quantity over all blend meshes
+ *
+ * Mesh j's list is approximated by offset + sum_k coef(k, j) * basis[k].
+ */
+template<typename T>
+struct ParamBasis {
+    std::vector<std::vector<T>> basis;          ///< K per-tet fields
+    MatrixXd coef;                              ///< K x numBlendMeshes coefficients
+
+    void clear() { basis.clear(); coef.resize(0, 0); }
+};
+
 /**
  * @brief N-Way blending engine
  *
  * Implements the core blending algorithm from the Maya plugin.
  * Handles tetrahedralization, parametrization, and ARAP-based blending.
  */
+class RigImage;
+
 class NWayBlender {
 public:
     /**
@@ -51,6 +115,17 @@ public:
      */
     void addBlendMesh(const Mesh& mesh);
 
+    /**
+     * @brief Replace the geometry of a blend mesh (e.g. the next animation frame)
+     *
+     * Only this mesh is reparametrized by the next computeBlend(). With temporal
+     * coherence enabled, its previous rotation logs seed the new ones.
+     *
+     * @param index Index of blend mesh
+     * @param mesh New geometry (same topology as base)
+     */
+    void updateBlendMesh(int index, const Mesh& mesh);
+
     /**
      * @brief Clear all meshes
      */
@@ -59,12 +134,208 @@ public:
     /**
      * @brief Set blending parameters
      */
-    void setBlendMode(short mode) { blendMode = mode; needsParametrization = true; }
-    void setTetMode(short mode) { tetMode = mode; needsInitialization = true; }
+    void setBlendMode(short mode);
+    void setTetMode(short mode);
     void setNumIterations(short iters) { numIterations = iters; }
-    void setRotationConsistency(bool enable) { rotationConsistency = enable; needsParametrization = true; }
+    void setRotationConsistency(bool enable);
     void setAreaWeighted(bool enable) { areaWeighted = enable; needsInitialization = true; }
-    void setInitRotation(double angle) { initRotationAngle = angle; }
+    void setInitRotation(double angle);
+
+    /**
+     * @brief Keep rotation log branches coherent across frames
+     *
+     * When a blend mesh is reparametrized (see updateBlendMesh()), each tet takes
+     * the log branch closest to its log from the previous frame. Tets whose
+     * rotation jumped by more than jumpAngle fall back to the spatial BFS of
+     * rotation consistency, seeded by their coherent neighbours.
+     *
+     * @param enable Enable temporal coherence
+     * @param jumpAngle Largest per-frame rotation change (degrees) treated as coherent
+     */
+    void setTemporalCoherence(bool enable, double jumpAngle = 45.0);
+
+    /**
+     * @brief Share the parametrization of mirror-image blend meshes
+     *
+     * initialize() detects the mirror vertex map of the base mesh across the
+     * plane perpendicular to axis (unless one was given by setMirrorMap) and
+     * the mirror tet of every tet. A blend mesh that is the mirror image of an
+     * earlier one (e.g. the right-side corrective of a left-side one) then
+     * stores no parametrization: its transformations are those of the earlier
+     * mesh on the mirror tets, conjugated by the reflection. Weight fitting and
+     * target compression are unavailable while meshes are shared this way.
+     *
+     * @param enable Enable mirror symmetry
+     * @param axis Mirror axis (0 = x, 1 = y, 2 = z)
+     * @param tolerance Largest vertex mismatch, relative to the base mesh bounding box diagonal
+     */
+    void setMirrorSymmetry(bool enable, int axis = 0, double tolerance = 1e-4);
+
+    /**
+     * @brief Use a known mirror vertex map instead of detecting one
+     *
+     * @param mirror mirror[v] is the vertex mirroring v (empty to detect)
+     * @param plane Coordinate of the mirror plane along the mirror axis
+     */
+    void setMirrorMap(const std::vector<int>& mirror, double plane);
+
+    /**
+     * @brief Check if initialize() found the base mesh mirror symmetric
+     */
+    bool hasMirrorSymmetry() const { return !tetMirror.empty(); }
+
+    /**
+     * @brief Number of blend meshes sharing the parametrization of their mirror image
+     */
+    int numMirroredMeshes() const;
+
+    /**
+     * @brief Configure the adaptive local step
+     *
+     * Between ARAP iterations, tets whose deformation gradient changed by less
+     * than tolerance (relative Frobenius norm) since their last polar fit keep
+     * their rotation. Every fullSweep-th local step refits all tets.
+     *
+     * @param tolerance Relative change threshold (0 refits every tet every iteration)
+     * @param fullSweep Interval of full sweeps, counted in local steps
+     */
+    void setLocalStepTolerance(double tolerance, short fullSweep = 4) {
+        localStepTolerance = tolerance;
+        fullSweepInterval = fullSweep;
+    }
+
+    /**
+     * @brief Configure the OpenMP threads of the process
+     *
+     * Applies to all engines; call it from the main thread before
+     * initialize(). Per-tet data is first written by parallel loops with the
+     * same static schedule as the blend loops, so with pinned threads each
+     * NUMA node holds the tets that its cores blend. Background threads of
+     * the engine are not pinned, and run on any core of the process.
+     * Nested parallelism is off by default: the loops over meshes run their
+     * per-tet loops on a single thread.
+     *
+     * @param config Thread count, pinning and nesting policy
+     * @return false if pinning is not supported or failed
+     */
+    static bool configureThreads(const ThreadConfig& config);
+
+    /**
+     * @brief Solve the ARAP system by domain decomposition
+     *
+     * With more than one subdomain, initialize() partitions the mesh and
+     * factorizes the subdomain interiors and the Schur complement of their
+     * interface in parallel instead of factorizing the whole system, and each
+     * global step solves the subdomains in parallel (see DDSolver). The result
+     * is the same as with the single factorization. Pays off on large meshes
+     * and many cores.
+     *
+     * @param numDomains Number of subdomains (0 or 1 = single factorization)
+     */
+    void setSolverDomains(int numDomains);
+
+    /**
+     * @brief Vertices on the interface between solver subdomains (0 with a single factorization)
+     */
+    int getSolverInterfaceSize() const {
+        return solver->numDomains > 1 ? solver->ddSolver.numInterface() : 0;
+    }
+
+    /**
+     * @brief Fraction of polar fits skipped by the adaptive local step in the last computeBlend()
+     */
+    double getSkippedFraction() const {
+        return numLocalVisited > 0 ? 1.0 - (double)numRefitted / numLocalVisited : 0.0;
+    }
+
+    /**
+     * @brief Stage timings of the last computeBlend()
+     */
+    const BlendTimings& getLastTimings() const { return lastTimings; }
+
+    /**
+     * @brief Set per-vertex weight masks for spatially varying blends
+     *
+     * The effective weight of blend mesh j on a tet is weights[j] times the
+     * tet average of column j (see Tetrise::makeTetWeightList). Meshes without
+     * a column are not masked. An empty matrix disables masking.
+     *
+     * @param mask numPts x (up to) numBlendMeshes
+     */
+    void setWeightMask(const MatrixXd& mask);
+
+    /**
+     * @brief Set per-vertex stiffness (SM_PAINT)
+     *
+     * The ARAP weight of each tet is multiplied by the tet average of the
+     * stiffness (see Tetrise::makeTetWeightList). Once initialized, only the
+     * tets whose weight changed are patched into the system matrix, followed by
+     * a numeric refactorization that reuses the symbolic analysis.
+     *
+     * @param stiffness numPts values (empty for uniform stiffness)
+     * @return true if successful
+     */
+    bool setStiffness(const VectorXd& stiffness);
+
+    /**
+     * @brief Get per-vertex stiffness (empty if uniform)
+     */
+    const VectorXd& getStiffness() const { return ptsStiffness; }
+
+    /**
+     * @brief Blend correctives on top of a deformed (e.g. skinned) base mesh
+     *
+     * The blend targets stay parametrized against the rest pose given by
+     * setBaseMesh(). Each frame, the per-tet affine map D from the rest pose to
+     * the posed base is composed after the blended transformation, so the ARAP
+     * targets become A * D. The system matrix only depends on the rest pose and
+     * is reused as is; the pose changes the right-hand side only (the targets,
+     * the pinned vertex and the regularization, which pulls towards the posed
+     * base instead of the origin), and costs one tet matrix pass per frame. The
+     * local step fits rotations in the rest frame, against F * D^-1.
+     *
+     * @param posed Posed base vertex positions (empty to blend on the rest pose)
+     * @return true if successful
+     */
+    bool setBasePose(const std::vector<Vector3d>& posed);
+
+    /**
+     * @brief Check if blending on top of a posed base mesh
+     */
+    bool hasBasePose() const { return !basePose.empty(); }
+
+    /**
+     * @brief Make a blend mesh the base mesh, and the base mesh a blend mesh in its place
+     *
+     * The tet structure is shared by all meshes and is kept. The ARAP system
+     * of the new base is factorized on a background thread while blending
+     * continues on the old base, until finishRebase() swaps it in. Targets
+     * parametrized by then are rebased by composing affine maps per tet: if D
+     * maps the old base to the new one and A_k the old base to target k, the
+     * new parametrization of target k is that of D^-1 * A_k (and of D^-1 for
+     * the old base), so only their polar decompositions and logs are redone.
+     * The others are parametrized lazily as usual. The base pose and the
+     * target compression are cleared.
+     *
+     * Not available with mirror symmetry or when the new base has degenerate
+     * tets; initialize() with the swapped meshes instead.
+     *
+     * @param targetIndex Index of the blend mesh to become the base
+     * @return true if the rebase started
+     */
+    bool rebase(int targetIndex);
+
+    /**
+     * @brief Swap in the base mesh of rebase() once its system is factorized
+     * @param wait Block until the factorization is done
+     * @return true if the rebase was applied
+     */
+    bool finishRebase(bool wait = false);
+
+    /**
+     * @brief Check if a rebase is waiting for its factorization
+     */
+    bool isRebasing() const { return rebaseThread.joinable(); }
 
     /**
      * @brief Initialize the blending engine
@@ -76,6 +347,55 @@ public:
      */
     bool initialize();
 
+    /**
+     * @brief Parametrize pending blend meshes on a background thread
+     *
+     * computeBlend() only parametrizes blend meshes whose weight is nonzero.
+     * This speculatively parametrizes the others, in the given order (most
+     * likely to be used first), on a single background thread. A mesh the
+     * background thread is working on when computeBlend() needs it is waited
+     * for, not parametrized twice. Does nothing if a thread is already running.
+     * Any change to the meshes or parametrization settings stops the thread.
+     *
+     * @param order Blend mesh indices in order of priority
+     */
+    void startBackgroundParametrization(const std::vector<int>& order);
+
+    /**
+     * @brief Stop the background parametrization (waits for the current mesh)
+     */
+    void stopBackgroundParametrization();
+
+    /**
+     * @brief Number of blend meshes whose parametrization is up to date
+     */
+    int numParametrizedMeshes();
+
+    /**
+     * @brief Limit the memory held by target parametrizations
+     *
+     * With a budget, only the most used blend meshes (by a decaying count of
+     * blends with a nonzero weight) keep their per-tet parametrization. The
+     * others keep only their vertex positions, plus one byte per tet for the
+     * rotation branch when rotation consistency is enabled, and computeBlend()
+     * recomputes their parametrization tile by tile inside the blend kernel.
+     * Weight fitting and target compression need every parametrization and
+     * are unavailable under a budget.
+     *
+     * @param bytes Byte budget for the parametrizations (0 = unlimited)
+     */
+    void setMemoryBudget(size_t bytes);
+
+    /**
+     * @brief Number of blend meshes whose parametrization is kept in memory
+     */
+    int numCachedMeshes() const;
+
+    /**
+     * @brief Bytes currently held by target parametrizations
+     */
+    size_t parametrizationBytes();
+
     /**
      * @brief Compute N-way blended mesh
      *
@@ -91,9 +411,153 @@ public:
                      double visualizationMultiplier = 1.0);
 
     /**
-     * @brief Get the last computed energy values
+     * @brief Compute the blends of several weight vectors at once
+     *
+     * Each blend is that of computeBlend() in the current mode. The meshes
+     * any of them needs are parametrized first, then the blends iterate in
+     * lockstep as in computeBlendModes(): their right-hand sides are
+     * assembled concurrently and solved together with the shared
+     * factorization. Each blend holds its own tet lists while iterating.
+     *
+     * @param weights Per-mesh blend weights of each blend
+     * @param outputs Output meshes, one per weight vector (updated with the blended results)
+     * @return true if successful
+     */
+    bool computeBlends(const std::vector<std::vector<double>>& weights,
+                       const std::vector<Mesh*>& outputs);
+
+    /**
+     * @brief Compute the blend of the same weights in several blend modes, for side-by-side comparison
+     *
+     * The meshes are parametrized once for all the modes, whose lists derive
+     * from the same polar decomposition per tet. Each mode iterates on its
+     * own workspace, in lockstep with the others: the right-hand sides of
+     * all modes are assembled concurrently and solved together with the
+     * shared factorization. Only the current blend mode uses the compressed
+     * parametrizations or an attached rig, so with a rig attached the other
+     * modes are rejected.
+     *
+     * @param weights Per-mesh blend weights
+     * @param modes Blend modes: BM_SRL, BM_LOG3, BM_SQL, BM_SlRL or BM_AFF
+     * @param outputs Output meshes, one per mode (updated with the blended results)
+     * @param visualizeEnergy If true, compute and store energy values
+     * @param visualizationMultiplier Scaling factor for energy visualization
+     * @return true if successful
+     */
+    bool computeBlendModes(const std::vector<double>& weights,
+                           const std::vector<short>& modes,
+                           const std::vector<Mesh*>& outputs,
+                           bool visualizeEnergy = false,
+                           double visualizationMultiplier = 1.0);
+
+    /**
+     * @brief Also keep the parametrizations of other blend modes
+     *
+     * Modes that are not kept yet reparametrize the meshes once;
+     * computeBlendModes() sets its modes. Dropping modes frees their lists.
+     *
+     * @param modes Blend modes besides the current one (empty = none)
+     */
+    void setCompareModes(const std::vector<short>& modes);
+
+    /**
+     * @brief Find the weights whose blend best matches a target mesh
+     *
+     * Minimizes the squared vertex distance to the target (up to a global
+     * translation) over the weight vector with projected L-BFGS. Gradients are
+     * exact: derivatives of the blend parametrization per tet, and one adjoint
+     * solve that reuses the ARAP factorization. The objective is the first
+     * global step of computeBlend(), which is exact for numIterations == 1.
+     * Supported for BM_SRL, BM_LOG3, BM_SQL, BM_SlRL and BM_AFF.
+     *
+     * @param target Mesh with the same topology as the base mesh
+     * @param weights In: initial guess (zeros if empty). Out: fitted weights
+     * @param options Bounds, sum constraint and stopping criteria
+     * @param rmsError Output (optional): RMS vertex error of the fit
+     * @return true if successful
+     */
+    bool fitWeights(const Mesh& target,
+                    std::vector<double>& weights,
+                    const WeightFitOptions& options = WeightFitOptions(),
+                    double* rmsError = nullptr);
+
+    /**
+     * @brief Compress the target parametrizations (streaming PCA)
+     *
+     * Each parametrized quantity blended by the current mode (e.g. logR, logS
+     * and L for BM_SRL) is approximated over all blend meshes by K principal
+     * components, with K chosen so that every mesh stays within the relative
+     * error budget. While the compression is valid, computeBlend() maps the
+     * weights through the K x N coefficients and blends O(K * numTet) data
+     * instead of O(N * numTet). The compression is dropped when meshes are
+     * reparametrized, and is not used with weight masks or another blend mode.
+     * While it is used, the full parametrizations are released as for meshes
+     * outside a memory budget; they are computed again for the blends that
+     * do not use it, for weight fitting and saving a rig, and after rebase().
+     *
+     * @param tolerance Relative error budget per mesh
+     * @return true if successful
+     */
+    bool compressTargets(double tolerance);
+
+    /**
+     * @brief Drop the compression and blend the full parametrizations
+     */
+    void clearCompression();
+
+    /**
+     * @brief Check if computeBlend() uses the compressed parametrizations
+     */
+    bool isCompressed() const;
+
+    /**
+     * @brief Number of principal components kept (largest over the quantities)
+     */
+    int numComponents() const;
+
+    /**
+     * @brief Relative approximation error per blend mesh (largest over the quantities)
+     */
+    const std::vector<double>& getCompressionError() const { return compressionError; }
+
+    /**
+     * @brief Write the prepared rig to a file that other processes can attach
+     *
+     * Parametrizes every blend mesh, then writes the factor of the ARAP system
+     * (in the form of the parallel triangular solves), the inverse tet
+     * matrices and the parametrizations blended by the current mode (as for
+     * compressTargets()), with a key of the meshes and settings they depend
+     * on. Not available with a memory budget, mirrored blend meshes, solver
+     * domains or CHOLMOD.
+     *
+     * @param path Output file, e.g. in /dev/shm to keep it in memory
+     * @return true if successful
+     */
+    bool saveRig(const std::string& path);
+
+    /**
+     * @brief Initialize from a rig image instead of factorizing and parametrizing
+     *
+     * The meshes and settings must be those the image was saved with. The
+     * image is mapped read-only and shared: the global steps solve with its
+     * factor and inverse tet matrices and the blends read its
+     * parametrizations in place, so every process attached to it shares one
+     * physical copy. Only the tet structure, which is linear in the mesh
+     * size, is built again. Stiffness changes, rebase(), fitWeights() and
+     * compressTargets() need the system matrix or own parametrizations and
+     * are unavailable until initialize(); blend
+     * meshes that are replaced, or all of them after a parametrization
+     * setting changes, are parametrized as usual.
+     *
+     * @param path Rig image written by saveRig()
+     * @return false if the image cannot be mapped or does not match
+     */
+    bool attachRig(const std::string& path);
+
+    /**
+     * @brief Check if the engine runs on an attached rig image
      */
-    const std::vector<double>& getVertexEnergy() const { return ptsEnergy; }
+    bool isRigAttached() const { return rig != nullptr; }
 
     /**
      * @brief Check if blender is initialized
@@ -113,7 +577,7 @@ private:
     int numPts;                                 // Number of vertices
 
     // ========== Tetrahedral Structure ==========
-    Laplacian solver;                           // ARAP solver
+    std::unique_ptr<Laplacian> solver;          // ARAP solver (replaced as a whole by rebase())
     std::vector<int> faceList;                  // Triangulated faces
     std::vector<edge> edgeList;                 // Edge topology
     std::vector<vertex> vertexList;             // Vertex connectivity
@@ -130,10 +594,81 @@ private:
     std::vector<std::vector<Vector3d>> L;       // Translation part
     std::vector<std::vector<Vector4d>> quat;    // Quaternions
 
+    // ========== Memory Budget ==========
+    size_t memoryBudget;                        // Bytes for parametrizations (0 = unlimited)
+    std::vector<char> meshCached;               // Parametrization kept (1) or recomputed (0) per blend mesh
+    std::vector<double> meshUsage;              // Decaying count of blends using each mesh
+    std::vector<std::vector<signed char>> logBranch; // Rotation log branch per tet of recomputed meshes
+    std::vector<std::vector<std::pair<int, Matrix3d>>> logExplicit; // (tet, log) where the branch cannot tell
+    std::vector<int> tetGroupStart;             // Tets of group g (see Tetrise::makeTetGroups)
+
+    // ========== Mirror Symmetry ==========
+    bool mirrorSymmetry;                        // Share parametrizations of mirror-image meshes
+    int mirrorAxis;                             // Mirror axis (0 = x, 1 = y, 2 = z)
+    double mirrorTolerance;                     // Relative to the base mesh bounding box diagonal
+    std::vector<int> userPtsMirror;             // Mirror vertex map from setMirrorMap (empty = detect)
+    double userMirrorPlane;                     // Mirror plane from setMirrorMap
+    std::vector<int> ptsMirror;                 // Mirror vertex map in use (empty = no symmetry)
+    double mirrorPlane;                         // Mirror plane coordinate along mirrorAxis
+    double mirrorMaxDist;                       // Largest vertex mismatch of mirror images
+    std::vector<int> tetMirror;                 // Mirror tet of each tet
+    std::vector<int> mirrorSource;              // Mesh each blend mesh mirrors (-1 = own parametrization)
+
+    // ========== Compressed Parametrizations ==========
+    // Which lists they approximate depends on compressedMode (see compressTargets)
+    ParamBasis<Matrix3d> pcaRot;                // logR, logGL or GL
+    ParamBasis<Matrix3d> pcaScale;              // logS or S
+    ParamBasis<Vector3d> pcaL;                  // L
+    ParamBasis<Vector4d> pcaQuat;               // quat
+    short compressedMode;                       // Blend mode compressed for (-1 = none)
+    int compressedMeshes;                       // Number of blend meshes compressed
+    std::vector<double> compressionError;       // Relative error per blend mesh
+
+    // ========== Shared Rig ==========
+    // Parametrizations in the attached image, one pointer per blend mesh (null
+    // = own list); which lists they stand for depends on the blend mode, as
+    // for the compressed parametrizations. Cleared when the settings change.
+    std::unique_ptr<RigImage> rig;              // Attached rig image (null = none)
+    std::vector<const Matrix3d*> rigRot;        // logR, logGL or GL
+    std::vector<const Matrix3d*> rigScale;      // logS or S
+    std::vector<const Vector3d*> rigL;          // L
+    std::vector<const Vector4d*> rigQuat;       // quat
+
+    // ========== Spatial Weight Masks ==========
+    MatrixXd ptsMask;                           // Per-vertex mask (numPts x numMasked)
+    std::vector<std::vector<double>> tetMask;   // Per-tet mask, one vector per masked mesh
+
+    // ========== Stiffness ==========
+    VectorXd ptsStiffness;                      // Per-vertex stiffness (empty = uniform)
+    std::vector<double> baseTetWeight;          // Uniform or area tet weights before stiffness
+
+    // ========== Posed Base ==========
+    std::vector<Vector3d> basePose;             // Posed base vertices (empty = rest pose)
+    std::vector<Matrix4d> baseDeform;           // Per-tet affine map from the rest to the posed base
+    std::vector<Matrix3d> baseDeformInverse;    // Inverse of its linear part
+
     // ========== Temporary Storage ==========
     std::vector<Matrix4d> Q;                    // Temp tet matrices
     std::vector<double> dummy_weight;           // Temp weights
-    std::vector<double> ptsEnergy;              // Per-vertex energy
+
+    // ========== Iteration Workspaces ==========
+    // State of the ARAP iteration of one blend
+    struct IterationWorkspace {
+        std::vector<Matrix4d> Q;                // Tet matrices of the iterate
+        std::vector<double> tetArea;            // Their weights (unused)
+        std::vector<double> tetEnergy;          // Per-tet energy
+        std::vector<Matrix3d> tetDeform;        // Deformation gradient at the last polar fit
+        int localStepCount;                     // Local steps in the current blend
+        IterationWorkspace() : localStepCount(0) {}
+    };
+    IterationWorkspace iterWork;                // computeBlend()
+    std::vector<IterationWorkspace> batchWork;  // computeBlendModes() and computeBlends(), one per blend
+
+    // ========== Energy Visualization ==========
+    // Vertex -> tet incidence (CSR) with the per-vertex averaging folded into ptsTetScale
+    std::vector<int> ptsTetStart;               // numPts + 1 offsets into ptsTetIdx
+    std::vector<int> ptsTetIdx;                 // Incident tets
+    std::vector<double> ptsTetScale;            // 1 / number of incident elements
 
     // ========== Parameters ==========
     short blendMode;                            // BM_SRL, BM_LOG3, etc.
@@ -142,14 +677,82 @@ private:
     bool rotationConsistency;                   // Enable rotation consistency
     bool areaWeighted;                          // Use area-weighted blending
     double initRotationAngle;                   // Initial rotation (degrees)
+    bool temporalCoherence;                     // Seed rotation logs from the previous frame
+    double temporalJumpAngle;                   // Rotation change (degrees) that triggers the BFS
+    double localStepTolerance;                  // Adaptive local step threshold (0 = off)
+    short fullSweepInterval;                    // Refit all tets every this many local steps
+    std::vector<short> compareModes;            // Modes parametrized besides blendMode (setCompareModes)
+
+    // ========== Local Step Statistics ==========
+    long numRefitted;                           // Polar fits performed in the current blend
+    long numLocalVisited;                       // Tets visited by local steps in the current blend
+    BlendTimings lastTimings;                   // Stage timings of the last blend
 
     // ========== State Flags ==========
     bool needsInitialization;                   // Need to rebuild tet structure
     bool needsParametrization;                  // Need to reparametrize meshes
-    int numParametrized;                        // Number of parametrized meshes
+
+    // ========== Lazy Parametrization ==========
+    enum { PS_PENDING = 0, PS_RUNNING, PS_DONE };
+    std::vector<char> paramState;               // PS_* per blend mesh (guarded by paramMutex)
+    std::mutex paramMutex;
+    std::condition_variable paramDone;          // Signalled when a mesh becomes PS_DONE
+    std::thread paramThread;                    // Background parametrization
+    std::atomic<bool> paramStop;                // Ask paramThread to finish
+
+    // ========== Rebase ==========
+    std::unique_ptr<Laplacian> rebaseSolver;    // ARAP system of the new base, factorized by rebaseThread
+    std::vector<double> rebaseTetWeight;        // baseTetWeight of the new base
+    int rebaseTarget;                           // Blend mesh becoming the base
+    int rebaseError;                            // ARAPprecompute() result of rebaseSolver
+    std::thread rebaseThread;
+    std::atomic<bool> rebaseReady;              // rebaseThread is done
 
     // ========== Internal Methods ==========
 
+    /**
+     * @brief Build the tet structure, mirror maps and tet weights of the base mesh (first part of initialize())
+     */
+    void setupTetStructure();
+
+    /**
+     * @brief Mask, base pose and state after the ARAP system is ready (last part of initialize())
+     */
+    void finishInitialization();
+
+    /**
+     * @brief Own lists blended by the current mode besides L and quat (see compressTargets()); null if unused
+     */
+    void blendedLists(std::vector<std::vector<Matrix3d>>*& rot, std::vector<std::vector<Matrix3d>>*& scale);
+
+    /**
+     * @brief Key of the meshes and settings a rig image depends on
+     */
+    unsigned long long rigKey() const;
+
+    /**
+     * @brief Drop the attached rig image and the solver state that points into it
+     */
+    void detachRig();
+
+    /**
+     * @brief Size the parametrization arrays and states for the current meshes
+     *
+     * Marks every mesh pending when the parametrization settings changed.
+     */
+    void syncParametrizationState();
+
+    /**
+     * @brief Parametrize pending blend meshes
+     * @param weights If given, only meshes with a nonzero weight
+     */
+    void prepareParametrization(const std::vector<double>* weights = nullptr);
+
+    /**
+     * @brief Background thread body of startBackgroundParametrization()
+     */
+    void backgroundParametrization(std::vector<int> order);
+
     /**
      * @brief Parametrize a single blend mesh
      *
@@ -159,29 +762,178 @@ private:
      */
     void parametrizeBlendMesh(int meshIndex);
 
+    /**
+     * @brief Parametrize a blend mesh from its per-tet affine maps (GL and L)
+     * @param meshIndex Index of blend mesh
+     * @param temporal Seed the rotation logs from the previous parametrization
+     */
+    void parametrizeAffine(int meshIndex, bool temporal);
+
+    /**
+     * @brief Stop a rebase in progress and keep the current base
+     */
+    void cancelRebase();
+
+    /**
+     * @brief Blend mesh holding the parametrization used by mesh j (itself unless it is mirrored)
+     */
+    int paramSource(int j) const {
+        return j < (int)mirrorSource.size() && mirrorSource[j] >= 0 ? mirrorSource[j] : j;
+    }
+
+    /**
+     * @brief Check if blend mesh j is the mirror image of blend mesh k
+     */
+    bool isMirrorImage(int j, int k) const;
+
+    /**
+     * @brief Find the mesh a replaced blend mesh mirrors, and the meshes still mirroring it
+     * @param index Index of the replaced blend mesh
+     */
+    void updateMirrorSource(int index);
+
+    /**
+     * @brief Add the blend contribution of mirrored meshes whose source is cached
+     *
+     * Conjugates the source's parametrization on the mirror tet by the reflection.
+     *
+     * @param mode Blend mode
+     * @param weights Per-mesh weights
+     * @param AR, AS, AL, Aq Partial blends (before exp and normalization)
+     */
+    void blendMirrored(short mode,
+                       const std::vector<double>& weights,
+                       std::vector<Matrix3d>& AR,
+                       std::vector<Matrix3d>& AS,
+                       std::vector<Vector3d>& AL,
+                       std::vector<Vector4d>& Aq);
+
+    /**
+     * @brief Pick the blend meshes whose parametrization fits in the memory budget
+     *
+     * Meshes leaving the cache drop their parametrization; meshes entering it
+     * are reparametrized lazily. A blend that uses the compressed
+     * parametrizations caches no mesh.
+     *
+     * @param weights If given, per-mesh weights of the current blend to add to the usage counts
+     *        (none = every mesh is needed)
+     */
+    void updateMeshCache(const std::vector<double>* weights = nullptr);
+
+    /**
+     * @brief Bytes of the full parametrization of one blend mesh in the current blend mode
+     *        (and the compared modes)
+     */
+    size_t meshParametrizationBytes() const;
+
+    /**
+     * @brief Check if the parametrizations hold the lists of a blend mode
+     */
+    bool parametrizesMode(short mode) const;
+
+    /**
+     * @brief Drop the parametrization of a mesh that is not cached
+     *
+     * Keeps the rotation log branch per tet if it is not the principal one
+     * (the whole log of the few tets without a rotation axis).
+     *
+     * @param meshIndex Index of blend mesh
+     */
+    void releaseParametrization(int meshIndex);
+
+    /**
+     * @brief Add the blend contribution of meshes that are not cached
+     *
+     * Recomputes their parametrization from the vertex positions, tile by tile
+     * (for a mirrored mesh, that of its source, reflected onto the mirror tets).
+     * Linear and quaternion terms are added relative to the identity, as the
+     * cached blend already added (1 - sum of cached weights) times the identity.
+     *
+     * @param mode Blend mode
+     * @param weights Per-mesh weights
+     * @param AR, AS, AL, Aq Partial blends (before exp and normalization)
+     */
+    void blendStreamed(short mode,
+                       const std::vector<double>& weights,
+                       std::vector<Matrix3d>& AR,
+                       std::vector<Matrix3d>& AS,
+                       std::vector<Vector3d>& AL,
+                       std::vector<Vector4d>& Aq);
+
     /**
      * @brief Compute rotation consistency for a blend mesh
      *
      * Uses BFS traversal to pick consistent rotation branches.
      *
      * @param meshIndex Index of blend mesh
+     * @param temporal Seed from the current logR (previous frame) and only
+     *        traverse tets whose rotation jumped
+     */
+    void computeRotationConsistency(int meshIndex, bool temporal = false);
+
+    /**
+     * @brief Convert ptsMask to per-tet masks for the current tet structure
      */
-    void computeRotationConsistency(int meshIndex);
+    void updateTetMask();
+
+    /**
+     * @brief Recompute baseDeform and the right-hand side terms of the solver from basePose
+     */
+    void updateBaseDeform();
+
+    /**
+     * @brief Tet weights with the stiffness applied
+     * @param base Tet weights before stiffness (uniform or area)
+     * @param tetWeight Output: base scaled by the per-tet stiffness
+     */
+    void makeStiffTetWeight(const std::vector<double>& base, std::vector<double>& tetWeight) const;
 
     /**
      * @brief Blend parametrized transformations
      *
      * Linearly blends the parametrized components based on weights.
      *
+     * @param mode Blend mode (blendMode, or one of compareModes)
      * @param weights Per-mesh weights
      * @param AR Output: blended rotation/linear part
      * @param AS Output: blended symmetric/scale part
      * @param AL Output: blended translation
+     * @param allowCompressed Use the compressed parametrizations if valid
      */
-    void blendTransformations(const std::vector<double>& weights,
+    void blendTransformations(short mode,
+                             const std::vector<double>& weights,
                              std::vector<Matrix3d>& AR,
                              std::vector<Matrix3d>& AS,
-                             std::vector<Vector3d>& AL);
+                             std::vector<Vector3d>& AL,
+                             bool allowCompressed = true);
+
+    /**
+     * @brief Fitting objective and its gradient with respect to the weights
+     *
+     * @param target Target vertex positions
+     * @param w Weights
+     * @param grad Output: gradient
+     * @return Half the squared vertex distance to the target
+     */
+    double fitObjective(const Mesh::VertexMatrix& target, const VectorXd& w, VectorXd& grad);
+
+    /**
+     * @brief Blend transformations and ARAP iterations of several blends in lockstep
+     *
+     * The rest of computeBlendModes() and computeBlends(), once the meshes
+     * are parametrized. Adds to lastTimings.
+     *
+     * @param modes Blend mode of each blend
+     * @param weights Per-mesh blend weights of each blend
+     * @param outputs Output meshes, one per blend
+     * @param visualizeEnergy If true, compute and store energy values
+     * @param visualizationMultiplier Scaling factor for energy visualization
+     */
+    void iterateBlends(const std::vector<short>& modes,
+                       const std::vector<const std::vector<double>*>& weights,
+                       const std::vector<Mesh*>& outputs,
+                       bool visualizeEnergy,
+                       double visualizationMultiplier);
 
     /**
      * @brief Compute ARAP energy per tet
@@ -189,10 +941,15 @@ private:
      * @param newPts Current vertex positions
      * @param AS Target symmetric part
      * @param AR Output: fitted rotation
-     * @param tetEnergy Output: per-tet energy
+     * @param work Iteration state of the blend; Output: per-tet energy in work.tetEnergy
+     * @param vertexEnergy Output (optional): per-vertex average of the tet energy,
+     *        reduced in the same parallel pass
+     * @param multiplier Scaling factor applied to vertexEnergy
      */
-    void computeEnergy(const std::vector<Vector3d>& newPts,
+    void computeEnergy(const Vector3d* newPts,
                       const std::vector<Matrix3d>& AS,
                       std::vector<Matrix3d>& AR,
-                      std::vector<double>& tetEnergy);
+                      IterationWorkspace& work,
+                      VectorXd* vertexEnergy = nullptr,
+                      double multiplier = 1.0);
 };
@@ -0,0 +1,264 @@
+/**
+ * @file RigImage.cpp
+ * @brief Rig image implementation
+ * @section LICENSE The MIT License
+ * @version 1.0
+ * @date 2026
+ */
+
+#include "RigImage.h"
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RIG_IMAGE_MMAP
+#endif
+
+static const char MAGIC[4] = {'N', 'W', 'R', 'G'};
+static const unsigned int VERSION = 3;
+static const size_t ALIGN = 64;
+
+// Fixed part of the file before the section table
+struct FileHeader {
+    char magic[4];
+    unsigned int version;
+    unsigned long long key;
+    unsigned long long numSections;
+    unsigned long long fileBytes;
+    unsigned long long checksum;        ///< Of the header and the section table
+};
+
+// FNV-1a of the header, with checksum 0, and the section table
+static unsigned long long checksum(FileHeader header, const void* table, size_t tableBytes) {
+    header.checksum = 0;
+    unsigned long long hash = 14695981039346656037ULL;
+    auto add = [&hash](const void* data, size_t bytes) {
+        const unsigned char* p = (const unsigned char*)data;
+        for (size_t i = 0; i < bytes; i++) {
+            hash = (hash ^ p[i]) * 1099511628211ULL;
+        }
+    };
+    add(&header, sizeof(header));
+    add(table, tableBytes);
+    return hash;
+}
+
+static size_t alignUp(size_t offset) {
+    return (offset + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+static long processId() {
+#ifdef RIG_IMAGE_MMAP
+    return (long)getpid();
+#else
+    return 0;
+#endif
+}
+
+RigImage::RigImage()
+    : base(nullptr)
+    , mappedBytes(0)
+    , mapped(false)
+    , key(0) {
+}
+
+RigImage::~RigImage() {
+    detach();
+}
+
+void RigImage::add(unsigned int id, const void* data, size_t bytes) {
+    pending.push_back(Pending{id, data, bytes});
+}
+
+bool RigImage::write(const std::string& path, unsigned long long imageKey) const {
+    FileHeader header;
+    std::memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.key = imageKey;
+    header.numSections = pending.size();
+
+    std::vector<Entry> table(pending.size());
+    size_t offset = alignUp(sizeof(FileHeader) + table.size() * sizeof(Entry));
+    for (size_t s = 0; s < pending.size(); s++) {
+        table[s].id = pending[s].id;
+        table[s].pad = 0;
+        table[s].offset = offset;
+        table[s].bytes = pending[s].bytes;
+        offset = alignUp(offset + pending[s].bytes);
+    }
+
+    header.fileBytes = offset;
+    header.checksum = checksum(header, table.data(), table.size() * sizeof(Entry));
+
+    // A name of this process, so that concurrent writers do not write into
+    // the same file; each rename replaces the image with a whole one
+    std::string temp = path + ".tmp." + std::to_string(processId());
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "RigImage: Cannot write " << temp << std::endl;
+            return false;
+        }
+        const char zeros[ALIGN] = {0};
+        size_t written = 0;
+        auto put = [&](const void* data, size_t bytes) {
+            out.write((const char*)data, bytes);
+            written += bytes;
+        };
+        put(&header, sizeof(header));
+        put(table.data(), table.size() * sizeof(Entry));
+        for (size_t s = 0; s < pending.size(); s++) {
+            put(zeros, table[s].offset - written);
+            put(pending[s].data, pending[s].bytes);
+        }
+        put(zeros, offset - written);
+        out.flush();
+        if (!out) {
+            std::cerr << "RigImage: Write to " << temp << " failed" << std::endl;
+            out.close();
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::cerr << "RigImage: Cannot rename " << temp << " to " << path << std::endl;
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool RigImage::attach(const std::string& path) {
+    detach();
+
+#ifdef RIG_IMAGE_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "RigImage: Cannot open " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(FileHeader)) {
+        close(fd);
+        std::cerr << "RigImage: " << path << " is not a rig image" << std::endl;
+        return false;
+    }
+    void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        std::cerr << "RigImage: Cannot map " << path << std::endl;
+        return false;
+    }
+    base = (const char*)p;
+    mappedBytes = (size_t)st.st_size;
+    mapped = true;
+#else
+    // No shared mapping on this platform: a private copy
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        std::cerr << "RigImage: Cannot open " << path << std::endl;
+        return false;
+    }
+    mappedBytes = (size_t)in.tellg();
+    owned.assign((mappedBytes + sizeof(double) - 1) / sizeof(double), 0.0);
+    in.seekg(0);
+    in.read((char*)owned.data(), mappedBytes);
+    if (!in) {
+        owned.clear();
+        mappedBytes = 0;
+        std::cerr << "RigImage: Cannot read " << path << std::endl;
+        return false;
+    }
+    base = (const char*)owned.data();
+#endif
+
+    // Check the header and table, and that every section lies in the file.
+    // The data is not read: it is paged in when used
+    FileHeader header;
+    bool valid = mappedBytes >= sizeof(FileHeader);
+    if (valid) {
+        std::memcpy(&header, base, sizeof(FileHeader));
+        valid = std::memcmp(header.magic, MAGIC, 4) == 0 && header.version == VERSION &&
+                header.fileBytes == mappedBytes &&
+                header.numSections <= (mappedBytes - sizeof(FileHeader)) / sizeof(Entry);
+    }
+    if (valid) {
+        entries.resize(header.numSections);
+        std::memcpy(entries.data(), base + sizeof(FileHeader), entries.size() * sizeof(Entry));
+        valid = checksum(header, entries.data(), entries.size() * sizeof(Entry)) == header.checksum;
+        for (const Entry& e : entries) {
+            valid = valid && e.offset % ALIGN == 0 && e.offset <= mappedBytes && e.bytes <= mappedBytes - e.offset;
+        }
+    }
+    if (!valid) {
+        std::cerr << "RigImage: " << path << " is not a rig image of this version" << std::endl;
+        detach();
+        return false;
+    }
+    key = header.key;
+    return true;
+}
+
+void RigImage::detach() {
+#ifdef RIG_IMAGE_MMAP
+    if (mapped && base) {
+        munmap((void*)base, mappedBytes);
+    }
+#endif
+    base = nullptr;
+    mappedBytes = 0;
+    mapped = false;
+    owned.clear();
+    key = 0;
+    entries.clear();
+}
+
+RigImage::Lock::Lock(const std::string& path)
+    : fd(-1) {
+#ifdef RIG_IMAGE_MMAP
+    std::string name = path + ".lock";
+    fd = open(name.c_str(), O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        std::cerr << "RigImage: Cannot open lock file " << name << std::endl;
+        return;
+    }
+    int status;
+    while ((status = flock(fd, LOCK_EX)) != 0 && errno == EINTR) {
+    }
+    if (status != 0) {
+        std::cerr << "RigImage: Cannot lock " << name << std::endl;
+        close(fd);
+        fd = -1;
+    }
+#else
+    (void)path;
+#endif
+}
+
+RigImage::Lock::~Lock() {
+#ifdef RIG_IMAGE_MMAP
+    if (fd >= 0) {
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+#endif
+}
+
+const char* RigImage::section(unsigned int id, size_t& bytes) const {
+    for (const Entry& e : entries) {
+        if (e.id == id) {
+            bytes = (size_t)e.bytes;
+            return base + e.offset;
+        }
+    }
+    bytes = 0;
+    return nullptr;
+}
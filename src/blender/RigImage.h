@@ -0,0 +1,121 @@
+/**
+ * @file RigImage.h
+ * @brief Read-only file image of a prepared rig, mapped into memory shared by processes
+ * @section LICENSE The MIT License
+ * @version 1.0
+ * @date 2026
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Numbered binary sections in one file, used in place from a read-only mapping
+ *
+ * The writer collects the sections and writes them with a key of the inputs
+ * they were computed from. Readers map the file read-only and shared, so
+ * every process on a node that attaches the same file uses the same physical
+ * pages of the page cache; a file in /dev/shm is plain shared memory. Attach
+ * costs one mmap: pages are read when first touched.
+ *
+ * Sections start at multiples of 64 bytes. The file is written to a temporary
+ * name of the writing process and renamed, so that a reader never sees a
+ * partial image and processes attached to an older image keep it until they
+ * detach. Attach verifies a checksum of the header and section table only.
+ * Processes that would all prepare the same image take a Lock on its path
+ * first: one writes it while the others wait and then attach.
+ *
+ * Layout: "NWRG", version, key, number of sections, file size, checksum, then
+ * per section its id, offset and size, followed by the data. Native byte order.
+ */
+class RigImage {
+public:
+    RigImage();
+    ~RigImage();
+
+    RigImage(const RigImage&) = delete;
+    RigImage& operator=(const RigImage&) = delete;
+
+    /**
+     * @brief Add a section to write; data must stay valid until write()
+     */
+    void add(unsigned int id, const void* data, size_t bytes);
+
+    /**
+     * @brief Write the added sections
+     * @param path Output file
+     * @param key Key of the inputs, checked by readers
+     * @return true if successful
+     */
+    bool write(const std::string& path, unsigned long long key) const;
+
+    /**
+     * @brief Map an image read-only
+     * @return false if the file cannot be mapped, is not an image of this version or its table fails the checksum
+     */
+    bool attach(const std::string& path);
+
+    /**
+     * @brief Unmap the image; pointers into it become invalid
+     */
+    void detach();
+
+    bool isAttached() const { return base != nullptr; }
+    unsigned long long getKey() const { return key; }
+    size_t size() const { return mappedBytes; }
+
+    /**
+     * @brief Data of a section of the attached image
+     * @param id Section id
+     * @param bytes Output: section size
+     * @return nullptr if there is no such section
+     */
+    const char* section(unsigned int id, size_t& bytes) const;
+
+    /**
+     * @brief Exclusive lock on an image path among processes, held while in scope
+     *
+     * Locks path + ".lock" with flock(), so it is released if the process
+     * dies; the lock file is left in place. Not locked where mmap is
+     * unavailable, as images are not shared there.
+     */
+    class Lock {
+    public:
+        explicit Lock(const std::string& path);
+        ~Lock();
+
+        Lock(const Lock&) = delete;
+        Lock& operator=(const Lock&) = delete;
+
+        bool isLocked() const { return fd >= 0; }
+
+    private:
+        int fd;
+    };
+
+private:
+    struct Entry {
+        unsigned int id;
+        unsigned int pad;
+        unsigned long long offset;
+        unsigned long long bytes;
+    };
+
+    // Writer
+    struct Pending {
+        unsigned int id;
+        const void* data;
+        size_t bytes;
+    };
+    std::vector<Pending> pending;
+
+    // Reader
+    const char* base;                   ///< Start of the mapping
+    size_t mappedBytes;
+    bool mapped;                        ///< base is an mmap, not a copy in owned
+    std::vector<double> owned;          ///< File contents where mmap is unavailable
+    unsigned long long key;
+    std::vector<Entry> entries;
+};
@@ -0,0 +1,332 @@
+/**
+ * @file WeightField.cpp
+ * @brief Per-vertex weight field implementation
+ * @section LICENSE The MIT License
+ * @version 1.0
+ * @date 2026
+ */
+
+#include "WeightField.h"
+#include "distance.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <map>
+
+WeightField::WeightField() {
+}
+
+WeightField::~WeightField() {
+}
+
+void WeightField::setMesh(const std::vector<Eigen::Vector3d>& points, const std::vector<int>& faces) {
+    // The same mesh again keeps the factorized heat systems and solved distances
+    if (points == pts && faces == faceList) {
+        return;
+    }
+    pts = points;
+    faceList = faces;
+    weights.resize(0, 0);
+    distances.resize(0, 0);
+    distanceSources.clear();
+    heat.reset();
+}
+
+void WeightField::setHandles(const std::vector<std::vector<int>>& handleVertices) {
+    handles = handleVertices;
+    weights.resize(0, 0);
+}
+
+void WeightField::setHandlePoints(const std::vector<Eigen::Vector3d>& handlePoints) {
+    Distance dist;
+    dist.findClosestPts(pts, handlePoints);
+
+    handles.assign(handlePoints.size(), std::vector<int>());
+    for (size_t k = 0; k < handlePoints.size(); k++) {
+        handles[k].push_back(dist.closestPts[k]);
+    }
+    weights.resize(0, 0);
+}
+
+void WeightField::setupSystem(Laplacian& lap, bool ghost) const {
+    int numPts = (int)pts.size();
+
+    // Face tets, with degenerate faces removed as in NWayBlender::initialize()
+    std::vector<int> faces = faceList;
+    std::vector<edge> edgeList;
+    std::vector<vertex> vertexList;
+    std::vector<double> area;
+    Tetrise::makeEdgeList(faces, edgeList);
+    Tetrise::makeTetList(TM_FACE, numPts, faces, edgeList, vertexList, lap.tetList);
+    Tetrise::makeTetMatrix(TM_FACE, pts, lap.tetList, faces, edgeList, vertexList, lap.tetMatrix, area);
+    int dim = Tetrise::removeDegenerate(TM_FACE, numPts, lap.tetList, faces, edgeList, vertexList, lap.tetMatrix);
+    Tetrise::makeTetMatrix(TM_FACE, pts, lap.tetList, faces, edgeList, vertexList, lap.tetMatrix, area);
+
+    lap.numTet = (int)lap.tetList.size() / 4;
+    lap.dim = ghost ? dim : numPts;     // the cotan Laplacian does not touch ghost vertices
+    lap.tetWeight.assign(lap.numTet, 1.0);
+
+    // Soft constraints: row c of constraintVal is the indicator of the handle owning vertex c
+    int numConstraints = 0;
+    for (const auto& h : handles) {
+        numConstraints += (int)h.size();
+    }
+    lap.constraintWeight.clear();
+    lap.constraintVal = Eigen::MatrixXd::Zero(numConstraints, handles.size());
+    int c = 0;
+    for (size_t k = 0; k < handles.size(); k++) {
+        for (int v : handles[k]) {
+            lap.constraintWeight.push_back(std::make_pair(v, 1.0));
+            lap.constraintVal(c++, k) = 1.0;
+        }
+    }
+}
+
+bool WeightField::computeHarmonic(short weightMode, short normaliseMode) {
+    if (pts.empty() || faceList.empty() || handles.empty()) {
+        std::cerr << "WeightField::computeHarmonic() - Need a mesh and at least one handle" << std::endl;
+        return false;
+    }
+
+    unsigned long long key = inputKey(weightMode, normaliseMode);
+    if (!cacheFile.empty() && loadCache(cachePath(key), key, weights)) {
+        std::cout << "WeightField: Loaded " << handles.size() << " fields from cache" << std::endl;
+        return true;
+    }
+
+    // One factorization for all handles
+    Laplacian lap;
+    int error;
+    if (weightMode == WM_HARMONIC_COTAN) {
+        setupSystem(lap, false);
+        error = lap.cotanPrecompute();
+    } else {
+        setupSystem(lap, true);
+        lap.computeTetMatrixInverse();
+        error = lap.ARAPprecompute();
+    }
+    if (error > 0) {
+        std::cerr << "WeightField::computeHarmonic() - Factorization failed" << std::endl;
+        return false;
+    }
+
+    // Every handle is one column of the right-hand side
+    lap.harmonicSolve();
+    weights = lap.Sol.topRows(pts.size());
+    normaliseRows(weights, normaliseMode);
+
+    std::cout << "WeightField: Computed " << handles.size()
+              << (weightMode == WM_HARMONIC_COTAN ? " biharmonic" : " harmonic")
+              << " fields on " << pts.size() << " vertices" << std::endl;
+
+    if (!cacheFile.empty()) {
+        saveCache(cachePath(key), key, weights);
+    }
+    return true;
+}
+
+bool WeightField::computeGeodesic() {
+    if (pts.empty() || faceList.empty() || handles.empty()) {
+        std::cerr << "WeightField::computeGeodesic() - Need a mesh and at least one handle" << std::endl;
+        return false;
+    }
+
+    unsigned long long key = inputKey(DM_GEODESIC, NM_NONE);
+    if (!cacheFile.empty() && loadCache(cachePath(key), key, distances)) {
+        distanceSources = handles;
+        std::cout << "WeightField: Loaded " << handles.size() << " distance fields from cache" << std::endl;
+        return true;
+    }
+
+    if (!heat) {
+        heat.reset(new Laplacian);
+        setupSystem(*heat, false);
+        if (heat->heatPrecompute() > 0) {
+            heat.reset();
+            std::cerr << "WeightField::computeGeodesic() - Factorization failed" << std::endl;
+            return false;
+        }
+    }
+
+    // Reuse columns of handles already solved; batch the rest
+    std::map<std::vector<int>, int> solved;
+    for (size_t k = 0; k < distanceSources.size(); k++) {
+        solved[distanceSources[k]] = (int)k;
+    }
+    std::vector<std::vector<int>> newSources;
+    for (const auto& h : handles) {
+        if (!solved.count(h)) {
+            newSources.push_back(h);
+        }
+    }
+    if (!newSources.empty()) {
+        heat->heatGeodesic(newSources);
+    }
+
+    int numPts = (int)pts.size();
+    Eigen::MatrixXd D(numPts, handles.size());
+    int next = 0;
+    for (size_t k = 0; k < handles.size(); k++) {
+        auto it = solved.find(handles[k]);
+        if (it != solved.end()) {
+            D.col(k) = distances.col(it->second);
+        } else {
+            D.col(k) = heat->Sol.col(next++).head(numPts);
+        }
+    }
+    distances = D;
+    distanceSources = handles;
+
+    std::cout << "WeightField: Computed " << newSources.size() << " geodesic fields ("
+              << handles.size() - newSources.size() << " reused) on " << numPts << " vertices" << std::endl;
+
+    if (!cacheFile.empty()) {
+        saveCache(cachePath(key), key, distances);
+    }
+    return true;
+}
+
+bool WeightField::computeDistanceWeights(short distMode, short weightMode, double radius, short normaliseMode) {
+    if (distMode == DM_GEODESIC) {
+        if (!computeGeodesic()) {
+            return false;
+        }
+    } else {
+        if (pts.empty() || handles.empty()) {
+            std::cerr << "WeightField::computeDistanceWeights() - Need a mesh and at least one handle" << std::endl;
+            return false;
+        }
+        // Euclidean distance to the closest vertex of each handle
+        std::vector<Eigen::Vector3d> hdlPts;
+        std::vector<int> owner;
+        for (size_t k = 0; k < handles.size(); k++) {
+            for (int v : handles[k]) {
+                hdlPts.push_back(pts[v]);
+                owner.push_back((int)k);
+            }
+        }
+        // Only distances the weights can use are queried (through the BVH): those
+        // within the radius, or for inverse distance with many handles those of
+        // the nearest handles (the rest contribute little)
+        Distance dist((int)hdlPts.size(), (int)pts.size(), 0);
+        if (weightMode == WM_CUTOFF_DISTANCE) {
+            dist.computeDistPts(pts, hdlPts, radius);
+        } else if ((int)handles.size() > maxDenseHandles) {
+            int ptsPerHandle = (int)((hdlPts.size() + handles.size() - 1) / handles.size());
+            dist.computeDistPtsNearest(pts, hdlPts, nearestHandles * ptsPerHandle);
+        } else {
+            dist.computeDistPts(pts, hdlPts);
+        }
+        distances = Eigen::MatrixXd::Constant(pts.size(), handles.size(), HUGE_VAL);
+        for (size_t j = 0; j < hdlPts.size(); j++) {
+            for (int i = 0; i < (int)pts.size(); i++) {
+                distances(i, owner[j]) = std::min(distances(i, owner[j]), dist.distPts[j][i]);
+            }
+        }
+        distanceSources.clear();    // not geodesic; do not reuse as such
+    }
+
+    weights.resize(distances.rows(), distances.cols());
+    #pragma omp parallel for
+    for (int i = 0; i < (int)distances.rows(); i++) {
+        for (int k = 0; k < (int)distances.cols(); k++) {
+            double d = distances(i, k);
+            if (weightMode == WM_CUTOFF_DISTANCE) {
+                double x = (radius > 0.0) ? d / radius : HUGE_VAL;
+                weights(i, k) = (x < 1.0) ? (1.0 - x * x) * (1.0 - x * x) : 0.0;
+            } else {
+                weights(i, k) = (d < HUGE_VAL) ? 1.0 / (d * d + 1e-10) : 0.0;
+            }
+        }
+    }
+    normaliseRows(weights, normaliseMode);
+    return true;
+}
+
+void WeightField::normaliseRows(Eigen::MatrixXd& w, short normaliseMode) {
+    if (normaliseMode != NM_LINEAR) {
+        return;
+    }
+    #pragma omp parallel for
+    for (int i = 0; i < (int)w.rows(); i++) {
+        w.row(i) = w.row(i).cwiseMax(0.0);
+        double sum = w.row(i).sum();
+        if (sum > 0.0) {
+            w.row(i) /= sum;
+        }
+    }
+}
+
+// FNV-1a over the raw bytes of everything the field depends on
+unsigned long long WeightField::inputKey(short mode, short normaliseMode) const {
+    unsigned long long h = 14695981039346656037ULL;
+    auto mix = [&h](const void* data, size_t size) {
+        const unsigned char* p = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++) {
+            h ^= p[i];
+            h *= 1099511628211ULL;
+        }
+    };
+    mix(&mode, sizeof(mode));
+    mix(&normaliseMode, sizeof(normaliseMode));
+    for (const auto& p : pts) {
+        mix(p.data(), 3 * sizeof(double));
+    }
+    mix(faceList.data(), faceList.size() * sizeof(int));
+    for (const auto& hv : handles) {
+        int n = (int)hv.size();
+        mix(&n, sizeof(n));
+        mix(hv.data(), hv.size() * sizeof(int));
+    }
+    return h;
+}
+
+// One file per key, so that fields of different modes or handles do not
+// replace each other
+std::string WeightField::cachePath(unsigned long long key) const {
+    char suffix[20];
+    std::snprintf(suffix, sizeof(suffix), ".%016llx", key);
+    return cacheFile + suffix;
+}
+
+bool WeightField::saveCache(const std::string& path, unsigned long long key, const Eigen::MatrixXd& data) const {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "WeightField: Cannot write cache " << path << std::endl;
+        return false;
+    }
+    long long rows = data.rows(), cols = data.cols();
+    out.write("NWWF", 4);
+    out.write((const char*)&key, sizeof(key));
+    out.write((const char*)&rows, sizeof(rows));
+    out.write((const char*)&cols, sizeof(cols));
+    out.write((const char*)data.data(), rows * cols * sizeof(double));
+    return (bool)out;
+}
+
+bool WeightField::loadCache(const std::string& path, unsigned long long key, Eigen::MatrixXd& data) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    char magic[4];
+    unsigned long long storedKey;
+    long long rows, cols;
+    in.read(magic, 4);
+    in.read((char*)&storedKey, sizeof(storedKey));
+    in.read((char*)&rows, sizeof(rows));
+    in.read((char*)&cols, sizeof(cols));
+    if (!in || std::memcmp(magic, "NWWF", 4) != 0 || storedKey != key ||
+        rows != (long long)pts.size() || cols != (long long)handles.size()) {
+        return false;
+    }
+    Eigen::MatrixXd loaded(rows, cols);
+    in.read((char*)loaded.data(), rows * cols * sizeof(double));
+    if (!in) {
+        return false;
+    }
+    data = loaded;
+    return true;
+}
@@ -0,0 +1,159 @@
+/**
+ * @file WeightField.h
+ * @brief Per-vertex weight fields (harmonic / biharmonic / distance falloff) for spatially varying blends
+ * @section LICENSE The MIT License
+ * @version 1.0
+ * @date 2026
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "tetrise.h"
+#include "laplacian.h"
+#include "deformerConst.h"
+
+/**
+ * @brief Smooth per-vertex weight fields generated from handles on the mesh
+ *
+ * Each handle is a set of mesh vertices. The field of handle k is 1 on its own
+ * vertices and 0 on those of the other handles, and is interpolated smoothly in
+ * between. The system is factorized once and all handles are solved together as
+ * one multi-column right-hand side. Results can be cached on disk so that the same
+ * mesh and handles are not solved again.
+ *
+ * Distance falloff weights can use geodesic distances from the heat method. The
+ * heat and Poisson systems are factorized once per mesh, and every handle that has
+ * not been seen before costs two more solves.
+ *
+ * Result: weights(i, k) = weight of handle k at vertex i
+ */
+class WeightField {
+public:
+    static const int maxDenseHandles = 32;      ///< Euclidean inverse distance to every handle up to this many
+    static const int nearestHandles = 8;        ///< Handles weighted per vertex beyond that
+
+    WeightField();
+    ~WeightField();
+
+    /**
+     * @brief Set the surface the field lives on
+     *
+     * Setting the current mesh again keeps the factorized heat systems and the
+     * geodesic distances already solved on it.
+     *
+     * @param pts Vertex positions
+     * @param faceList Flattened triangle indices
+     */
+    void setMesh(const std::vector<Eigen::Vector3d>& pts, const std::vector<int>& faceList);
+
+    /**
+     * @brief Set handles as vertex sets
+     * @param handleVertices handleVertices[k] = vertices constrained to handle k
+     */
+    void setHandles(const std::vector<std::vector<int>>& handleVertices);
+
+    /**
+     * @brief Set handles as points; each is snapped to its closest vertex
+     * @param handlePoints 3D handle positions
+     */
+    void setHandlePoints(const std::vector<Eigen::Vector3d>& handlePoints);
+
+    /**
+     * @brief Set the path used to cache computed fields (empty disables caching)
+     *
+     * Each field is stored in its own file, the path followed by the hex key of
+     * its inputs, so harmonic weights and geodesic distances are cached side by side.
+     */
+    void setCacheFile(const std::string& path) { cacheFile = path; }
+
+    /**
+     * @brief Compute harmonic or biharmonic weights for all handles
+     *
+     * WM_HARMONIC_ARAP uses the ARAP (tet) Laplacian and gives harmonic weights;
+     * WM_HARMONIC_COTAN uses the squared cotan Laplacian and gives biharmonic weights.
+     *
+     * @param weightMode WM_HARMONIC_ARAP or WM_HARMONIC_COTAN
+     * @param normaliseMode NM_NONE or NM_LINEAR (clamp negatives and normalise per vertex)
+     * @return true if successful
+     */
+    bool computeHarmonic(short weightMode = WM_HARMONIC_ARAP, short normaliseMode = NM_LINEAR);
+
+    /**
+     * @brief Compute geodesic distances from every handle with the heat method
+     *
+     * Distances to handles solved earlier on the same mesh are reused, and new
+     * handles are solved together as one batch.
+     *
+     * @return true if successful
+     */
+    bool computeGeodesic();
+
+    /**
+     * @brief Compute weights that fall off with the distance to each handle
+     * @param distMode DM_EUCLIDEAN or DM_GEODESIC
+     * @param weightMode WM_INV_DISTANCE (1/d^2) or WM_CUTOFF_DISTANCE (smooth falloff to 0 at radius).
+     *        With more than maxDenseHandles Euclidean handles, inverse distance
+     *        only weights about the nearestHandles closest handles of each vertex
+     * @param radius Effect radius for WM_CUTOFF_DISTANCE
+     * @param normaliseMode NM_NONE or NM_LINEAR
+     * @return true if successful
+     */
+    bool computeDistanceWeights(short distMode, short weightMode, double radius, short normaliseMode = NM_LINEAR);
+
+    /**
+     * @brief Get the last computed distances (numPts x numHandles, HUGE_VAL if unreachable)
+     */
+    const Eigen::MatrixXd& getDistances() const { return distances; }
+
+    /**
+     * @brief Get the last computed field (numPts x numHandles)
+     */
+    const Eigen::MatrixXd& getWeights() const { return weights; }
+
+    /**
+     * @brief Get handle vertex sets
+     */
+    const std::vector<std::vector<int>>& getHandles() const { return handles; }
+
+    int numHandles() const { return (int)handles.size(); }
+
+    /**
+     * @brief Save/load a numPts x numHandles matrix together with a key identifying mesh, handles and mode
+     */
+    bool saveCache(const std::string& path, unsigned long long key, const Eigen::MatrixXd& data) const;
+    bool loadCache(const std::string& path, unsigned long long key, Eigen::MatrixXd& data);
+
+private:
+    std::vector<Eigen::Vector3d> pts;           ///< Vertex positions
+    std::vector<int> faceList;                  ///< Triangles
+    std::vector<std::vector<int>> handles;      ///< Handle vertex sets
+    Eigen::MatrixXd weights;                    ///< numPts x numHandles
+    Eigen::MatrixXd distances;                  ///< numPts x numHandles
+    std::vector<std::vector<int>> distanceSources;  ///< Handles the columns of distances belong to
+    std::unique_ptr<Laplacian> heat;            ///< Prefactorized heat method systems (reset with the mesh)
+    std::string cacheFile;                      ///< Disk cache (empty = off)
+
+    /**
+     * @brief Hash of the inputs that determine a field
+     */
+    unsigned long long inputKey(short mode, short normaliseMode) const;
+
+    /**
+     * @brief Cache file of the field with a key
+     */
+    std::string cachePath(unsigned long long key) const;
+
+    /**
+     * @brief Set up face tets and soft constraints on a Laplacian
+     */
+    void setupSystem(Laplacian& lap, bool ghost) const;
+
+    /**
+     * @brief Clamp and normalise each row
+     */
+    static void normaliseRows(Eigen::MatrixXd& w, short normaliseMode);
+};
@@ -330,6 +330,20 @@ namespace AffineLib{
         return (ans+ans.transpose())/2;
     }
     
+    inline Matrix3d expFrechet(const Matrix3d& m, const Matrix3d& e)
+    /** Frechet derivative of exp at m in the direction e, read off from exp of a 6x6 block matrix
+     * Since <Y, expFrechet(m,e)> = <expFrechet(m^T,Y), e>, it also gives the gradient of a function of exp(m)
+     * @param m 3x3 matrix
+     * @param e 3x3 direction
+     * @return d/dt exp(m+te) at t=0
+     */
+    {
+        Matrix<double,6,6> B;
+        B << m, e,
+        Matrix3d::Zero(), m;
+        return B.exp().block(0,3,3,3);
+    }
+    
     
     inline Matrix3d logSym(const Matrix3d& m, Vector3d& lambda)
     /** log for a positive definite symmetric matrix by spectral decomposition
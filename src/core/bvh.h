@@ -0,0 +1,297 @@
+/**
+ * @file bvh.h
+ * @brief bounding volume hierarchy for closest element queries
+ * @section LICENSE The MIT License
+ * @section requirements:  Eigen library
+ * @version 0.10
+ * @date  Oct. 2026
+ */
+
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Dense>
+
+using namespace Eigen;
+
+// primitive types stored in the tree
+#define BVH_POINT 1
+#define BVH_SEGMENT 2
+#define BVH_TRIANGLE 3
+
+class BVH {
+public:
+    // node of the hierarchy; leaves point into primIndex[start..start+count)
+    struct Node {
+        Vector3d lo, hi;
+        int left, right;      // child nodes (-1 for leaves)
+        int start, count;
+    };
+    std::vector<Node> nodes;
+    std::vector<int> primIndex;    // primitive order after partitioning
+    std::vector<Vector3d> vert;    // primitive corners (primType per primitive)
+    short primType;
+    int numPrim;
+    int leafSize;
+    BVH(): primType(BVH_POINT), numPrim(0), leafSize(4) {};
+    void buildPoints(const std::vector<Vector3d>& pts);
+    void buildSegments(const std::vector<Vector3d>& pts, const std::vector<int>& list, int stride=2);
+    void buildTriangles(const std::vector<Vector3d>& pts, const std::vector<int>& list, int stride=3);
+    bool empty() const { return numPrim == 0; }
+    double distPrim(int i, const Vector3d& p) const;
+    int closest(const Vector3d& p, double& dist, double maxDist=HUGE_VAL) const;
+    void kNearest(const Vector3d& p, int k, std::vector<int>& idx, std::vector<double>& dist) const;
+    void withinRadius(const Vector3d& p, double r, std::vector<int>& idx, std::vector<double>& dist) const;
+    void closestBatch(const std::vector<Vector3d>& q, std::vector<int>& idx, std::vector<double>& dist) const;
+    static double distPtSegment(const Vector3d& p, const Vector3d& a, const Vector3d& b);
+    static double distPtTriangle(const Vector3d& p, const Vector3d& a, const Vector3d& b, const Vector3d& c);
+private:
+    void build();
+    int buildNode(int start, int count, const std::vector<Vector3d>& centre);
+    double boxDist2(const Node& n, const Vector3d& p) const {
+        return (p.cwiseMax(n.lo).cwiseMin(n.hi) - p).squaredNorm();
+    }
+};
+
+// tree over isolated points
+inline void BVH::buildPoints(const std::vector<Vector3d>& pts){
+    primType = BVH_POINT;
+    vert = pts;
+    numPrim = (int)pts.size();
+    build();
+}
+
+// tree over segments given by index pairs (stride allows reading pairs out of a tetList)
+inline void BVH::buildSegments(const std::vector<Vector3d>& pts, const std::vector<int>& list, int stride){
+    primType = BVH_SEGMENT;
+    numPrim = (int)list.size()/stride;
+    vert.resize(2*numPrim);
+    for(int i=0;i<numPrim;i++){
+        vert[2*i] = pts[list[stride*i]];
+        vert[2*i+1] = pts[list[stride*i+1]];
+    }
+    build();
+}
+
+// tree over triangles given by index triples (stride=4 reads the faces of a tetList)
+inline void BVH::buildTriangles(const std::vector<Vector3d>& pts, const std::vector<int>& list, int stride){
+    primType = BVH_TRIANGLE;
+    numPrim = (int)list.size()/stride;
+    vert.resize(3*numPrim);
+    for(int i=0;i<numPrim;i++){
+        for(int k=0;k<3;k++){
+            vert[3*i+k] = pts[list[stride*i+k]];
+        }
+    }
+    build();
+}
+
+inline void BVH::build(){
+    nodes.clear();
+    primIndex.resize(numPrim);
+    if(numPrim == 0) return;
+    std::vector<Vector3d> centre(numPrim);
+    for(int i=0;i<numPrim;i++){
+        primIndex[i] = i;
+        centre[i] = Vector3d::Zero();
+        for(int k=0;k<primType;k++){
+            centre[i] += vert[primType*i+k];
+        }
+        centre[i] /= primType;
+    }
+    nodes.reserve(2*numPrim/leafSize+1);
+    buildNode(0, numPrim, centre);
+}
+
+// median split along the longest axis of the centroid bounds
+inline int BVH::buildNode(int start, int count, const std::vector<Vector3d>& centre){
+    Vector3d lo = Vector3d::Constant(HUGE_VAL), hi = Vector3d::Constant(-HUGE_VAL);
+    Vector3d clo = lo, chi = hi;
+    for(int i=start;i<start+count;i++){
+        int p = primIndex[i];
+        for(int k=0;k<primType;k++){
+            lo = lo.cwiseMin(vert[primType*p+k]);
+            hi = hi.cwiseMax(vert[primType*p+k]);
+        }
+        clo = clo.cwiseMin(centre[p]);
+        chi = chi.cwiseMax(centre[p]);
+    }
+    int id = (int)nodes.size();
+    Node node = {lo, hi, -1, -1, start, count};
+    nodes.push_back(node);
+    if(count <= leafSize) return id;
+    int axis;
+    (chi-clo).maxCoeff(&axis);
+    int mid = start + count/2;
+    std::nth_element(primIndex.begin()+start, primIndex.begin()+mid, primIndex.begin()+start+count,
+                     [&](int a, int b){ return centre[a][axis] < centre[b][axis]; });
+    int left = buildNode(start, mid-start, centre);
+    int right = buildNode(mid, start+count-mid, centre);
+    nodes[id].left = left;
+    nodes[id].right = right;
+    return id;
+}
+
+// unsigned distance between p and the i-th primitive
+inline double BVH::distPrim(int i, const Vector3d& p) const{
+    switch(primType){
+        case BVH_POINT:
+            return (vert[i]-p).norm();
+        case BVH_SEGMENT:
+            return distPtSegment(p, vert[2*i], vert[2*i+1]);
+        default:
+            return distPtTriangle(p, vert[3*i], vert[3*i+1], vert[3*i+2]);
+    }
+}
+
+// closest primitive to p; returns -1 if nothing lies within maxDist
+inline int BVH::closest(const Vector3d& p, double& dist, double maxDist) const{
+    int best = -1;
+    dist = maxDist;
+    if(nodes.empty()) return best;
+    std::vector<int> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    while(!stack.empty()){
+        const Node& n = nodes[stack.back()];
+        stack.pop_back();
+        if(boxDist2(n, p) >= dist*dist) continue;
+        if(n.left < 0){
+            for(int i=n.start;i<n.start+n.count;i++){
+                double d = distPrim(primIndex[i], p);
+                if(d < dist){
+                    dist = d;
+                    best = primIndex[i];
+                }
+            }
+        }else{
+            // visit the nearer child first
+            double dl = boxDist2(nodes[n.left], p);
+            double dr = boxDist2(nodes[n.right], p);
+            if(dl < dr){
+                stack.push_back(n.right);
+                stack.push_back(n.left);
+            }else{
+                stack.push_back(n.left);
+                stack.push_back(n.right);
+            }
+        }
+    }
+    return best;
+}
+
+// k nearest primitives to p, sorted by distance
+inline void BVH::kNearest(const Vector3d& p, int k, std::vector<int>& idx, std::vector<double>& dist) const{
+    idx.clear();
+    dist.clear();
+    if(nodes.empty() || k <= 0) return;
+    std::priority_queue< std::pair<double,int> > heap;    // max-heap of the current k best
+    std::vector<int> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    while(!stack.empty()){
+        const Node& n = nodes[stack.back()];
+        stack.pop_back();
+        if((int)heap.size() == k && boxDist2(n, p) >= heap.top().first*heap.top().first) continue;
+        if(n.left < 0){
+            for(int i=n.start;i<n.start+n.count;i++){
+                double d = distPrim(primIndex[i], p);
+                if((int)heap.size() < k){
+                    heap.push(std::make_pair(d, primIndex[i]));
+                }else if(d < heap.top().first){
+                    heap.pop();
+                    heap.push(std::make_pair(d, primIndex[i]));
+                }
+            }
+        }else{
+            double dl = boxDist2(nodes[n.left], p);
+            double dr = boxDist2(nodes[n.right], p);
+            if(dl < dr){
+                stack.push_back(n.right);
+                stack.push_back(n.left);
+            }else{
+                stack.push_back(n.left);
+                stack.push_back(n.right);
+            }
+        }
+    }
+    int m = (int)heap.size();
+    idx.resize(m);
+    dist.resize(m);
+    for(int i=m-1;i>=0;i--){
+        dist[i] = heap.top().first;
+        idx[i] = heap.top().second;
+        heap.pop();
+    }
+}
+
+// all primitives within distance r of p (unordered)
+inline void BVH::withinRadius(const Vector3d& p, double r, std::vector<int>& idx, std::vector<double>& dist) const{
+    idx.clear();
+    dist.clear();
+    if(nodes.empty()) return;
+    std::vector<int> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    while(!stack.empty()){
+        const Node& n = nodes[stack.back()];
+        stack.pop_back();
+        if(boxDist2(n, p) > r*r) continue;
+        if(n.left < 0){
+            for(int i=n.start;i<n.start+n.count;i++){
+                double d = distPrim(primIndex[i], p);
+                if(d <= r){
+                    idx.push_back(primIndex[i]);
+                    dist.push_back(d);
+                }
+            }
+        }else{
+            stack.push_back(n.left);
+            stack.push_back(n.right);
+        }
+    }
+}
+
+// closest primitive for a batch of query points
+inline void BVH::closestBatch(const std::vector<Vector3d>& q, std::vector<int>& idx, std::vector<double>& dist) const{
+    int numQuery = (int)q.size();
+    idx.resize(numQuery);
+    dist.resize(numQuery);
+#pragma omp parallel for schedule(dynamic, 64)
+    for(int i=0;i<numQuery;i++){
+        idx[i] = closest(q[i], dist[i]);
+    }
+}
+
+inline double BVH::distPtSegment(const Vector3d& p, const Vector3d& a, const Vector3d& b){
+    Vector3d ab = b-a;
+    double l = ab.squaredNorm();
+    if(l == 0.0) return (p-a).norm();
+    double t = std::max(0.0, std::min(1.0, (p-a).dot(ab)/l));
+    return (a + t*ab - p).norm();
+}
+
+// closest point on a triangle by Voronoi region classification
+inline double BVH::distPtTriangle(const Vector3d& p, const Vector3d& a, const Vector3d& b, const Vector3d& c){
+    Vector3d ab = b-a, ac = c-a, ap = p-a;
+    double d1 = ab.dot(ap), d2 = ac.dot(ap);
+    if(d1 <= 0 && d2 <= 0) return ap.norm();
+    Vector3d bp = p-b;
+    double d3 = ab.dot(bp), d4 = ac.dot(bp);
+    if(d3 >= 0 && d4 <= d3) return bp.norm();
+    double vc = d1*d4 - d3*d2;
+    if(vc <= 0 && d1 >= 0 && d3 <= 0) return (a + d1/(d1-d3)*ab - p).norm();
+    Vector3d cp = p-c;
+    double d5 = ab.dot(cp), d6 = ac.dot(cp);
+    if(d6 >= 0 && d5 <= d6) return cp.norm();
+    double vb = d5*d2 - d1*d6;
+    if(vb <= 0 && d2 >= 0 && d6 <= 0) return (a + d2/(d2-d6)*ac - p).norm();
+    double va = d3*d6 - d5*d4;
+    if(va <= 0 && (d4-d3) >= 0 && (d5-d6) >= 0) return (b + (d4-d3)/((d4-d3)+(d5-d6))*(c-b) - p).norm();
+    double denom = va+vb+vc;
+    if(denom == 0.0) return std::min(ap.norm(), std::min(bp.norm(), cp.norm()));
+    return (a + (vb/denom)*ab + (vc/denom)*ac - p).norm();
+}
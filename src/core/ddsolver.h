@@ -0,0 +1,306 @@
+/**
+ * @file ddsolver.h
+ * @brief domain decomposition solver for large sparse SPD systems
+ * @section LICENSE The MIT License
+ * @section requirements:  Eigen library
+ * @version 0.10
+ * @date  Oct. 2026
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Sparse>
+
+using namespace Eigen;
+
+// The unknowns are split into numDomains subdomains by recursive graph bisection.
+// A vertex adjacent to a subdomain with a larger index goes to the interface, so that
+// the interiors are decoupled and are factorised and solved independently in parallel.
+// The interface system (Schur complement) is assembled from the subdomains in parallel and
+// factorised; separators of surface meshes are small, so a solve costs two interior solves
+// per subdomain plus a small interface solve, and gives the same result as a direct solve.
+// Solver is the direct solver used for the subdomain interiors and the interface.
+template<typename Solver>
+class DDSolver {
+public:
+    typedef SparseMatrix<double> Mat;
+    int numDomains;
+    std::vector<int> part;  // subdomain of each unknown
+    DDSolver(): numDomains(1), dim(0), status(Success), interfaceAnalyzed(false) {};
+    int analyzePattern(const Mat& A);
+    int factorize(const Mat& A);
+    ComputationInfo info() const { return status; }
+    MatrixXd solve(const MatrixXd& B);
+    int numInterface() const { return (int)gamma.size(); }
+    static void partition(const std::vector<int>& adjStart, const std::vector<int>& adj, int K, std::vector<int>& part);
+private:
+    int dim;
+    ComputationInfo status;
+    std::vector<int> owner, loc;             // subdomain (-1 = interface) and local index of each unknown
+    std::vector< std::vector<int> > interior, border;   // unknowns of each interior, interface unknowns each touches
+    std::vector<int> gamma;                  // interface unknowns
+    std::vector<Mat> Aii, Aig;               // interior block and its coupling to the border (local border columns)
+    std::vector<Solver> sub;
+    Mat Agg;
+    Mat S;                                   // Schur complement on the interface
+    Solver interfaceSolver;
+    bool interfaceAnalyzed;                  // the pattern of S is fixed by the partition
+    void extract(const Mat& A);
+};
+
+// split vertices of the graph into K parts of nearly equal size
+// each part is halved along the BFS order from a pseudo-peripheral vertex, which keeps the cut small for meshes
+template<typename Solver>
+inline void DDSolver<Solver>::partition(const std::vector<int>& adjStart, const std::vector<int>& adj, int K, std::vector<int>& part){
+    int n = (int)adjStart.size()-1;
+    part.assign(n, 0);
+    std::vector<int> mark(n, -1), order, queue;
+    order.reserve(n);
+    queue.reserve(n);
+    // (first part index, number of parts, vertices)
+    struct Job { int first, count; std::vector<int> verts; };
+    std::vector<Job> jobs(1);
+    jobs[0].first = 0;
+    jobs[0].count = K;
+    jobs[0].verts.resize(n);
+    for(int i=0;i<n;i++) jobs[0].verts[i]=i;
+    int stamp = 0;
+    while(!jobs.empty()){
+        Job job = std::move(jobs.back());
+        jobs.pop_back();
+        if(job.count <= 1 || job.verts.size() <= 1){
+            for(int v: job.verts) part[v] = job.first;
+            continue;
+        }
+        // BFS restricted to the job; returns the last vertex reached
+        auto bfs = [&](int s, int tag){
+            queue.clear();
+            queue.push_back(s);
+            mark[s] = tag;
+            for(size_t q=0;q<queue.size();q++){
+                int v = queue[q];
+                for(int e=adjStart[v];e<adjStart[v+1];e++){
+                    int u = adj[e];
+                    if(mark[u] == tag-1){
+                        mark[u] = tag;
+                        queue.push_back(u);
+                    }
+                }
+            }
+            return queue.back();
+        };
+        // label the job's vertices so that the BFS stays inside
+        stamp += 3;
+        for(int v: job.verts) mark[v] = stamp;
+        order.clear();
+        for(int v: job.verts){
+            if(mark[v] != stamp) continue;
+            // component of v: two sweeps find a pseudo-peripheral start, the third gives the order
+            int far = bfs(v, stamp+1);
+            for(int u: queue) mark[u] = stamp;
+            far = bfs(far, stamp+1);
+            for(int u: queue) mark[u] = stamp;
+            bfs(far, stamp+1);
+            order.insert(order.end(), queue.begin(), queue.end());
+            for(int u: queue) mark[u] = stamp+2;
+        }
+        int K1 = job.count/2;
+        size_t cut = (size_t)((double)order.size()*K1/job.count);
+        Job a, b;
+        a.first = job.first;
+        a.count = K1;
+        a.verts.assign(order.begin(), order.begin()+cut);
+        b.first = job.first+K1;
+        b.count = job.count-K1;
+        b.verts.assign(order.begin()+cut, order.end());
+        jobs.push_back(std::move(a));
+        jobs.push_back(std::move(b));
+    }
+}
+
+// partition the unknowns from the sparsity pattern of A (symmetric)
+template<typename Solver>
+inline int DDSolver<Solver>::analyzePattern(const Mat& A){
+    dim = (int)A.rows();
+    std::vector<int> adjStart(dim+1, 0), adj;
+    adj.reserve(A.nonZeros());
+    for(int j=0;j<dim;j++){
+        for(Mat::InnerIterator it(A,j); it; ++it){
+            if(it.row() != j) adj.push_back((int)it.row());
+        }
+        adjStart[j+1] = (int)adj.size();
+    }
+    int K = std::max(1, std::min(numDomains, dim));
+    partition(adjStart, adj, K, part);
+    // interface: unknowns adjacent to a subdomain with a larger index
+    owner.resize(dim);
+    loc.resize(dim);
+    interior.assign(K, std::vector<int>());
+    gamma.clear();
+    for(int v=0;v<dim;v++){
+        bool shared = false;
+        for(int e=adjStart[v];e<adjStart[v+1] && !shared;e++){
+            shared = part[adj[e]] > part[v];
+        }
+        if(shared){
+            owner[v] = -1;
+            loc[v] = (int)gamma.size();
+            gamma.push_back(v);
+        }else{
+            owner[v] = part[v];
+            loc[v] = (int)interior[part[v]].size();
+            interior[part[v]].push_back(v);
+        }
+    }
+    // interface unknowns touched by each interior
+    border.assign(K, std::vector<int>());
+    std::vector<int> seen(gamma.size(), -1);
+    for(int k=0;k<K;k++){
+        for(int v: interior[k]){
+            for(int e=adjStart[v];e<adjStart[v+1];e++){
+                int u = adj[e];
+                if(owner[u] < 0 && seen[loc[u]] != k){
+                    seen[loc[u]] = k;
+                    border[k].push_back(loc[u]);
+                }
+            }
+        }
+        std::sort(border[k].begin(), border[k].end());
+    }
+    std::vector<Solver>(K).swap(sub);
+    extract(A);
+    status = Success;
+#pragma omp parallel for schedule(dynamic)
+    for(int k=0;k<K;k++){
+        sub[k].analyzePattern(Aii[k]);
+    }
+    interfaceAnalyzed = false;
+    return factorize(A);
+}
+
+// split A into the interior, coupling and interface blocks
+template<typename Solver>
+inline void DDSolver<Solver>::extract(const Mat& A){
+    int K = (int)interior.size();
+    Aii.resize(K);
+    Aig.resize(K);
+#pragma omp parallel for schedule(dynamic)
+    for(int k=0;k<K;k++){
+        std::vector<int> borderLoc(gamma.size(), -1);
+        for(size_t b=0;b<border[k].size();b++) borderLoc[border[k][b]] = (int)b;
+        std::vector< Triplet<double> > tii, tig;
+        for(size_t c=0;c<interior[k].size();c++){
+            int v = interior[k][c];
+            for(Mat::InnerIterator it(A,v); it; ++it){
+                int u = (int)it.row();
+                if(owner[u] == k){
+                    tii.push_back(Triplet<double>(loc[u], (int)c, it.value()));
+                }else{
+                    tig.push_back(Triplet<double>((int)c, borderLoc[loc[u]], it.value()));
+                }
+            }
+        }
+        Aii[k].resize(interior[k].size(), interior[k].size());
+        Aii[k].setFromTriplets(tii.begin(), tii.end());
+        Aig[k].resize(interior[k].size(), border[k].size());
+        Aig[k].setFromTriplets(tig.begin(), tig.end());
+    }
+    std::vector< Triplet<double> > tgg;
+    for(size_t c=0;c<gamma.size();c++){
+        for(Mat::InnerIterator it(A,gamma[c]); it; ++it){
+            if(owner[it.row()] < 0) tgg.push_back(Triplet<double>(loc[it.row()], (int)c, it.value()));
+        }
+    }
+    Agg.resize(gamma.size(), gamma.size());
+    Agg.setFromTriplets(tgg.begin(), tgg.end());
+}
+
+// numeric factorisation of the subdomains and of the Schur complement
+// S = Agg - sum_k Aig_k^T Aii_k^{-1} Aig_k, whose blocks are computed in parallel
+template<typename Solver>
+inline int DDSolver<Solver>::factorize(const Mat& A){
+    extract(A);
+    int K = (int)sub.size();
+    int failed = 0;
+    std::vector< std::vector< Triplet<double> > > ts(K);
+#pragma omp parallel for schedule(dynamic) reduction(+:failed)
+    for(int k=0;k<K;k++){
+        sub[k].factorize(Aii[k]);
+        if(sub[k].info() != Success){
+            failed++;
+            continue;
+        }
+        int nb = (int)border[k].size();
+        // a few columns at a time, so that the interior solutions stay small
+        const int blockSize = 64;
+        ts[k].reserve((size_t)nb*nb);
+        for(int c0=0;c0<nb;c0+=blockSize){
+            int width = std::min(blockSize, nb-c0);
+            MatrixXd Z = sub[k].solve(MatrixXd(Aig[k].middleCols(c0, width)));
+            MatrixXd Sk = Aig[k].transpose()*Z;
+            for(int c=0;c<width;c++){
+                for(int r=0;r<nb;r++){
+                    ts[k].push_back(Triplet<double>(border[k][r], border[k][c0+c], -Sk(r,c)));
+                }
+            }
+        }
+    }
+    if(!gamma.empty() && !failed){
+        std::vector< Triplet<double> > t;
+        for(int k=0;k<K;k++){
+            t.insert(t.end(), ts[k].begin(), ts[k].end());
+            std::vector< Triplet<double> >().swap(ts[k]);
+        }
+        S.resize(gamma.size(), gamma.size());
+        S.setFromTriplets(t.begin(), t.end());
+        S += Agg;
+        if(!interfaceAnalyzed){
+            interfaceSolver.analyzePattern(S);
+            interfaceAnalyzed = true;
+        }
+        interfaceSolver.factorize(S);
+        if(interfaceSolver.info() != Success) failed++;
+    }
+    status = failed ? NumericalIssue : Success;
+    return failed ? 1 : 0;
+}
+
+template<typename Solver>
+inline MatrixXd DDSolver<Solver>::solve(const MatrixXd& B){
+    int K = (int)sub.size();
+    int m = (int)B.cols();
+    int ng = (int)gamma.size();
+    MatrixXd X(dim, m);
+    // interior solves with the interface fixed at zero, and the reduced right-hand side
+    std::vector<MatrixXd> Y(K), contrib(K);
+#pragma omp parallel for schedule(dynamic)
+    for(int k=0;k<K;k++){
+        MatrixXd Bk(interior[k].size(), m);
+        for(size_t c=0;c<interior[k].size();c++) Bk.row(c) = B.row(interior[k][c]);
+        Y[k] = sub[k].solve(Bk);
+        contrib[k] = Aig[k].transpose()*Y[k];
+    }
+    MatrixXd G(ng, m);
+    for(int c=0;c<ng;c++) G.row(c) = B.row(gamma[c]);
+    for(int k=0;k<K;k++){
+        for(size_t b=0;b<border[k].size();b++) G.row(border[k][b]) -= contrib[k].row(b);
+    }
+    MatrixXd Xg = (ng > 0) ? MatrixXd(interfaceSolver.solve(G)) : G;
+    for(int c=0;c<ng;c++) X.row(gamma[c]) = Xg.row(c);
+    // back-substitute the interface into the interiors
+#pragma omp parallel for schedule(dynamic)
+    for(int k=0;k<K;k++){
+        MatrixXd Xi = Y[k];
+        if(!border[k].empty()){
+            MatrixXd Xk(border[k].size(), m);
+            for(size_t b=0;b<border[k].size();b++) Xk.row(b) = Xg.row(border[k][b]);
+            Xi -= sub[k].solve(Aig[k]*Xk);
+        }
+        for(size_t c=0;c<interior[k].size();c++) X.row(interior[k][c]) = Xi.row(c);
+    }
+    return X;
+}
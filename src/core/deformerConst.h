@@ -31,6 +31,10 @@
 #define WM_HARMONIC_COTAN 17
 #define WM_HARMONIC_TRANS 18
 
+// distance mode
+#define DM_EUCLIDEAN 0
+#define DM_GEODESIC 1
+
 // tetrahedra construction mode
 #define TM_FACE 0
 #define TM_EDGE 1
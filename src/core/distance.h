@@ -2,9 +2,15 @@
 
 #include <utility>
 #include <vector>
+#include <numeric>
+#include <cmath>
+#include <algorithm>
 #include <Eigen/Core>
+#include <Eigen/Sparse>
 
 #include "deformerConst.h"
+#include "affinelib.h"
+#include "bvh.h"
 
 using namespace Eigen;
 
@@ -17,16 +23,21 @@ public:
     std::vector< std::vector<double> > distPts, distTet;   // [i,j]-entry is the distance to the i-th handle to j-th element
     std::vector<int> closestPts, closestTet;               // [i]-entry is the index of the closest element to i-th handle
     int nHdl, nPts, nTet;
-    Distance(){};
+    BVH ptsTree, tetTree, hdlTree;                         // acceleration structures for the queries below
+    Distance(): nHdl(0), nPts(0), nTet(0) {};
     Distance(int _nHandle, int _nPts, int _nTet) {
         setNum(_nHandle, _nPts, _nTet);
     };
     void setNum(int _nHandle, int _nPts, int _nTet);
     void findClosestPts();
     void findClosestTet();
+    void findClosestPts(const std::vector<Vector3d>& pts, const std::vector<Vector3d>& hdlPts);
+    void findClosestTet(const std::vector<Vector3d>& tetCenter, const std::vector<Vector3d>& hdlPts);
     void computeCageDistPts(short cageMode, const std::vector<Vector3d>& pts, const std::vector<Vector3d>& cagePts, const std::vector<int>& cageTetList);
     void computeCageDistTet(short cageMode, const std::vector<Vector3d>& tetCenter, const std::vector<Vector3d>& cagePts, const std::vector<int>& cageTetList);
     void computeDistPts(const std::vector<Vector3d>& pts, const std::vector<Vector3d>& hdlPts);
+    void computeDistPts(const std::vector<Vector3d>& pts, const std::vector<Vector3d>& hdlPts, double cutoff);
+    void computeDistPtsNearest(const std::vector<Vector3d>& pts, const std::vector<Vector3d>& hdlPts, int k);
     void computeDistTet(const std::vector<Vector3d>& tetCenter, const std::vector<Vector3d>& hdlPts);
     double distPtLin(Vector3d p,Vector3d a,Vector3d b);
     double distPtTri(Vector3d p,Vector3d a,Vector3d b,Vector3d c);
@@ -36,7 +47,7 @@ public:
 };
 
 // initialise
-void Distance::setNum(int _nHandle, int _nPts, int _nTet){
+inline void Distance::setNum(int _nHandle, int _nPts, int _nTet){
     nHdl = _nHandle;
     nPts = _nPts;
     nTet = _nTet;
@@ -51,7 +62,8 @@ void Distance::setNum(int _nHandle, int _nPts, int _nTet){
 }
 
 // distance between probe handles and mesh pts
-void Distance::computeDistPts(const std::vector<Vector3d>& pts, const std::vector<Vector3d>& hdlPts){
+inline void Distance::computeDistPts(const std::vector<Vector3d>& pts, const std::vector<Vector3d>& hdlPts){
+#pragma omp parallel for
     for(int i=0;i<nHdl;i++){
         for(int j=0;j<nPts;j++){
             distPts[i][j] = (pts[j]-hdlPts[i]).norm();
@@ -60,7 +72,8 @@ void Distance::computeDistPts(const std::vector<Vector3d>& pts, const std::vecto
 }
 
 // distance between probe handles and mesh tet
-void Distance::computeDistTet(const std::vector<Vector3d>& tetCenter, const std::vector<Vector3d>& hdlPts){
+inline void Distance::computeDistTet(const std::vector<Vector3d>& tetCenter, const std::vector<Vector3d>& hdlPts){
+#pragma omp parallel for
     for(int i=0;i<nHdl;i++){
         for(int j=0;j<nTet;j++){
             distTet[i][j] = (tetCenter[j]-hdlPts[i]).norm();
@@ -68,11 +81,46 @@ void Distance::computeDistTet(const std::vector<Vector3d>& tetCenter, const std:
     }
 }
 
+// distance between probe handles and mesh pts within the cutoff radius; the rest is set to HUGE_VAL
+// (for WM_CUTOFF_DISTANCE, where farther pts get zero weight anyway)
+inline void Distance::computeDistPts(const std::vector<Vector3d>& pts, const std::vector<Vector3d>& hdlPts, double cutoff){
+    ptsTree.buildPoints(pts);
+#pragma omp parallel for schedule(dynamic)
+    for(int i=0;i<nHdl;i++){
+        std::fill(distPts[i].begin(), distPts[i].end(), HUGE_VAL);
+        std::vector<int> idx;
+        std::vector<double> d;
+        ptsTree.withinRadius(hdlPts[i], cutoff, idx, d);
+        for(size_t k=0;k<idx.size();k++){
+            distPts[i][idx[k]] = d[k];
+        }
+    }
+}
+
+// distance from each mesh pt to its k nearest handles; the rest is set to HUGE_VAL
+// (for WM_INV_DISTANCE with many handles, where far handles contribute little)
+inline void Distance::computeDistPtsNearest(const std::vector<Vector3d>& pts, const std::vector<Vector3d>& hdlPts, int k){
+    hdlTree.buildPoints(hdlPts);
+    for(int i=0;i<nHdl;i++){
+        std::fill(distPts[i].begin(), distPts[i].end(), HUGE_VAL);
+    }
+#pragma omp parallel for schedule(dynamic, 64)
+    for(int j=0;j<nPts;j++){
+        std::vector<int> idx;
+        std::vector<double> d;
+        hdlTree.kNearest(pts[j], k, idx, d);
+        for(size_t l=0;l<idx.size();l++){
+            distPts[idx[l]][j] = d[l];
+        }
+    }
+}
+
 // distance between cage and mesh pts
-void Distance::computeCageDistPts(short cageMode, const std::vector<Vector3d>& pts, const std::vector<Vector3d>& cagePts, const std::vector<int>& cageTetList){
+inline void Distance::computeCageDistPts(short cageMode, const std::vector<Vector3d>& pts, const std::vector<Vector3d>& cagePts, const std::vector<int>& cageTetList){
     switch (cageMode){
         case TM_FACE:
         {
+#pragma omp parallel for
             for(int j=0;j<nPts;j++){
                 for(int i=0;i<nHdl;i++){
                     Vector3d a=cagePts[cageTetList[4*i]];
@@ -85,6 +133,7 @@ void Distance::computeCageDistPts(short cageMode, const std::vector<Vector3d>& p
         }
         case TM_EDGE:
         {
+#pragma omp parallel for
             for(int j=0;j<nPts;j++){
                 for(int i=0;i<nHdl;i++){
                     Vector3d a=cagePts[cageTetList[4*i]];
@@ -97,6 +146,7 @@ void Distance::computeCageDistPts(short cageMode, const std::vector<Vector3d>& p
         case TM_VERTEX:
         case TM_VFACE:
         {
+#pragma omp parallel for
             for(int j=0;j<nPts;j++){
                 for(int i=0;i<nHdl;i++){
                     distPts[i][j] = (pts[j]-cagePts[cageTetList[4*i]]).norm();
@@ -108,6 +158,7 @@ void Distance::computeCageDistPts(short cageMode, const std::vector<Vector3d>& p
         case CM_MLS_SIM:
         case CM_MLS_RIGID:
         {
+#pragma omp parallel for
             for(int j=0;j<nPts;j++){
                 for(int i=0;i<nHdl;i++){
                     distPts[i][j] = (pts[j]-cagePts[i]).norm();
@@ -119,10 +170,11 @@ void Distance::computeCageDistPts(short cageMode, const std::vector<Vector3d>& p
 }
 
 // distance between cage and mesh tet
-void Distance::computeCageDistTet(short cageMode, const std::vector<Vector3d>& tetCenter, const std::vector<Vector3d>& cagePts, const std::vector<int>& cageTetList){
+inline void Distance::computeCageDistTet(short cageMode, const std::vector<Vector3d>& tetCenter, const std::vector<Vector3d>& cagePts, const std::vector<int>& cageTetList){
     switch (cageMode){
         case TM_FACE:
         {
+#pragma omp parallel for
             for(int j=0;j<nTet;j++){
                 for(int i=0;i<nHdl;i++){
                     Vector3d a=cagePts[cageTetList[4*i]];
@@ -135,6 +187,7 @@ void Distance::computeCageDistTet(short cageMode, const std::vector<Vector3d>& t
         }
         case TM_EDGE:
         {
+#pragma omp parallel for
             for(int j=0;j<nTet;j++){
                 for(int i=0;i<nHdl;i++){
                     Vector3d a=cagePts[cageTetList[4*i]];
@@ -147,6 +200,7 @@ void Distance::computeCageDistTet(short cageMode, const std::vector<Vector3d>& t
         case TM_VERTEX:
         case TM_VFACE:
         {
+#pragma omp parallel for
             for(int j=0;j<nTet;j++){
                 for(int i=0;i<nHdl;i++){
                     distTet[i][j] = (tetCenter[j]-cagePts[cageTetList[4*i]]).norm();
@@ -158,6 +212,7 @@ void Distance::computeCageDistTet(short cageMode, const std::vector<Vector3d>& t
         case CM_MLS_SIM:
         case CM_MLS_RIGID:
         {
+#pragma omp parallel for
             for(int j=0;j<nTet;j++){
                 for(int i=0;i<nHdl;i++){
                     distTet[i][j] = (tetCenter[j]-cagePts[i]).norm();
@@ -170,7 +225,7 @@ void Distance::computeCageDistTet(short cageMode, const std::vector<Vector3d>& t
 
 
 // find closest point on mesh from each handle
-void Distance::findClosestPts(){
+inline void Distance::findClosestPts(){
     for(int i=0;i<nHdl;i++){
         closestPts[i] = 0;
         double min_d = HUGE_VAL;
@@ -183,7 +238,7 @@ void Distance::findClosestPts(){
     }
 }
 // find closest tet on mesh from each handle
-void Distance::findClosestTet(){
+inline void Distance::findClosestTet(){
     for(int i=0;i<nHdl;i++){
         closestTet[i] = 0;
         double min_d = HUGE_VAL;
@@ -197,8 +252,21 @@ void Distance::findClosestTet(){
 }
 
 
+// find closest point on mesh from each handle (without the full distance table)
+inline void Distance::findClosestPts(const std::vector<Vector3d>& pts, const std::vector<Vector3d>& hdlPts){
+    ptsTree.buildPoints(pts);
+    std::vector<double> d;
+    ptsTree.closestBatch(hdlPts, closestPts, d);
+}
+// find closest tet on mesh from each handle (without the full distance table)
+inline void Distance::findClosestTet(const std::vector<Vector3d>& tetCenter, const std::vector<Vector3d>& hdlPts){
+    tetTree.buildPoints(tetCenter);
+    std::vector<double> d;
+    tetTree.closestBatch(hdlPts, closestTet, d);
+}
+
 // compute distance between a line segment (ab) and a point p
-double Distance::distPtLin(Vector3d p,Vector3d a,Vector3d b){
+inline double Distance::distPtLin(Vector3d p,Vector3d a,Vector3d b){
     double t= (a-b).dot(p-b)/(a-b).squaredNorm();
     if(t>1){
         return (a-p).norm();
@@ -210,33 +278,34 @@ double Distance::distPtLin(Vector3d p,Vector3d a,Vector3d b){
 }
 
 // compute distance between a triangle (abc) and a point p
-double Distance::distPtTri(Vector3d p, Vector3d a, Vector3d b, Vector3d c){
+inline double Distance::distPtTri(Vector3d p, Vector3d a, Vector3d b, Vector3d c){
     /// if p is in the outer half-space, it returns HUGE_VAL
     double s[4];
     Vector3d n=(b-a).cross(c-a);
     if(n.squaredNorm()<EPSILON){
         return (p-a).norm();
     }
+    n.normalize();
     double k=n.dot(a-p);
     if(k<0) return HUGE_VAL;
     s[0]=distPtLin(p,a,b);
     s[1]=distPtLin(p,b,c);
     s[2]=distPtLin(p,c,a);
     Matrix3d A;
-    A << b(0)-a(0), c(0)-a(0), n(0)-a(0),
-    b(1)-a(1), c(1)-a(1), n(1)-a(1),
-    b(2)-a(2), c(2)-a(2), n(2)-a(2);
+    A << b(0)-a(0), c(0)-a(0), n(0),
+    b(1)-a(1), c(1)-a(1), n(1),
+    b(2)-a(2), c(2)-a(2), n(2);
     Vector3d v = A.inverse()*(p-a);  // barycentric coordinate of p
     if(v(0)>0 && v(1)>0 && v(0)+v(1)<1){
         s[3]=k;
     }else{
         s[3] = HUGE_VAL;
     }
-    return min(min(min(s[0],s[1]),s[2]),s[3]);
+    return std::min(std::min(std::min(s[0],s[1]),s[2]),s[3]);
 }
 
 // mean value coordinate
-void Distance::MVC(const std::vector<Vector3d>& pts, const std::vector<Vector3d>& cagePts,
+inline void Distance::MVC(const std::vector<Vector3d>& pts, const std::vector<Vector3d>& cagePts,
                            const std::vector<int>& cageFaceList, std::vector< std::vector<double> >& w)
 {
     int numPts=(int) pts.size();
@@ -271,20 +340,20 @@ void Distance::MVC(const std::vector<Vector3d>& pts, const std::vector<Vector3d>
 }
 
 // normalise weights
-void Distance::normaliseWeight(short mode, std::vector<double>& w){
+inline void Distance::normaliseWeight(short mode, std::vector<double>& w){
     if(mode == NM_NONE || mode == NM_LINEAR){
         double sum = std::accumulate(w.begin(), w.end(), 0.0);
         if ((sum > 1 || mode == NM_LINEAR) && sum != 0.0){
-            for (int i = 0; i < w.size(); i++){
+            for (size_t i = 0; i < w.size(); i++){
                 w[i] /= sum;
             }
         }
     }else if(mode == NM_SOFTMAX){
         double sum = 0.0;
-        for (int i = 0; i < w.size(); i++){
+        for (size_t i = 0; i < w.size(); i++){
             sum += exp(w[i]);
         }
-        for (int i = 0; i < w.size(); i++){
+        for (size_t i = 0; i < w.size(); i++){
             w[i] = exp(w[i])/sum;
         }
     }
@@ -12,9 +12,18 @@
 
 #include <iostream>
 #include <utility>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <chrono>
 #include <Eigen/Sparse>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "deformerConst.h"
+#include "ddsolver.h"
+#include "trisolve.h"
 
 //#define _SuiteSparse
 //#define _CERES
@@ -46,21 +55,47 @@ public:
     int dim;   // the dimension of the system including ghost vertices
     double transWeight;
     SpSolver solver;
+    int numDomains;   // > 1: solve the ARAP system by domain decomposition instead of a single factorization
+    DDSolver<SpSolver> ddSolver;
+    TriSolver triSolver;      // parallel triangular solves with the factor of solver
+    bool useTriSolver;        // triSolver measured faster than solver.solve
+    bool triSolverPending;    // set up and time triSolver at the next factorization; later ones only refresh its values
+    double serialSolveTime, parallelSolveTime;   // ms of a 3-column solve, measured at the first factorization of the pattern (0 = not measured)
     SpMat constraintMat;
     SpMat laplacian;
+    SpMat systemMat;   // assembled ARAP system; kept so that tet weight changes only need a numeric refactorization
     std::vector<int> tetList;
     std::vector<Matrix4d> tetMatrix,tetMatrixInverse;
+    const Matrix4d* tetInverse;   // numTet inverse tet matrices: tetMatrixInverse, or those stored elsewhere by ARAPattach
     std::vector<double> tetWeight;
     std::vector< std::pair<int,double> > constraintWeight;  //  [i,w] = i-th vertex is constrained with weight w
     MatrixXd constraintVal;       // i-th row = value of i-th constraint
+    double regularization;        // diagonal regularization of the ARAP system
+    MatrixXd regularizationTarget;   // dim x 3 positions the regularization pulls towards (empty = origin)
     MatrixXd Sol;
-    Laplacian(): numTet(0), tetMatrix(0), tetMatrixInverse(0), tetWeight(0), constraintWeight(0), transWeight(0) {
+    // heat method geodesics
+    SpSolver heatSolver, poissonSolver;   // (M + t L) and L, factorized once per mesh
+    VectorXd vertexArea;                  // lumped mass M
+    std::vector<int> component;           // connected component of each vertex
+    double heatTime;
+    Laplacian(): numTet(0), transWeight(0), numDomains(0), useTriSolver(false), triSolverPending(false), serialSolveTime(0), parallelSolveTime(0), tetMatrix(0), tetMatrixInverse(0), tetInverse(nullptr), tetWeight(0), constraintWeight(0), regularization(0), heatTime(0) {
     };
     int ARAPprecompute();
+    int ARAPrefactorize();
+    int ARAPattach(const char* factor, size_t bytes, const Matrix4d* inverse);
+    void setupTriSolver();
+    void updateTetWeight(const std::vector<int>& idx, const std::vector<double>& w);
     void ARAPSolve(const std::vector<Matrix4d>& targetMat);
+    MatrixXd ARAPrhs(const std::vector<Matrix4d>& targetMat) const;
+    MatrixXd systemSolve(const MatrixXd& B);
+    MatrixXd systemSolveBlocks(const MatrixXd& B, int blockSize);
     void harmonicSolve();
     int cotanPrecompute();
+    void cotanLaplacian();
+    int heatPrecompute(double t=0);
+    void heatGeodesic(const std::vector< std::vector<int> >& sources);
     void computeTetMatrixInverse();
+    static void blockSolve(const SpSolver& s, const MatrixXd& B, MatrixXd& X, int blockSize=8);
 };
 
 
@@ -71,15 +106,17 @@ inline int Laplacian::ARAPprecompute(){
     Matrix4d Hlist;
     Matrix4d diag=Matrix4d::Identity();
     diag(3,3)=transWeight;
+    // entries are kept even where tetWeight is zero, so that the sparsity pattern does not depend on tetWeight
     for(int i=0;i<numTet;i++){
-        Hlist=tetWeight[i] * tetMatrixInverse[i].transpose() * diag * tetMatrixInverse[i];
+        Hlist=tetWeight[i] * tetInverse[i].transpose() * diag * tetInverse[i];
         for(int j=0;j<4;j++){
             for(int k=0;k<4;k++){
                 tripletListMat.push_back(T(tetList[4*i+j],tetList[4*i+k],Hlist(j,k)));
             }
         }
     }
-    SpMat mat(dim,dim);
+    SpMat& mat = systemMat;
+    mat.resize(dim,dim);
     mat.setFromTriplets(tripletListMat.begin(), tripletListMat.end());
     // set soft constraint
     int numConstraints = constraintWeight.size();
@@ -98,28 +135,139 @@ inline int Laplacian::ARAPprecompute(){
 
     // Add regularization for numerical stability (helps with degenerate geometry)
     // Add small diagonal term: mat += epsilon * I
-    double regularization = 1e-6 * numTet;  // Scale with mesh size
+    regularization = 1e-6 * numTet;  // Scale with mesh size
     for (int i = 0; i < dim; i++) {
         mat.coeffRef(i, i) += regularization;
     }
 
-    solver.compute(mat);
-    if(solver.info() != Success){
+    if(numDomains > 1){
+        ddSolver.numDomains = numDomains;
+        if(ddSolver.analyzePattern(mat) == 0) return 0;
+        std::cerr << "ARAP precompute failed: mesh may have zero-length edges or degenerate faces" << std::endl;
+        return ERROR_ARAP_PRECOMPUTE;
+    }
+    solver.analyzePattern(mat);
+    triSolverPending = true;
+    return ARAPrefactorize();
+}
+
+// instead of ARAPprecompute: solve with a factor stored by TriSolver elsewhere (e.g. shared memory) and the
+// numTet inverse tet matrices stored with it, both left in place instead of computeTetMatrixInverse.
+// systemMat is not assembled, so updateTetWeight and ARAPrefactorize are unavailable
+inline int Laplacian::ARAPattach(const char* factor, size_t bytes, const Matrix4d* inverse){
+    tetMatrixInverse.clear();
+    tetMatrixInverse.shrink_to_fit();
+    tetInverse = inverse;
+    int numConstraints = constraintWeight.size();
+    std::vector<T> tripletListC(0);
+    for(int i=0;i<numConstraints;i++){
+        tripletListC.push_back(T( constraintWeight[i].first, i, constraintWeight[i].second));
+    }
+    constraintMat.resize(dim,numConstraints);
+    constraintMat.setZero();
+    constraintMat.setFromTriplets(tripletListC.begin(), tripletListC.end());
+    regularization = 1e-6 * numTet;
+    systemMat.resize(0,0);
+    triSolverPending = false;
+    serialSolveTime = parallelSolveTime = 0;
+    useTriSolver = numDomains <= 1 && triSolver.attach(factor, bytes) && triSolver.rows() == dim;
+    if(!useTriSolver){
+        triSolver.clear();
+        std::cerr << "ARAP attach failed: the factor does not match the system" << std::endl;
+        return ERROR_ARAP_PRECOMPUTE;
+    }
+    return 0;
+}
+
+// numeric factorization of systemMat, reusing the symbolic analysis of ARAPprecompute.
+// The parallel solves are set up and timed with the first factor; later ones (e.g. stiffness
+// changes) only copy the new values into them
+inline int Laplacian::ARAPrefactorize(){
+    if(numDomains > 1){
+        ddSolver.factorize(systemMat);
+    }else{
+        solver.factorize(systemMat);
+    }
+    if((numDomains > 1 ? ddSolver.info() : solver.info()) != Success){
         //std::string error_mes = solver.lastErrorMessage();
         std::cerr << "ARAP precompute failed: mesh may have zero-length edges or degenerate faces" << std::endl;
         return ERROR_ARAP_PRECOMPUTE;
     }
+    if(numDomains <= 1){
+        if(triSolverPending){
+            setupTriSolver();
+        }else if(useTriSolver && !triSolver.refresh(solver)){
+            useTriSolver = false;
+            triSolver.clear();
+        }
+    }
     return 0;
 }
 
+// copy the new factor for the parallel triangular solves, and keep them only if they beat the serial ones
+inline void Laplacian::setupTriSolver(){
+    useTriSolver = false;
+    triSolverPending = false;
+    serialSolveTime = parallelSolveTime = 0;
+    triSolver.clear();
+#ifndef _SuiteSparse
+    int numThreads = 1;
+#ifdef _OPENMP
+    numThreads = omp_get_max_threads();
+#endif
+    // small systems solve in well under a millisecond; not worth the copy
+    if(dim < 2000) return;
+    triSolver.setup(solver, numThreads);
+    MatrixXd B(dim,3);
+    for(int i=0;i<dim;i++){
+        for(int k=0;k<3;k++) B(i,k) = std::sin(0.7*i+k);
+    }
+    typedef std::chrono::steady_clock Clock;
+    serialSolveTime = parallelSolveTime = 1e30;
+    for(int r=0;r<2;r++){
+        Clock::time_point t0 = Clock::now();
+        MatrixXd X = solver.solve(B);
+        Clock::time_point t1 = Clock::now();
+        MatrixXd Y = triSolver.solve(B);
+        Clock::time_point t2 = Clock::now();
+        serialSolveTime = std::min(serialSolveTime, std::chrono::duration<double, std::milli>(t1-t0).count());
+        parallelSolveTime = std::min(parallelSolveTime, std::chrono::duration<double, std::milli>(t2-t1).count());
+    }
+    useTriSolver = parallelSolveTime < serialSolveTime;
+    if(!useTriSolver) triSolver.clear();
+#endif
+}
+
+// change the weights of a few tets by patching systemMat in place; call ARAPrefactorize afterwards
+inline void Laplacian::updateTetWeight(const std::vector<int>& idx, const std::vector<double>& w){
+    Matrix4d Hlist;
+    Matrix4d diag=Matrix4d::Identity();
+    diag(3,3)=transWeight;
+    for(size_t n=0;n<idx.size();n++){
+        int i = idx[n];
+        Hlist=(w[n]-tetWeight[i]) * tetInverse[i].transpose() * diag * tetInverse[i];
+        for(int j=0;j<4;j++){
+            for(int k=0;k<4;k++){
+                systemMat.coeffRef(tetList[4*i+j],tetList[4*i+k]) += Hlist(j,k);
+            }
+        }
+        tetWeight[i] = w[n];
+    }
+}
+
 // solve the ARAP system
 inline void Laplacian::ARAPSolve(const std::vector<Matrix4d>& targetMat){
+    Sol = systemSolve(ARAPrhs(targetMat));
+}
+
+// right-hand side of the ARAP system for the target matrices
+inline MatrixXd Laplacian::ARAPrhs(const std::vector<Matrix4d>& targetMat) const{
     Matrix4d Glist;
     Matrix4d diag=Matrix4d::Identity();
     diag(3,3)=transWeight;
     MatrixXd G = MatrixXd::Zero(dim,3);
     for(int i=0;i<numTet;i++){
-        Glist= tetWeight[i] * tetMatrixInverse[i].transpose() * diag * targetMat[i];
+        Glist= tetWeight[i] * tetInverse[i].transpose() * diag * targetMat[i];
         for(int k=0;k<3;k++){
             for(int j=0;j<4;j++){
                 G(tetList[4*i+j],k) += Glist(j,k);
@@ -129,17 +277,49 @@ inline void Laplacian::ARAPSolve(const std::vector<Matrix4d>& targetMat){
     // set soft constraint
     // (H^T,C_M) * (G \\ constraintVal)
     G += numTet * constraintMat * constraintVal;
-    Sol = solver.solve(G);
+    if(regularizationTarget.rows() == dim){
+        G += regularization * regularizationTarget;
+    }
+    return G;
+}
+
+// solve with the factorized ARAP system
+inline MatrixXd Laplacian::systemSolve(const MatrixXd& B){
+    if(numDomains > 1) return ddSolver.solve(B);
+    if(useTriSolver) return triSolver.solve(B);
+    return solver.solve(B);
+}
+
+// solve with the factorized ARAP system for right-hand sides made of independent blocks of columns
+// (e.g. one per blend); the serial factor solves the blocks in parallel
+inline MatrixXd Laplacian::systemSolveBlocks(const MatrixXd& B, int blockSize){
+    if(numDomains > 1 || useTriSolver) return systemSolve(B);
+    MatrixXd X;
+    blockSolve(solver, B, X, blockSize);
+    return X;
+}
+
+// solve for many right-hand sides; blocks of columns share the factorization in parallel
+inline void Laplacian::blockSolve(const SpSolver& s, const MatrixXd& B, MatrixXd& X, int blockSize){
+    int numCols = (int)B.cols();
+    int numBlocks = (numCols+blockSize-1)/blockSize;
+    X.resize(B.rows(), numCols);
+#pragma omp parallel for schedule(dynamic)
+    for(int b=0;b<numBlocks;b++){
+        int width = std::min(blockSize, numCols-b*blockSize);
+        X.middleCols(b*blockSize, width) = s.solve(B.middleCols(b*blockSize, width));
+    }
 }
 
 // harmonic weighting
+// each column of constraintVal is an independent field
 inline void Laplacian::harmonicSolve(){
     MatrixXd G = numTet * constraintMat * constraintVal;
-    Sol = solver.solve(G);
+    blockSolve(solver, G, Sol);
 }
 
-// harmonic weighting with cotan laplacian
-inline int Laplacian::cotanPrecompute(){
+// cotan laplacian of the faces (first three vertices of each tet); negative semi-definite
+inline void Laplacian::cotanLaplacian(){
     std::vector<T> tripletListMat(0);
     tripletListMat.reserve(numTet*9);
     for(int i=0;i<numTet;i++){
@@ -159,6 +339,11 @@ inline int Laplacian::cotanPrecompute(){
     laplacian.resize(dim, dim);
     laplacian.setZero();
     laplacian.setFromTriplets(tripletListMat.begin(), tripletListMat.end());
+}
+
+// harmonic weighting with cotan laplacian
+inline int Laplacian::cotanPrecompute(){
+    cotanLaplacian();
     // set soft constraint
     int numConstraints = constraintWeight.size();
     std::vector<T> tripletListF(0),tripletListC(0);
@@ -181,6 +366,9 @@ inline int Laplacian::cotanPrecompute(){
     }
 
     solver.compute(mat);
+    useTriSolver = false;    // harmonicSolve uses blockSolve with the new factor
+    triSolverPending = false;
+    triSolver.clear();
     if(solver.info() != Success){
         //std::string error_mes = solver.lastErrorMessage();
         std::cerr << "ARAP precompute failed: mesh may have zero-length edges or degenerate faces" << std::endl;
@@ -189,11 +377,137 @@ inline int Laplacian::cotanPrecompute(){
     return 0;
 }
 
+// heat method (Crane et al. 2013): prefactorize (M + tL) and L so that each source costs two solves
+// t defaults to the squared mean edge length
+inline int Laplacian::heatPrecompute(double t){
+    cotanLaplacian();
+    SpMat L = -0.5 * laplacian;     // positive semi-definite, with the usual 1/2 cot weights
+    vertexArea = VectorXd::Zero(dim);
+    double edgeSum = 0;
+    for(int i=0;i<numTet;i++){
+        Vector3d a = tetMatrix[i].block(0,0,1,3).transpose();
+        Vector3d b = tetMatrix[i].block(1,0,1,3).transpose();
+        Vector3d c = tetMatrix[i].block(2,0,1,3).transpose();
+        double area = (b-a).cross(c-a).norm()/2.0;
+        for(int j=0;j<3;j++){
+            vertexArea[tetList[4*i+j]] += area/3.0;
+        }
+        edgeSum += (b-a).norm() + (c-b).norm() + (a-c).norm();
+    }
+    if(numTet == 0) return ERROR_ARAP_PRECOMPUTE;
+    // connected components by union-find over the faces
+    component.resize(dim);
+    std::iota(component.begin(), component.end(), 0);
+    auto root = [&](int v){
+        while(component[v] != v){
+            component[v] = component[component[v]];
+            v = component[v];
+        }
+        return v;
+    };
+    for(int i=0;i<numTet;i++){
+        for(int j=1;j<3;j++){
+            component[root(tetList[4*i+j])] = root(tetList[4*i]);
+        }
+    }
+    for(int i=0;i<dim;i++){
+        component[i] = root(i);
+    }
+    double h = edgeSum/(3*numTet);
+    heatTime = (t > 0) ? t : h*h;
+    // regularization keeps isolated vertices and the constant kernel of L from making the systems singular
+    double regularization = 1e-8 * vertexArea.sum()/dim;
+    SpMat M(dim,dim), R(dim,dim);
+    std::vector<T> tripletListM(0), tripletListR(0);
+    for(int i=0;i<dim;i++){
+        tripletListM.push_back(T(i,i,vertexArea[i]));
+        tripletListR.push_back(T(i,i,regularization));
+    }
+    M.setFromTriplets(tripletListM.begin(), tripletListM.end());
+    R.setFromTriplets(tripletListR.begin(), tripletListR.end());
+    SpMat A = M + heatTime * L + R;
+    heatSolver.compute(A);
+    if(heatSolver.info() != Success){
+        std::cerr << "Heat method precompute failed: mesh may have degenerate faces" << std::endl;
+        return ERROR_ARAP_PRECOMPUTE;
+    }
+    SpMat P = L + R;
+    poissonSolver.compute(P);
+    if(poissonSolver.info() != Success){
+        std::cerr << "Heat method precompute failed: mesh may have degenerate faces" << std::endl;
+        return ERROR_ARAP_PRECOMPUTE;
+    }
+    return 0;
+}
+
+// geodesic distance from each source set (one column of Sol per set); HUGE_VAL where unreachable
+inline void Laplacian::heatGeodesic(const std::vector< std::vector<int> >& sources){
+    int numSrc = (int)sources.size();
+    MatrixXd U0 = MatrixXd::Zero(dim, numSrc);
+    for(int k=0;k<numSrc;k++){
+        for(int v: sources[k]){
+            U0(v,k) = 1.0;
+        }
+    }
+    // heat flow
+    MatrixXd U;
+    blockSolve(heatSolver, U0, U);
+    // divergence of the normalised negative gradient
+    MatrixXd div = MatrixXd::Zero(dim, numSrc);
+#pragma omp parallel for
+    for(int k=0;k<numSrc;k++){
+        for(int i=0;i<numTet;i++){
+            int id[3] = {tetList[4*i], tetList[4*i+1], tetList[4*i+2]};
+            Vector3d p[3];
+            for(int j=0;j<3;j++){
+                p[j] = tetMatrix[i].block(j,0,1,3).transpose();
+            }
+            Vector3d N = (p[1]-p[0]).cross(p[2]-p[0]);
+            double area2 = N.norm();
+            if(area2 == 0) continue;
+            N /= area2;
+            Vector3d grad = Vector3d::Zero();
+            for(int j=0;j<3;j++){
+                grad += U(id[j],k) * N.cross(p[(j+2)%3]-p[(j+1)%3]);
+            }
+            double gn = grad.norm();
+            if(gn == 0) continue;
+            Vector3d X = -grad/gn;
+            for(int j=0;j<3;j++){
+                int j1=(j+1)%3, j2=(j+2)%3;
+                Vector3d e1 = p[j1]-p[j], e2 = p[j2]-p[j];
+                // cot of the angles opposite e1 and e2
+                double cot1 = (p[j]-p[j2]).dot(p[j1]-p[j2]) / area2;
+                double cot2 = (p[j]-p[j1]).dot(p[j2]-p[j1]) / area2;
+                div(id[j],k) += 0.5*(cot1*e1.dot(X) + cot2*e2.dot(X));
+            }
+        }
+    }
+    // recover the distance from its gradient
+    MatrixXd phi;
+    blockSolve(poissonSolver, -div, phi);
+    Sol.resize(dim, numSrc);
+#pragma omp parallel for
+    for(int k=0;k<numSrc;k++){
+        // phi is defined up to a constant on each component; zero it at the sources
+        std::vector<double> offset(dim, HUGE_VAL);
+        for(int v: sources[k]){
+            offset[component[v]] = std::min(offset[component[v]], phi(v,k));
+        }
+        for(int i=0;i<dim;i++){
+            double o = offset[component[i]];
+            Sol(i,k) = (o < HUGE_VAL) ? std::max(0.0, phi(i,k)-o) : HUGE_VAL;
+        }
+    }
+}
+
 inline void Laplacian::computeTetMatrixInverse(){
     tetMatrixInverse.resize(numTet);
+#pragma omp parallel for schedule(static)
     for(int i=0;i<numTet;i++){
         tetMatrixInverse[i] = tetMatrix[i].inverse().eval();
     }
+    tetInverse = tetMatrixInverse.data();
 }
 
 
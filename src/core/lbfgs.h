@@ -0,0 +1,124 @@
+/**
+ * @file lbfgs.h
+ * @brief projected L-BFGS for small bound constrained problems
+ * @section LICENSE The MIT License
+ * @section requirements:  Eigen library
+ * @version 0.10
+ * @date  Oct. 2026
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <cmath>
+#include <algorithm>
+#include <Eigen/Dense>
+
+using namespace Eigen;
+
+// minimise f(x) subject to lower <= x <= upper and optionally sum(x) = sum
+// func(x, grad) returns f(x) and fills grad
+class LBFGS {
+public:
+    int m;              // number of stored correction pairs
+    int maxIter;
+    double tol;         // stop when the projected gradient is smaller than this
+    VectorXd lower, upper;
+    bool fixSum;
+    double sum;
+    int numIter, numEval;
+    LBFGS(): m(6), maxIter(100), tol(1e-8), fixSum(false), sum(1.0), numIter(0), numEval(0) {};
+    void setBounds(int n, double lo, double hi){
+        lower = VectorXd::Constant(n, lo);
+        upper = VectorXd::Constant(n, hi);
+    }
+    void project(VectorXd& x) const;
+    template<typename F> double minimize(F& func, VectorXd& x);
+};
+
+// projection onto the box, intersected with the hyperplane sum(x)=sum if requested
+inline void LBFGS::project(VectorXd& x) const{
+    int n = (int)x.size();
+    VectorXd lo = lower.size()==n ? lower : VectorXd::Constant(n, -HUGE_VAL);
+    VectorXd hi = upper.size()==n ? upper : VectorXd::Constant(n, HUGE_VAL);
+    if(!fixSum){
+        x = x.cwiseMax(lo).cwiseMin(hi);
+        return;
+    }
+    // find the shift t with sum(clamp(x-t)) = sum by bisection
+    auto total = [&](double t){ return (x.array()-t).max(lo.array()).min(hi.array()).sum(); };
+    double a = (x-hi).minCoeff(), b = (x-lo).maxCoeff();
+    if(!std::isfinite(a)) a = x.minCoeff() - std::abs(sum) - 1.0;
+    if(!std::isfinite(b)) b = x.maxCoeff() + std::abs(sum) + 1.0;
+    for(int k=0;k<100 && b-a > 1e-15*(1.0+std::abs(a)+std::abs(b));k++){
+        double t = (a+b)/2;
+        if(total(t) > sum) a = t; else b = t;
+    }
+    double t = (a+b)/2;
+    x = (x.array()-t).max(lo.array()).min(hi.array()).matrix();
+}
+
+template<typename F>
+inline double LBFGS::minimize(F& func, VectorXd& x){
+    int n = (int)x.size();
+    project(x);
+    VectorXd g(n), gNew(n), xNew(n), d(n);
+    double f = func(x, g);
+    numEval = 1;
+    std::deque<VectorXd> S, Y;
+    std::deque<double> rho;
+    for(numIter=0;numIter<maxIter;numIter++){
+        // projected gradient as stationarity measure
+        VectorXd pg = x-g;
+        project(pg);
+        if((pg-x).norm() < tol) break;
+        // two-loop recursion
+        d = -g;
+        int k = (int)S.size();
+        std::vector<double> alpha(k);
+        for(int i=k-1;i>=0;i--){
+            alpha[i] = rho[i]*S[i].dot(d);
+            d -= alpha[i]*Y[i];
+        }
+        if(k>0) d *= S[k-1].dot(Y[k-1])/Y[k-1].squaredNorm();
+        for(int i=0;i<k;i++){
+            double beta = rho[i]*Y[i].dot(d);
+            d += (alpha[i]-beta)*S[i];
+        }
+        // fall back to steepest descent if the projected step does not descend
+        xNew = x+d;
+        project(xNew);
+        if(g.dot(xNew-x) >= 0){
+            S.clear(); Y.clear(); rho.clear();
+            d = -g;
+        }
+        // backtracking line search along the projected path (Armijo)
+        double step = 1.0, fNew = f;
+        bool accepted = false;
+        for(int ls=0;ls<30;ls++){
+            xNew = x+step*d;
+            project(xNew);
+            fNew = func(xNew, gNew);
+            numEval++;
+            if(fNew <= f + 1e-4*g.dot(xNew-x)){
+                accepted = true;
+                break;
+            }
+            step *= 0.5;
+        }
+        if(!accepted) break;
+        VectorXd s = xNew-x, y = gNew-g;
+        double sy = s.dot(y);
+        if(sy > 1e-12*s.norm()*y.norm()){
+            S.push_back(s); Y.push_back(y); rho.push_back(1.0/sy);
+            if((int)S.size() > m){
+                S.pop_front(); Y.pop_front(); rho.pop_front();
+            }
+        }
+        bool converged = std::abs(f-fNew) <= tol*std::max(1.0, std::abs(f));
+        x = xNew; g = gNew; f = fNew;
+        if(converged) break;
+    }
+    return f;
+}
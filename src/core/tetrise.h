@@ -20,6 +20,8 @@
 #include <cassert>
 #include <vector>
 #include <map>
+#include <array>
+#include <algorithm>
 
 #include "deformerConst.h"
 #include "affinelib.h"
@@ -107,7 +109,7 @@ public:
 ///
 namespace Tetrise{
     // compose a matrix out of four vectors
-    inline Matrix4d mat(Vector3d p0,Vector3d p1,Vector3d p2,Vector3d c){
+    inline Matrix4d mat(const Vector3d& p0,const Vector3d& p1,const Vector3d& p2,const Vector3d& c){
         Matrix4d m;
         m << p0[0], p0[1], p0[2], 1,
         p1[0], p1[1], p1[2], 1,
@@ -122,7 +124,8 @@ namespace Tetrise{
         edgeList.reserve(faceList.size());
         std::map< couple<int>, int > edges;
         int s,t;
-        for(int i=0;i<faceList.size()/3;i++){
+        int numFaces = (int)faceList.size()/3;
+        for(int i=0;i<numFaces;i++){
             for(int j=0;j<3;j++){
                 s=faceList[3*i+j];
                 t=faceList[3*i+((j+1)%3)];
@@ -139,15 +142,19 @@ namespace Tetrise{
         return (int)edgeList.size();
     }
     
-    // make the list of tetrahedra
-    inline int makeTetList(short tetMode, int numPts, const std::vector<int>& faceList,
-                    const std::vector<edge>& edgeList, const std::vector<vertex>& vertexList,
-                    std::vector<int>& tetList){
-        tetList.clear();
-        int dim=0;    // number of total points including ghost ones
-        if(tetMode == TM_FACE){
+    // per tet mode policies: the routines below branch on the mode once (dispatchTetMode),
+    // so that their per-tet loops are compiled for each mode, branch-free and inlined.
+    // tets sharing their fourth vertex form a group: a tet for TM_FACE/TM_VFACE,
+    // the two tets of an edge for TM_EDGE, the fan of a vertex for TM_VERTEX.
+    // TetPolicy<mode>::matrix(pts, ..., g, first, P, tetWeight, normalise) writes the matrices of
+    // group g, whose first tet is tet number "first", to P[0], P[1], ...
+    // pts is indexed by vertex: a std::vector<Vector3d>, or a pointer to interleaved positions (Mesh::vertexArray())
+    template<short tetMode> struct TetPolicy;
+
+    template<> struct TetPolicy<TM_FACE>{
+        static inline int makeTetList(int numPts, const std::vector<int>& faceList, const std::vector<edge>& /*edgeList*/,
+                                      const std::vector<vertex>& /*vertexList*/, std::vector<int>& tetList){
             int numTet = (int)faceList.size()/3;
-            dim = numTet + numPts;
             tetList.resize(4*numTet);
             for(int i=0;i<numTet;i++){
                 tetList[4*i] = faceList[3*i];
@@ -155,11 +162,116 @@ namespace Tetrise{
                 tetList[4*i+2] = faceList[3*i+2];
                 tetList[4*i+3] = i+numPts;
             }
-        }else if(tetMode == TM_EDGE){
-            int numTet = 2 * (int)edgeList.size();
-            dim = numPts + (int)edgeList.size();
-            tetList.resize(4* numTet);
-            for(int i=0;i<edgeList.size();i++){
+            return numTet + numPts;
+        }
+
+        static inline void makeTetGroups(int numTet, const std::vector<edge>& /*edgeList*/,
+                                         const std::vector<vertex>& /*vertexList*/, std::vector<int>& groupStart){
+            groupStart.resize(numTet+1);
+            for(int i=0;i<=numTet;i++) groupStart[i] = i;
+        }
+
+        static inline void makeTetWeightList(const std::vector<int>& tetList, const std::vector<edge>& /*edgeList*/,
+                                             const VectorXd& ptsWeight, std::vector<double>& tetWeight){
+            int numTet = (int)tetList.size()/4;
+            for(int i=0;i<numTet;i++){
+                tetWeight[i] = (ptsWeight[tetList[4*i]] + ptsWeight[tetList[4*i+1]]
+                                + ptsWeight[tetList[4*i+2]])/3;
+            }
+        }
+
+        static inline void makePtsWeightList(const std::vector<int>& tetList, const std::vector<edge>& /*edgeList*/,
+                                             const std::vector<double>& tetWeight, std::vector<double>& ptsWeight, std::vector<int>& ptsCount){
+            int numTet = (int)tetList.size()/4;
+            for(int i=0;i<numTet;i++){
+                for(int j=0;j<3;j++){
+                    ptsCount[tetList[4*i+j]]++;
+                    ptsWeight[tetList[4*i+j]] += tetWeight[i];
+                }
+            }
+        }
+
+        // incident (vertex, tet) pairs in tet order, as makePtsWeightList visits them
+        static inline void makePtsTetPairs(const std::vector<int>& tetList, const std::vector<edge>& /*edgeList*/,
+                                           std::vector<int>& pv, std::vector<int>& pt, std::vector<int>& ptsCount){
+            int numTet = (int)tetList.size()/4;
+            for(int i=0;i<numTet;i++){
+                for(int j=0;j<3;j++){
+                    pv.push_back(tetList[4*i+j]); pt.push_back(i);
+                    ptsCount[tetList[4*i+j]]++;
+                }
+            }
+        }
+
+        static inline std::array<int,3> mirrorKey(int a, int b, int c){
+            std::array<int,3> k = {{a,b,c}};
+            std::sort(k.begin(), k.end());
+            return k;
+        }
+
+        static inline void makeAdjacencyList(const std::vector<edge>& edgeList, const std::vector<vertex>& /*vertexList*/,
+                                             std::vector< std::vector<int> >& adjacencyList){
+            int numEdges = (int)edgeList.size();
+            for(int i=0;i<numEdges;i++){
+                adjacencyList[edgeList[i].faces[0]].push_back(edgeList[i].faces[1]);
+                adjacencyList[edgeList[i].faces[1]].push_back(edgeList[i].faces[0]);
+            }
+        }
+
+        static inline void removeDegenerate(const std::vector<int>& tetList, std::vector<int>& faceList, std::vector<edge>& edgeList,
+                                            std::vector<vertex>& /*vertexList*/, const std::vector<Matrix4d>& P){
+            std::vector<int> goodList(0);
+            std::vector<int> oldFaceList = faceList;
+            int numTet = (int)tetList.size()/4;
+            for(int i=0;i<numTet;i++){
+                if( abs(P[i].determinant())>EPSILON){
+                    goodList.push_back(i);
+                }
+            }
+            int numFaces = (int)goodList.size();
+            faceList.resize(3*numFaces);
+            for(int i=0;i<numFaces;i++){
+                faceList[3*i] = oldFaceList[3*goodList[i]];
+                faceList[3*i+1] = oldFaceList[3*goodList[i]+1];
+                faceList[3*i+2] = oldFaceList[3*goodList[i]+2];
+            }
+            makeEdgeList(faceList, edgeList);
+        }
+
+        static inline void makeTetCenterList(const std::vector<Vector3d>& pts, const std::vector<int>& tetList,
+                                             std::vector<Vector3d>& tetCenter){
+            int numTet = (int)tetList.size()/4;
+            for(int i=0;i<numTet;i++){
+                tetCenter[i]=(pts[tetList[4*i]]+pts[tetList[4*i+1]]+pts[tetList[4*i+2]])/3;
+            }
+        }
+
+        template<typename Points>
+        static inline void matrix(const Points& pts, const std::vector<int>& tetList,
+            const std::vector<edge>& /*edgeList*/, const std::vector<vertex>& /*vertexList*/, int /*g*/, int first,
+            Matrix4d* P, double* tetWeight, bool normalise){
+            int i=first;
+            Vector3d p0=pts[tetList[4*i]];
+            Vector3d p1=pts[tetList[4*i+1]];
+            Vector3d p2=pts[tetList[4*i+2]];
+            Vector3d q = (p1-p0).cross(p2-p0);
+            tetWeight[0] = q.norm()/2;
+            if(normalise){
+                q.normalize();
+            }else{
+                q = (q/sqrt(q.norm()));
+            }
+            Vector3d c = q +(p0+p1+p2)/3;
+            P[0] = mat(p0,p1,p2,c);
+        }
+    };
+
+    template<> struct TetPolicy<TM_EDGE>{
+        static inline int makeTetList(int numPts, const std::vector<int>& faceList, const std::vector<edge>& edgeList,
+                                      const std::vector<vertex>& /*vertexList*/, std::vector<int>& tetList){
+            int numEdges = (int)edgeList.size();
+            tetList.resize(8*numEdges);
+            for(int i=0;i<numEdges;i++){
                 for(int j=0;j<2;j++){
                     int f=edgeList[i].faces[j];
                     int k=0;
@@ -174,229 +286,196 @@ namespace Tetrise{
                     tetList[8*i + 4*j+3]=i+numPts;
                 }
             }
-        }else if(tetMode == TM_VERTEX){
-            tetList.reserve(faceList.size());
-            dim = numPts + (int)vertexList.size();
-            for(int i=0;i<vertexList.size();i++){
-                for(int j=0;j<vertexList[i].connectedTriangles.size()/2;j++){
-                    tetList.push_back(vertexList[i].index);   // the first vertex should be the vertex
-                    tetList.push_back(vertexList[i].connectedTriangles[2*j]);
-                    tetList.push_back(vertexList[i].connectedTriangles[2*j+1]);
-                    tetList.push_back(numPts+i);
-                }
-            }
-        }else if(tetMode == TM_VFACE){
-            tetList.reserve(faceList.size());
-            int cur=0;
-            for(int i=0;i<vertexList.size();i++){
-                for(int j=0;j<vertexList[i].connectedTriangles.size()/2;j++){
-                    tetList.push_back(vertexList[i].index);   // the first vertex should be the vertex
-                    tetList.push_back(vertexList[i].connectedTriangles[2*j]);
-                    tetList.push_back(vertexList[i].connectedTriangles[2*j+1]);
-                    tetList.push_back(numPts+cur);
-                    cur++;
-                }
-            }
-            dim = numPts + (int) tetList.size()/4;
+            return numPts + numEdges;
         }
-        return dim;
-    }
-    
-    // comptute tetrahedra weights from those of points
-    inline void makeTetWeightList(short tetMode, const std::vector<int>& tetList,
-                   const std::vector<int>& faceList, const std::vector<edge>& edgeList,
-                   const std::vector<vertex>& vertexList, const VectorXd& ptsWeight,
-                   std::vector<double>& tetWeight ){
-        int numTet = (int)tetList.size()/4;
-        tetWeight.resize(numTet);
-        if(tetMode == TM_FACE){
-            for(int i=0;i<numTet;i++){
-                tetWeight[i] = (ptsWeight[tetList[4*i]] + ptsWeight[tetList[4*i+1]]
-                                + ptsWeight[tetList[4*i+2]])/3;
-            }
-        }else if(tetMode == TM_EDGE){
-            for(int i=0;i<edgeList.size();i++){
+
+        static inline void makeTetGroups(int /*numTet*/, const std::vector<edge>& edgeList,
+                                         const std::vector<vertex>& /*vertexList*/, std::vector<int>& groupStart){
+            int numEdges = (int)edgeList.size();
+            groupStart.resize(numEdges+1);
+            for(int i=0;i<=numEdges;i++) groupStart[i] = 2*i;
+        }
+
+        static inline void makeTetWeightList(const std::vector<int>& /*tetList*/, const std::vector<edge>& edgeList,
+                                             const VectorXd& ptsWeight, std::vector<double>& tetWeight){
+            int numEdges = (int)edgeList.size();
+            for(int i=0;i<numEdges;i++){
                 tetWeight[2*i]= (ptsWeight[edgeList[i].vertices[0]]+ptsWeight[edgeList[i].vertices[1]])/2.0;
                 tetWeight[2*i+1]= (ptsWeight[edgeList[i].vertices[0]]+ptsWeight[edgeList[i].vertices[1]])/2.0;
             }
-        }else if(tetMode == TM_VERTEX || tetMode == TM_VFACE){
-            for(int i=0;i<numTet;i++){
-                tetWeight[i] = ptsWeight[tetList[4*i]];
-            }
         }
-    }
-    // comptute tetrahedra weights from those of points
-    inline void makePtsWeightList(short tetMode, int numPts, const std::vector<int>& tetList,
-                        const std::vector<int>& faceList, const std::vector<edge>& edgeList,
-                        const std::vector<vertex>& vertexList, const std::vector<double>& tetWeight,
-                        std::vector<double>& ptsWeight ){
-        int numTet = (int)tetList.size()/4;
-        ptsWeight.clear();
-        ptsWeight.resize(numPts,0.0);
-        std::vector<int> ptsCount(numPts,0);
-        if(tetMode == TM_FACE){
-            for(int i=0;i<numTet;i++){
-                for(int j=0;j<3;j++){
-                    ptsCount[tetList[4*i+j]]++;
-                    ptsWeight[tetList[4*i+j]] += tetWeight[i];
-                }
-            }
-        }else if(tetMode == TM_EDGE){
-            for(int i=0;i<edgeList.size();i++){
+
+        static inline void makePtsWeightList(const std::vector<int>& /*tetList*/, const std::vector<edge>& edgeList,
+                                             const std::vector<double>& tetWeight, std::vector<double>& ptsWeight, std::vector<int>& ptsCount){
+            int numEdges = (int)edgeList.size();
+            for(int i=0;i<numEdges;i++){
                 ptsWeight[edgeList[i].vertices[0]] += tetWeight[2*i]+tetWeight[2*i+1];
                 ptsWeight[edgeList[i].vertices[1]] += tetWeight[2*i]+tetWeight[2*i+1];
                 ptsCount[edgeList[i].vertices[0]]++;
                 ptsCount[edgeList[i].vertices[1]]++;
             }
-        }else if(tetMode == TM_VERTEX || tetMode == TM_VFACE){
-            for(int i=0;i<numTet;i++){
-                ptsWeight[tetList[4*i]] += tetWeight[i];
-                ptsCount[tetList[4*i]]++;
-            }
-        }
-        for(int i=0;i<numPts;i++){
-            ptsWeight[i] /= ptsCount[i];
         }
-    }
-
 
-    
-        // construct tetrahedra matrices
-    inline void makeTetMatrix(short tetMode, const std::vector<Vector3d>& pts, const std::vector<int>& tetList,
-        const std::vector<int>& faceList, const std::vector<edge>& edgeList,
-                    const std::vector<vertex>& vertexList, std::vector<Matrix4d>& P, std::vector<double>& tetWeight, bool normalise=false){
-        Vector3d u, v, q, c;
-        int numTet = (int)tetList.size()/4;
-        P.clear();
-        P.reserve(numTet);
-        tetWeight.clear();
-        tetWeight.reserve(numTet);
-        if(tetMode == TM_FACE){
-            for(int i=0;i<numTet;i++){
-                Vector3d p0=pts[tetList[4*i]];
-                Vector3d p1=pts[tetList[4*i+1]];
-                Vector3d p2=pts[tetList[4*i+2]];
-                q = (p1-p0).cross(p2-p0);
-                tetWeight.push_back(q.norm()/2);
-                if(normalise){
-                    q.normalize();
-                }else{
-                    q = (q/sqrt(q.norm()));
-                }
-                c = q +(p0+p1+p2)/3;
-                P.push_back(mat(p0,p1,p2,c));
-            }
-        }else if(tetMode == TM_EDGE){
-            for(int i=0;i<edgeList.size();i++){
-                c = Vector3d::Zero();
-                for(int j=0;j<2;j++){
-                    Vector3d p0=pts[tetList[8*i + 4*j]];
-                    Vector3d p1=pts[tetList[8*i + 4*j + 1]];
-                    Vector3d p2=pts[tetList[8*i + 4*j + 2]];
-                    q=(p1-p0).cross(p2-p0).normalized();
-                    c += q;
-                }
-                u = pts[edgeList[i].vertices[0]];
-                v = pts[edgeList[i].vertices[1]];
-                if(normalise){
-                    c = (u+v)/2 + c.normalized();
-                }else{
-                    c = (u+v)/2 + (u-v).norm() * c.normalized();
-                }
+        static inline void makePtsTetPairs(const std::vector<int>& /*tetList*/, const std::vector<edge>& edgeList,
+                                           std::vector<int>& pv, std::vector<int>& pt, std::vector<int>& ptsCount){
+            int numEdges = (int)edgeList.size();
+            for(int i=0;i<numEdges;i++){
                 for(int j=0;j<2;j++){
-                    Vector3d p0=pts[tetList[8*i + 4*j]];
-                    Vector3d p1=pts[tetList[8*i + 4*j + 1]];
-                    Vector3d p2=pts[tetList[8*i + 4*j + 2]];
-                    P.push_back(mat(p0,p1,p2,c));
-                    tetWeight.push_back((p0-p1).norm());
+                    int v = edgeList[i].vertices[j];
+                    pv.push_back(v); pt.push_back(2*i);
+                    pv.push_back(v); pt.push_back(2*i+1);
+                    ptsCount[v]++;
                 }
             }
-        }else if(tetMode == TM_VERTEX){
-            for(int i=0;i<vertexList.size();i++){
-                c = Vector3d::Zero();
-                Vector3d p0 = pts[vertexList[i].index];
-                Vector3d p1,p2;
-                double area = 0;
-                for(int j=0;j<vertexList[i].connectedTriangles.size()/2;j++){
-                    p1 = pts[vertexList[i].connectedTriangles[2*j]];
-                    p2 = pts[vertexList[i].connectedTriangles[2*j+1]];
-                    q = (p1-p0).cross(p2-p0);
-                    tetWeight.push_back(q.norm()/2);
-                    area += q.norm()/2;
-                    c += q.normalized();
-                }
-                if(normalise){
-                    c =p0+c.normalized();
-                }else{
-                    c = p0 + sqrt(area)*(c.normalized());
+        }
+
+        static inline std::array<int,3> mirrorKey(int a, int b, int c){
+            std::array<int,3> k = {{a,b,c}};
+            if(k[0]>k[1]) std::swap(k[0],k[1]);
+            return k;
+        }
+
+        static inline void makeAdjacencyList(const std::vector<edge>& edgeList, const std::vector<vertex>& /*vertexList*/,
+                                             std::vector< std::vector<int> >& adjacencyList){
+            int numEdges = (int)edgeList.size();
+            std::vector< std::vector<int> > faceShareList(2*numEdges);
+            for(int i=0;i<numEdges;i++){
+                adjacencyList[2*i].push_back(2*i+1);
+                adjacencyList[2*i+1].push_back(2*i);
+                const std::vector<int>& share0 = faceShareList[edgeList[i].faces[0]];
+                for(size_t j=0;j<share0.size();j++){
+                    adjacencyList[2*i].push_back(share0[j]);
+                    adjacencyList[share0[j]].push_back(2*i);
                 }
-                for(int j=0;j<vertexList[i].connectedTriangles.size()/2;j++){
-                    p1 = pts[vertexList[i].connectedTriangles[2*j]];
-                    p2 = pts[vertexList[i].connectedTriangles[2*j+1]];
-                    P.push_back( mat(p0,p1,p2,c));
+                const std::vector<int>& share1 = faceShareList[edgeList[i].faces[1]];
+                for(size_t j=0;j<share1.size();j++){
+                    adjacencyList[2*i+1].push_back(share1[j]);
+                    adjacencyList[share1[j]].push_back(2*i+1);
                 }
+                faceShareList[edgeList[i].faces[0]].push_back(2*i);
+                faceShareList[edgeList[i].faces[1]].push_back(2*i+1);
             }
-        }else if(tetMode == TM_VFACE){
-            for(int i=0;i<numTet;i++){
-                Vector3d p0=pts[tetList[4*i]];
-                Vector3d p1=pts[tetList[4*i+1]];
-                Vector3d p2=pts[tetList[4*i+2]];
-                u=(p1-p0).normalized();
-                v=(p2-p0).normalized();
-                q=u.cross(v);
-                if(normalise){
-                    c = p0+q.normalized();
-                }else{
-                    c = p0+q;
+        }
+
+        static inline void removeDegenerate(const std::vector<int>& /*tetList*/, std::vector<int>& /*faceList*/, std::vector<edge>& edgeList,
+                                            std::vector<vertex>& /*vertexList*/, const std::vector<Matrix4d>& P){
+            std::vector<edge> oldEdgeList = edgeList;
+            // enumerate good edges
+            std::vector<int> goodList(0);
+            int numEdges = (int)edgeList.size();
+            for(int i=0;i<numEdges;i++){
+                if( abs(P[2*i].determinant())>EPSILON && abs(P[2*i+1].determinant())>EPSILON){
+                    goodList.push_back(i);
                 }
-                tetWeight.push_back(q.norm()/2);
-                P.push_back(mat(p0,p1,p2,c));
+            }
+            numEdges = (int)goodList.size();
+            edgeList.resize(numEdges);
+            for(int i=0;i<numEdges;i++){
+                edgeList[i]=oldEdgeList[goodList[i]];
             }
         }
-    }
-    
-    
-    // make tetrahedra adjacency list
-    inline void makeAdjacencyList(short tetMode, const std::vector<int>& tetList,
-            const std::vector<edge>& edgeList, const std::vector<vertex>& vertexList,
-                           std::vector< std::vector<int> >& adjacencyList){
-        adjacencyList.resize(tetList.size()/4);
-        for(int i=0;i<adjacencyList.size();i++){
-            adjacencyList[i].clear();
+
+        static inline void makeTetCenterList(const std::vector<Vector3d>& pts, const std::vector<int>& tetList,
+                                             std::vector<Vector3d>& tetCenter){
+            int numTet = (int)tetList.size()/4;
+            for(int i=0;i<numTet;i++){
+                tetCenter[i]=(pts[tetList[4*i]]+pts[tetList[4*i+1]])/2;
+            }
         }
-        if(tetMode == TM_FACE){
-            for(int i=0;i<edgeList.size();i++){
-                adjacencyList[edgeList[i].faces[0]].push_back(edgeList[i].faces[1]);
-                adjacencyList[edgeList[i].faces[1]].push_back(edgeList[i].faces[0]);
+
+        template<typename Points>
+        static inline void matrix(const Points& pts, const std::vector<int>& tetList,
+            const std::vector<edge>& edgeList, const std::vector<vertex>& /*vertexList*/, int g, int /*first*/,
+            Matrix4d* P, double* tetWeight, bool normalise){
+            int i=g;
+            Vector3d c = Vector3d::Zero();
+            for(int j=0;j<2;j++){
+                Vector3d p0=pts[tetList[8*i + 4*j]];
+                Vector3d p1=pts[tetList[8*i + 4*j + 1]];
+                Vector3d p2=pts[tetList[8*i + 4*j + 2]];
+                c += (p1-p0).cross(p2-p0).normalized();
             }
-        }else if(tetMode == TM_EDGE){
-            std::vector< std::vector<int> > faceShareList(2*edgeList.size());
-            for(int i=0;i<2*edgeList.size();i++){
-                faceShareList[i].clear();
+            Vector3d u = pts[edgeList[i].vertices[0]];
+            Vector3d v = pts[edgeList[i].vertices[1]];
+            if(normalise){
+                c = (u+v)/2 + c.normalized();
+            }else{
+                c = (u+v)/2 + (u-v).norm() * c.normalized();
             }
-            for(int i=0;i<edgeList.size();i++){
-                adjacencyList[2*i].push_back(2*i+1);
-                adjacencyList[2*i+1].push_back(2*i);
-                for(int j=0;j<faceShareList[edgeList[i].faces[0]].size();j++){
-                    adjacencyList[2*i].push_back(faceShareList[edgeList[i].faces[0]][j]);
-                    adjacencyList[faceShareList[edgeList[i].faces[0]][j]].push_back(2*i);
-                }
-                for(int j=0;j<faceShareList[edgeList[i].faces[1]].size();j++){
-                    adjacencyList[2*i+1].push_back(faceShareList[edgeList[i].faces[1]][j]);
-                    adjacencyList[faceShareList[edgeList[i].faces[1]][j]].push_back(2*i+1);
+            for(int j=0;j<2;j++){
+                Vector3d p0=pts[tetList[8*i + 4*j]];
+                Vector3d p1=pts[tetList[8*i + 4*j + 1]];
+                Vector3d p2=pts[tetList[8*i + 4*j + 2]];
+                P[j] = mat(p0,p1,p2,c);
+                tetWeight[j] = (p0-p1).norm();
+            }
+        }
+    };
+
+    // what TM_VERTEX and TM_VFACE share: the tets of a vertex fan, led by the vertex
+    struct VertexTetPolicy{
+        // the tets of the fans in order, with ghost vertex numPts+ghost(i, j) for tet j of fan i
+        template<typename Ghost>
+        static inline void makeFanTetList(int numPts, const std::vector<int>& faceList, const std::vector<vertex>& vertexList,
+                                          std::vector<int>& tetList, Ghost ghost){
+            tetList.reserve(faceList.size());
+            int numVertices = (int)vertexList.size();
+            for(int i=0;i<numVertices;i++){
+                int n = (int)vertexList[i].connectedTriangles.size()/2;
+                for(int j=0;j<n;j++){
+                    int tet = (int)tetList.size()/4;
+                    tetList.push_back(vertexList[i].index);   // the first vertex should be the vertex
+                    tetList.push_back(vertexList[i].connectedTriangles[2*j]);
+                    tetList.push_back(vertexList[i].connectedTriangles[2*j+1]);
+                    tetList.push_back(numPts+ghost(i, tet));
                 }
-                faceShareList[edgeList[i].faces[0]].push_back(2*i);
-                faceShareList[edgeList[i].faces[1]].push_back(2*i+1);
             }
-        }else if(tetMode == TM_VERTEX || tetMode == TM_VFACE){
+        }
+
+        static inline void makeTetWeightList(const std::vector<int>& tetList, const std::vector<edge>& /*edgeList*/,
+                                             const VectorXd& ptsWeight, std::vector<double>& tetWeight){
+            int numTet = (int)tetList.size()/4;
+            for(int i=0;i<numTet;i++){
+                tetWeight[i] = ptsWeight[tetList[4*i]];
+            }
+        }
+
+        static inline void makePtsWeightList(const std::vector<int>& tetList, const std::vector<edge>& /*edgeList*/,
+                                             const std::vector<double>& tetWeight, std::vector<double>& ptsWeight, std::vector<int>& ptsCount){
+            int numTet = (int)tetList.size()/4;
+            for(int i=0;i<numTet;i++){
+                ptsWeight[tetList[4*i]] += tetWeight[i];
+                ptsCount[tetList[4*i]]++;
+            }
+        }
+
+        static inline void makePtsTetPairs(const std::vector<int>& tetList, const std::vector<edge>& /*edgeList*/,
+                                           std::vector<int>& pv, std::vector<int>& pt, std::vector<int>& ptsCount){
+            int numTet = (int)tetList.size()/4;
+            for(int i=0;i<numTet;i++){
+                pv.push_back(tetList[4*i]); pt.push_back(i);
+                ptsCount[tetList[4*i]]++;
+            }
+        }
+
+        static inline std::array<int,3> mirrorKey(int a, int b, int c){
+            std::array<int,3> k = {{a,b,c}};
+            if(k[1]>k[2]) std::swap(k[1],k[2]);
+            return k;
+        }
+
+        static inline void makeAdjacencyList(const std::vector<edge>& /*edgeList*/, const std::vector<vertex>& vertexList,
+                                             std::vector< std::vector<int> >& adjacencyList){
             std::map< couple<int>, int > edges;
             int s,t,cur=0;
-            for(int i=0;i<vertexList.size();i++){
-                std::vector<int> adj(vertexList[i].connectedTriangles.size()/2);
-                for(int j=0;j<vertexList[i].connectedTriangles.size()/2;j++){
+            int numVertices = (int)vertexList.size();
+            for(int i=0;i<numVertices;i++){
+                int n = (int)vertexList[i].connectedTriangles.size()/2;
+                std::vector<int> adj(n);
+                for(int j=0;j<n;j++){
                     adj[j] = cur+j;
                 }
-                for(int j=0;j<vertexList[i].connectedTriangles.size()/2;j++){
+                for(int j=0;j<n;j++){
                     adjacencyList[cur].insert(adjacencyList[cur].end(), adj.begin(), adj.end());
                     // list of shared edges
                     s=vertexList[i].connectedTriangles[2*j];
@@ -418,87 +497,300 @@ namespace Tetrise{
                 }
             }
         }
-    }
 
-    // get rid of degenerate tetrahedra
-    inline int removeDegenerate(short tetMode, int numPts,
-           std::vector<int>& tetList,  std::vector<int>& faceList, std::vector<edge>& edgeList,
-                         std::vector<vertex>& vertexList, const std::vector<Matrix4d>& P){
-        if (tetMode == TM_FACE){
-            std::vector<int> goodList(0);
-            std::vector<int> oldFaceList = faceList;
-            int numTet = (int)tetList.size()/4;
-            for(int i=0;i<numTet;i++){
-                if( abs(P[i].determinant())>EPSILON){
-                    goodList.push_back(i);
-                }
-            }
-            int numFaces = (int)goodList.size();
-            faceList.resize(3*numFaces);
-            for(int i=0;i<numFaces;i++){
-                faceList[3*i] = oldFaceList[3*goodList[i]];
-                faceList[3*i+1] = oldFaceList[3*goodList[i]+1];
-                faceList[3*i+2] = oldFaceList[3*goodList[i]+2];
-            }
-            makeEdgeList(faceList, edgeList);
-        }else if( tetMode == TM_EDGE){
-            // deep copy edgeList
-            std::vector<edge> oldEdgeList(edgeList.size());
-            std::copy(edgeList.begin(), edgeList.end(), oldEdgeList.begin() );
-            // enumerate good edges
-            std::vector<int> goodList(0);
-            int numEdges = (int)edgeList.size();
-            for(int i=0;i<numEdges;i++){
-                if( abs(P[2*i].determinant())>EPSILON && abs(P[2*i+1].determinant())>EPSILON){
-                    goodList.push_back(i);
-                }
-            }
-            numEdges = (int)goodList.size();
-            edgeList.resize(numEdges);
-            for(int i=0;i<numEdges;i++){
-                edgeList[i]=oldEdgeList[goodList[i]];
-            }
-        }else if( tetMode == TM_VERTEX || tetMode == TM_VFACE){
-            // deep copy edgeList
-            std::vector<vertex> oldVertexList(vertexList.size());
-            std::copy(vertexList.begin(), vertexList.end(), oldVertexList.begin());
-            // enumerate good edges
+        static inline void removeDegenerate(const std::vector<int>& /*tetList*/, std::vector<int>& /*faceList*/, std::vector<edge>& /*edgeList*/,
+                                            std::vector<vertex>& vertexList, const std::vector<Matrix4d>& P){
+            std::vector<vertex> oldVertexList = vertexList;
+            // enumerate vertices whose fans have no degenerate tet
             std::vector<int> goodList(0);
             int cur = 0;
-            for(int i=0;i<vertexList.size();i++){
+            int numVertices = (int)vertexList.size();
+            for(int i=0;i<numVertices;i++){
                 bool isGood = true;
-                for(int j=0;j<vertexList[i].connectedTriangles.size()/2;j++){
+                int n = (int)vertexList[i].connectedTriangles.size()/2;
+                for(int j=0;j<n;j++){
                     isGood = isGood && abs(P[cur].determinant())>EPSILON;
                     cur++;
                 }
                 if(isGood) goodList.push_back(i);
             }
             vertexList.resize(goodList.size());
-            for(int i=0;i<goodList.size();i++){
+            for(size_t i=0;i<goodList.size();i++){
                 vertexList[i] = oldVertexList[goodList[i]];
             }
         }
-        return makeTetList(tetMode, numPts, faceList, edgeList, vertexList, tetList);
+
+        static inline void makeTetCenterList(const std::vector<Vector3d>& pts, const std::vector<int>& tetList,
+                                             std::vector<Vector3d>& tetCenter){
+            int numTet = (int)tetList.size()/4;
+            for(int i=0;i<numTet;i++){
+                tetCenter[i]=pts[tetList[4*i]];
+            }
+        }
+    };
+
+    template<> struct TetPolicy<TM_VERTEX> : VertexTetPolicy{
+        // one ghost vertex per fan
+        static inline int makeTetList(int numPts, const std::vector<int>& faceList, const std::vector<edge>& /*edgeList*/,
+                                      const std::vector<vertex>& vertexList, std::vector<int>& tetList){
+            makeFanTetList(numPts, faceList, vertexList, tetList, [](int i, int){ return i; });
+            return numPts + (int)vertexList.size();
+        }
+
+        static inline void makeTetGroups(int /*numTet*/, const std::vector<edge>& /*edgeList*/,
+                                         const std::vector<vertex>& vertexList, std::vector<int>& groupStart){
+            int numVertices = (int)vertexList.size();
+            groupStart.assign(numVertices+1,0);
+            for(int i=0;i<numVertices;i++){
+                groupStart[i+1] = groupStart[i] + (int)vertexList[i].connectedTriangles.size()/2;
+            }
+        }
+
+        template<typename Points>
+        static inline void matrix(const Points& pts, const std::vector<int>& /*tetList*/,
+            const std::vector<edge>& /*edgeList*/, const std::vector<vertex>& vertexList, int g, int /*first*/,
+            Matrix4d* P, double* tetWeight, bool normalise){
+            const std::vector<int>& fan = vertexList[g].connectedTriangles;
+            int n = (int)fan.size()/2;
+            Vector3d c = Vector3d::Zero();
+            Vector3d p0 = pts[vertexList[g].index];
+            double area = 0;
+            for(int j=0;j<n;j++){
+                Vector3d q = (pts[fan[2*j]]-p0).cross(pts[fan[2*j+1]]-p0);
+                tetWeight[j] = q.norm()/2;
+                area += q.norm()/2;
+                c += q.normalized();
+            }
+            if(normalise){
+                c =p0+c.normalized();
+            }else{
+                c = p0 + sqrt(area)*(c.normalized());
+            }
+            for(int j=0;j<n;j++){
+                P[j] = mat(p0,pts[fan[2*j]],pts[fan[2*j+1]],c);
+            }
+        }
+    };
+
+    template<> struct TetPolicy<TM_VFACE> : VertexTetPolicy{
+        // one ghost vertex per tet
+        static inline int makeTetList(int numPts, const std::vector<int>& faceList, const std::vector<edge>& /*edgeList*/,
+                                      const std::vector<vertex>& vertexList, std::vector<int>& tetList){
+            makeFanTetList(numPts, faceList, vertexList, tetList, [](int, int tet){ return tet; });
+            return numPts + (int)tetList.size()/4;
+        }
+
+        static inline void makeTetGroups(int numTet, const std::vector<edge>& /*edgeList*/,
+                                         const std::vector<vertex>& /*vertexList*/, std::vector<int>& groupStart){
+            groupStart.resize(numTet+1);
+            for(int i=0;i<=numTet;i++) groupStart[i] = i;
+        }
+
+        template<typename Points>
+        static inline void matrix(const Points& pts, const std::vector<int>& tetList,
+            const std::vector<edge>& /*edgeList*/, const std::vector<vertex>& /*vertexList*/, int /*g*/, int first,
+            Matrix4d* P, double* tetWeight, bool normalise){
+            Vector3d u, v, q, c;
+            int i=first;
+            Vector3d p0=pts[tetList[4*i]];
+            Vector3d p1=pts[tetList[4*i+1]];
+            Vector3d p2=pts[tetList[4*i+2]];
+            u=(p1-p0).normalized();
+            v=(p2-p0).normalized();
+            q=u.cross(v);
+            if(normalise){
+                c = p0+q.normalized();
+            }else{
+                c = p0+q;
+            }
+            tetWeight[0] = q.norm()/2;
+            P[0] = mat(p0,p1,p2,c);
+        }
+    };
+
+    // call f(TetPolicy<tetMode>()) once, so that the loops in f are compiled for each mode
+    template<typename F>
+    inline void dispatchTetMode(short tetMode, F&& f){
+        switch(tetMode){
+            case TM_FACE: f(TetPolicy<TM_FACE>()); break;
+            case TM_EDGE: f(TetPolicy<TM_EDGE>()); break;
+            case TM_VERTEX: f(TetPolicy<TM_VERTEX>()); break;
+            case TM_VFACE: f(TetPolicy<TM_VFACE>()); break;
+        }
+    }
+
+    // make the list of tetrahedra
+    inline int makeTetList(short tetMode, int numPts, const std::vector<int>& faceList,
+                    const std::vector<edge>& edgeList, const std::vector<vertex>& vertexList,
+                    std::vector<int>& tetList){
+        tetList.clear();
+        int dim=0;    // number of total points including ghost ones
+        dispatchTetMode(tetMode, [&](auto mode){
+            dim = decltype(mode)::makeTetList(numPts, faceList, edgeList, vertexList, tetList);
+        });
+        return dim;
     }
     
-    // compute tet position to be used by weighting and constraint
-    inline void makeTetCenterList(short tetMode, const std::vector<Vector3d>& pts,
-                           const std::vector<int>& tetList,
-                           std::vector<Vector3d>& tetCenter ){
-        int numTet = (int)tetList.size()/4;
-        tetCenter.resize(numTet);
-        if(tetMode == TM_FACE ){
-            for(int i=0;i<numTet;i++){
-                tetCenter[i]=(pts[tetList[4*i]]+pts[tetList[4*i+1]]+pts[tetList[4*i+2]])/3;
+    // comptute tetrahedra weights from those of points
+    inline void makeTetWeightList(short tetMode, const std::vector<int>& tetList,
+                   const std::vector<int>& /*faceList*/, const std::vector<edge>& edgeList,
+                   const std::vector<vertex>& /*vertexList*/, const VectorXd& ptsWeight,
+                   std::vector<double>& tetWeight ){
+        tetWeight.resize(tetList.size()/4);
+        dispatchTetMode(tetMode, [&](auto mode){
+            decltype(mode)::makeTetWeightList(tetList, edgeList, ptsWeight, tetWeight);
+        });
+    }
+    // comptute tetrahedra weights from those of points
+    inline void makePtsWeightList(short tetMode, int numPts, const std::vector<int>& tetList,
+                        const std::vector<int>& /*faceList*/, const std::vector<edge>& edgeList,
+                        const std::vector<vertex>& /*vertexList*/, const std::vector<double>& tetWeight,
+                        std::vector<double>& ptsWeight ){
+        ptsWeight.clear();
+        ptsWeight.resize(numPts,0.0);
+        std::vector<int> ptsCount(numPts,0);
+        dispatchTetMode(tetMode, [&](auto mode){
+            decltype(mode)::makePtsWeightList(tetList, edgeList, tetWeight, ptsWeight, ptsCount);
+        });
+        for(int i=0;i<numPts;i++){
+            ptsWeight[i] /= ptsCount[i];
+        }
+    }
+
+    // vertex -> tet incidence in CSR form with the averaging of makePtsWeightList folded in:
+    // ptsWeight[v] = sum of tetScale[k]*tetWeight[tetIdx[k]] for k in [tetStart[v], tetStart[v+1])
+    inline void makePtsTetCSR(short tetMode, int numPts, const std::vector<int>& tetList,
+                        const std::vector<edge>& edgeList, std::vector<int>& tetStart,
+                        std::vector<int>& tetIdx, std::vector<double>& tetScale){
+        std::vector<int> ptsCount(numPts,0);
+        tetStart.assign(numPts+1,0);
+        std::vector<int> pv, pt;
+        dispatchTetMode(tetMode, [&](auto mode){
+            decltype(mode)::makePtsTetPairs(tetList, edgeList, pv, pt, ptsCount);
+        });
+        int numPairs = (int)pv.size();
+        for(int k=0;k<numPairs;k++) tetStart[pv[k]+1]++;
+        for(int i=0;i<numPts;i++) tetStart[i+1] += tetStart[i];
+        tetIdx.resize(numPairs);
+        tetScale.resize(numPairs);
+        std::vector<int> cur(tetStart.begin(), tetStart.end()-1);
+        for(int k=0;k<numPairs;k++){
+            tetIdx[cur[pv[k]]] = pt[k];
+            tetScale[cur[pv[k]]++] = 1.0/ptsCount[pv[k]];
+        }
+    }
+
+    // the tets of group g (see TetPolicy) are groupStart[g] .. groupStart[g+1]-1
+    inline void makeTetGroups(short tetMode, int numTet, const std::vector<edge>& edgeList,
+                              const std::vector<vertex>& vertexList, std::vector<int>& groupStart){
+        dispatchTetMode(tetMode, [&](auto mode){
+            decltype(mode)::makeTetGroups(numTet, edgeList, vertexList, groupStart);
+        });
+    }
+
+    // tet matrices of group g (see TetPolicy). for a single group; loops over groups should
+    // dispatch once with makeGroupRangeTetMatrix or dispatchTetMode
+    template<typename Points>
+    inline void makeGroupTetMatrix(short tetMode, const Points& pts, const std::vector<int>& tetList,
+        const std::vector<edge>& edgeList, const std::vector<vertex>& vertexList, int g, int first,
+        Matrix4d* P, double* tetWeight, bool normalise=false){
+        dispatchTetMode(tetMode, [&](auto mode){
+            decltype(mode)::matrix(pts, tetList, edgeList, vertexList, g, first, P, tetWeight, normalise);
+        });
+    }
+
+    // tet matrices of the groups g0 .. g1-1, written from P[0] (tet groupStart[g0]) on
+    template<typename Points>
+    inline void makeGroupRangeTetMatrix(short tetMode, const Points& pts, const std::vector<int>& tetList,
+        const std::vector<edge>& edgeList, const std::vector<vertex>& vertexList,
+        const std::vector<int>& groupStart, int g0, int g1, Matrix4d* P, double* tetWeight, bool normalise=false){
+        int first = groupStart[g0];
+        dispatchTetMode(tetMode, [&](auto mode){
+            for(int g=g0;g<g1;g++){
+                int k = groupStart[g]-first;
+                decltype(mode)::matrix(pts, tetList, edgeList, vertexList, g, groupStart[g], P+k, tetWeight+k, normalise);
             }
-        }else if(tetMode == TM_EDGE){
-            for(int i=0;i<numTet;i++){
-                tetCenter[i]=(pts[tetList[4*i]]+pts[tetList[4*i+1]])/2;
+        });
+    }
+
+        // construct tetrahedra matrices
+    // groups are independent, so P is filled in parallel
+    template<typename Points>
+    inline void makeTetMatrix(short tetMode, const Points& pts, const std::vector<int>& tetList,
+        const std::vector<int>& /*faceList*/, const std::vector<edge>& edgeList,
+                    const std::vector<vertex>& vertexList, std::vector<Matrix4d>& P, std::vector<double>& tetWeight, bool normalise=false){
+        std::vector<int> groupStart;
+        makeTetGroups(tetMode, (int)tetList.size()/4, edgeList, vertexList, groupStart);
+        int numGroups = (int)groupStart.size()-1;
+        P.resize(groupStart[numGroups]);
+        tetWeight.resize(groupStart[numGroups]);
+        dispatchTetMode(tetMode, [&](auto mode){
+#pragma omp parallel for
+            for(int g=0;g<numGroups;g++){
+                decltype(mode)::matrix(pts, tetList, edgeList, vertexList, g, groupStart[g],
+                                       P.data()+groupStart[g], tetWeight.data()+groupStart[g], normalise);
             }
-        }else if(tetMode == TM_VERTEX || tetMode == TM_VFACE){
+        });
+    }
+    
+    
+    // map each tet to its mirror image under the vertex permutation ptsMirror.
+    // a tet is identified by its three mesh vertices: in any order for TM_FACE,
+    // the edge (first two) and the opposite vertex for TM_EDGE, the centre (first)
+    // and the rest for TM_VERTEX/TM_VFACE. returns false if some tet has no mirror
+    inline bool makeMirrorTetList(short tetMode, const std::vector<int>& tetList,
+                                  const std::vector<int>& ptsMirror, std::vector<int>& tetMirror){
+        int numTet = (int)tetList.size()/4;
+        bool found = true;
+        tetMirror.assign(numTet,-1);
+        dispatchTetMode(tetMode, [&](auto mode){
+            typedef decltype(mode) Mode;
+            std::map< std::array<int,3>, int > tets;
             for(int i=0;i<numTet;i++){
-                tetCenter[i]=pts[tetList[4*i]];
+                tets[Mode::mirrorKey(tetList[4*i],tetList[4*i+1],tetList[4*i+2])] = i;
             }
+            for(int i=0;i<numTet && found;i++){
+                auto t = tets.find(Mode::mirrorKey(ptsMirror[tetList[4*i]],ptsMirror[tetList[4*i+1]],ptsMirror[tetList[4*i+2]]));
+                if(t == tets.end()){
+                    found = false;
+                }else{
+                    tetMirror[i] = t->second;
+                }
+            }
+        });
+        return found;
+    }
+
+    // make tetrahedra adjacency list
+    inline void makeAdjacencyList(short tetMode, const std::vector<int>& tetList,
+            const std::vector<edge>& edgeList, const std::vector<vertex>& vertexList,
+                           std::vector< std::vector<int> >& adjacencyList){
+        adjacencyList.resize(tetList.size()/4);
+        for(size_t i=0;i<adjacencyList.size();i++){
+            adjacencyList[i].clear();
         }
+        dispatchTetMode(tetMode, [&](auto mode){
+            decltype(mode)::makeAdjacencyList(edgeList, vertexList, adjacencyList);
+        });
+    }
+
+    // get rid of degenerate tetrahedra
+    inline int removeDegenerate(short tetMode, int numPts,
+           std::vector<int>& tetList,  std::vector<int>& faceList, std::vector<edge>& edgeList,
+                         std::vector<vertex>& vertexList, const std::vector<Matrix4d>& P){
+        dispatchTetMode(tetMode, [&](auto mode){
+            decltype(mode)::removeDegenerate(tetList, faceList, edgeList, vertexList, P);
+        });
+        return makeTetList(tetMode, numPts, faceList, edgeList, vertexList, tetList);
+    }
+    
+    // compute tet position to be used by weighting and constraint
+    inline void makeTetCenterList(short tetMode, const std::vector<Vector3d>& pts,
+                           const std::vector<int>& tetList,
+                           std::vector<Vector3d>& tetCenter ){
+        tetCenter.resize(tetList.size()/4);
+        dispatchTetMode(tetMode, [&](auto mode){
+            decltype(mode)::makeTetCenterList(pts, tetList, tetCenter);
+        });
     }
 }
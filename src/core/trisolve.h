@@ -0,0 +1,402 @@
+/**
+ * @file trisolve.h
+ * @brief parallel triangular solves with a stored sparse LDL^T factor
+ * @section LICENSE The MIT License
+ * @section requirements:  Eigen library
+ * @version 0.10
+ * @date  Oct. 2026
+ */
+
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <type_traits>
+#include <cstring>
+#include <Eigen/Sparse>
+
+using namespace Eigen;
+
+// Solves A x = b with the factor P A P^T = L D L^T of a SimplicialLDLT, in parallel.
+// Row i of L only refers to descendants of i in the elimination tree, and column i only
+// to ancestors of i. The tree is cut into independent subtrees and the top part above them:
+// the forward substitution runs the subtrees in parallel gathering along the rows of L, then
+// the top part; the backward substitution runs the top part, then the subtrees gathering
+// along the columns. The top part is level scheduled: the rows of a level depend only on
+// earlier levels. Runs of narrow levels are done by one thread, to save the barriers.
+// All right-hand side columns are carried together, row by row.
+// The arrays live in one block without pointers (data(), bytes()), so that a copy of it
+// elsewhere, e.g. in memory shared by several processes, can be solved with in place (attach()).
+class TriSolver {
+public:
+    TriSolver(): n(0) {};
+    TriSolver(const TriSolver& other): n(0) { *this = other; }
+    TriSolver& operator=(const TriSolver& other);
+    template<typename LDLT>
+    void setup(const LDLT& ldlt, int numThreads);
+    template<typename LDLT>
+    bool refresh(const LDLT& ldlt);
+    bool attach(const char* data, size_t size);
+    bool ready() const { return n > 0; }
+    int rows() const { return n; }
+    void clear() { n = 0; own.clear(); }
+    MatrixXd solve(const MatrixXd& B) const;
+    int numSubtrees() const { return numSub; }
+    int topSize() const { return numTop; }
+    int numLevels() const { return numTopLevels; }
+    const char* data() const { return block; }
+    size_t bytes() const { return ready() ? layout(head, nullptr) : 0; }
+private:
+    typedef Matrix<double, Dynamic, Dynamic, RowMajor> RowMat;
+    // a run of the top part: one level done in parallel, or consecutive narrow levels done by one thread
+    struct Stage { int start, end, parallel; };
+    // sizes at the start of the block
+    struct Header { int n, nnz, numTopLevels, numSub, numTop, numStageF, numStageB, pad; };
+    int n;
+    int numTopLevels, numSub, numTop, numStageF, numStageB;
+    Header head;
+    const char* block;
+    std::vector<double> own;                   // the block, unless attached (double for alignment)
+    const int *perm, *permInv;                 // P and P^{-1} as index maps
+    const double* diag;
+    const int *rowStart, *rowCol;              // strictly lower L by rows
+    const double* rowVal;
+    const int *colStart, *colRow;              // strictly lower L by columns
+    const double* colVal;
+    const int *subStart, *subNodes;            // nodes of each subtree, ascending
+    const int *topF, *topB;                    // top nodes in forward and backward level order
+    const Stage *stageF, *stageB;
+    static size_t layout(const Header& h, TriSolver* bind);
+    static void makeStages(const std::vector<int>& level, std::vector<int>& nodes, std::vector<Stage>& stages, int minWidth);
+};
+
+// offsets of the arrays in a block with sizes h; returns its size, and points the arrays of bind into its block
+inline size_t TriSolver::layout(const Header& h, TriSolver* bind){
+    size_t offset = 0;
+    auto next = [&offset](size_t count, size_t size){
+        size_t start = offset;
+        offset += (count*size + 7) & ~(size_t)7;
+        return start;
+    };
+    next(1, sizeof(Header));
+    size_t oPerm = next(h.n, sizeof(int)), oPermInv = next(h.n, sizeof(int)), oDiag = next(h.n, sizeof(double));
+    size_t oRowStart = next(h.n+1, sizeof(int)), oRowCol = next(h.nnz, sizeof(int)), oRowVal = next(h.nnz, sizeof(double));
+    size_t oColStart = next(h.n+1, sizeof(int)), oColRow = next(h.nnz, sizeof(int)), oColVal = next(h.nnz, sizeof(double));
+    size_t oSubStart = next(h.numSub+1, sizeof(int)), oSubNodes = next(h.n-h.numTop, sizeof(int));
+    size_t oTopF = next(h.numTop, sizeof(int)), oTopB = next(h.numTop, sizeof(int));
+    size_t oStageF = next(h.numStageF, sizeof(Stage)), oStageB = next(h.numStageB, sizeof(Stage));
+    if(bind){
+        const char* b = bind->block;
+        bind->n = h.n;
+        bind->numTopLevels = h.numTopLevels;
+        bind->numSub = h.numSub;
+        bind->numTop = h.numTop;
+        bind->numStageF = h.numStageF;
+        bind->numStageB = h.numStageB;
+        bind->head = h;
+        bind->perm = (const int*)(b+oPerm);
+        bind->permInv = (const int*)(b+oPermInv);
+        bind->diag = (const double*)(b+oDiag);
+        bind->rowStart = (const int*)(b+oRowStart);
+        bind->rowCol = (const int*)(b+oRowCol);
+        bind->rowVal = (const double*)(b+oRowVal);
+        bind->colStart = (const int*)(b+oColStart);
+        bind->colRow = (const int*)(b+oColRow);
+        bind->colVal = (const double*)(b+oColVal);
+        bind->subStart = (const int*)(b+oSubStart);
+        bind->subNodes = (const int*)(b+oSubNodes);
+        bind->topF = (const int*)(b+oTopF);
+        bind->topB = (const int*)(b+oTopB);
+        bind->stageF = (const Stage*)(b+oStageF);
+        bind->stageB = (const Stage*)(b+oStageB);
+    }
+    return offset;
+}
+
+// a copy of an attached solver shares the block
+inline TriSolver& TriSolver::operator=(const TriSolver& other){
+    if(this == &other) return *this;
+    clear();
+    if(!other.ready()) return *this;
+    own = other.own;
+    block = own.empty() ? other.block : (const char*)own.data();
+    layout(other.head, this);
+    return *this;
+}
+
+// solve with a block of data() stored elsewhere; it must stay valid and 8-byte aligned while in use
+inline bool TriSolver::attach(const char* data, size_t size){
+    clear();
+    if(size < sizeof(Header) || ((size_t)data & 7)) return false;
+    Header h;
+    std::memcpy(&h, data, sizeof(Header));
+    if(h.n <= 0 || h.nnz < 0 || h.numSub < 0 || h.numTop < 0 || h.numTop > h.n || h.numStageF < 0 || h.numStageB < 0) return false;
+    if(layout(h, nullptr) != size) return false;
+    block = data;
+    layout(h, this);
+    return true;
+}
+
+// copy the factor and cut its elimination tree into about 4 subtrees per thread
+template<typename LDLT>
+inline void TriSolver::setup(const LDLT& ldlt, int numThreads){
+    const auto& L = ldlt.matrixL().nestedExpression();
+    clear();
+    int n = (int)L.rows();
+    int numTopLevels = 0;
+    std::vector<int> perm(n), permInv(n);
+    std::vector<double> diag(n);
+    for(int i=0;i<n;i++){
+        perm[i] = ldlt.permutationP().size() ? (int)ldlt.permutationP().indices()(i) : i;
+        permInv[i] = ldlt.permutationPinv().size() ? (int)ldlt.permutationPinv().indices()(i) : i;
+        diag[i] = (double)ldlt.vectorD()(i);
+    }
+    // columns as stored, rows by counting
+    std::vector<int> colStart(n+1, 0), rowStart(n+1, 0), colRow, rowCol;
+    std::vector<double> colVal, rowVal;
+    colRow.reserve(L.nonZeros());
+    colVal.reserve(L.nonZeros());
+    for(int j=0;j<n;j++){
+        for(typename std::decay<decltype(L)>::type::InnerIterator it(L,j); it; ++it){
+            if(it.row() <= j) continue;
+            colRow.push_back((int)it.row());
+            colVal.push_back((double)it.value());
+            rowStart[it.row()+1]++;
+        }
+        colStart[j+1] = (int)colRow.size();
+    }
+    for(int i=0;i<n;i++) rowStart[i+1] += rowStart[i];
+    rowCol.resize(colRow.size());
+    rowVal.resize(colRow.size());
+    std::vector<int> fill(rowStart.begin(), rowStart.end()-1);
+    for(int j=0;j<n;j++){
+        for(int k=colStart[j];k<colStart[j+1];k++){
+            int p = fill[colRow[k]]++;
+            rowCol[p] = j;
+            rowVal[p] = colVal[k];
+        }
+    }
+    // elimination tree: the parent of j is the first row below the diagonal in column j
+    std::vector<int> parent(n, -1), childStart(n+1, 0), children(n);
+    std::vector<long> cost(n);
+    for(int j=0;j<n;j++){
+        int first = n;
+        for(int k=colStart[j];k<colStart[j+1];k++) first = std::min(first, colRow[k]);
+        if(first < n){
+            parent[j] = first;
+            childStart[first+1]++;
+        }
+        cost[j] = 1 + (colStart[j+1]-colStart[j]) + (rowStart[j+1]-rowStart[j]);
+    }
+    for(int i=0;i<n;i++) childStart[i+1] += childStart[i];
+    fill.assign(childStart.begin(), childStart.end()-1);
+    long total = 0;
+    for(int j=0;j<n;j++){
+        if(parent[j] >= 0){
+            children[fill[parent[j]]++] = j;
+            cost[parent[j]] += cost[j];     // children precede their parent
+        }else{
+            total += cost[j];
+        }
+    }
+
+    // split the most expensive subtree until all are small enough
+    long target = std::max(1L, total/(4L*std::max(numThreads,1)));
+    std::vector<char> top(n, 0);
+    std::priority_queue< std::pair<long,int> > heap;
+    for(int j=0;j<n;j++) if(parent[j] < 0) heap.push(std::make_pair(cost[j], j));
+    while(!heap.empty() && heap.top().first > target){
+        int r = heap.top().second;
+        heap.pop();
+        top[r] = 1;
+        for(int c=childStart[r];c<childStart[r+1];c++) heap.push(std::make_pair(cost[children[c]], children[c]));
+    }
+    // subtrees from the most expensive, for dynamic scheduling
+    std::vector< std::pair<long,int> > roots;
+    while(!heap.empty()){
+        roots.push_back(heap.top());
+        heap.pop();
+    }
+    std::vector<int> subStart(1, 0), subNodes;
+    subNodes.reserve(n);
+    std::vector<int> stack;
+    for(size_t s=0;s<roots.size();s++){
+        int begin = (int)subNodes.size();
+        stack.assign(1, roots[s].second);
+        while(!stack.empty()){
+            int v = stack.back();
+            stack.pop_back();
+            subNodes.push_back(v);
+            for(int c=childStart[v];c<childStart[v+1];c++) stack.push_back(children[c]);
+        }
+        std::sort(subNodes.begin()+begin, subNodes.end());
+        subStart.push_back((int)subNodes.size());
+    }
+
+    // levels of the top part; rows and columns outside it are done before (forward) or after (backward)
+    std::vector<int> levelF(n, 0), levelB(n, 0), topF, topB;
+    for(int i=0;i<n;i++){
+        if(!top[i]) continue;
+        for(int k=rowStart[i];k<rowStart[i+1];k++){
+            if(top[rowCol[k]]) levelF[i] = std::max(levelF[i], levelF[rowCol[k]]+1);
+        }
+        topF.push_back(i);
+        numTopLevels = std::max(numTopLevels, levelF[i]+1);
+    }
+    for(int j=n-1;j>=0;j--){
+        if(!top[j]) continue;
+        for(int k=colStart[j];k<colStart[j+1];k++){
+            if(top[colRow[k]]) levelB[j] = std::max(levelB[j], levelB[colRow[k]]+1);
+        }
+        topB.push_back(j);
+    }
+    const int minWidth = 64 * std::max(numThreads,1);
+    std::vector<Stage> stageF, stageB;
+    makeStages(levelF, topF, stageF, minWidth);
+    makeStages(levelB, topB, stageB, minWidth);
+
+    // pack into one block
+    Header h = {n, (int)colRow.size(), numTopLevels, (int)roots.size(), (int)topF.size(), (int)stageF.size(), (int)stageB.size(), 0};
+    own.assign((layout(h, nullptr)+sizeof(double)-1)/sizeof(double), 0.0);
+    std::memcpy(own.data(), &h, sizeof(Header));
+    block = (const char*)own.data();
+    layout(h, this);
+    // the locals of the same names as the members were built above
+    auto copy = [](const void* dst, const void* src, size_t size){ if(size) std::memcpy((void*)dst, src, size); };
+    copy(this->perm, perm.data(), n*sizeof(int));
+    copy(this->permInv, permInv.data(), n*sizeof(int));
+    copy(this->diag, diag.data(), n*sizeof(double));
+    copy(this->rowStart, rowStart.data(), (n+1)*sizeof(int));
+    copy(this->rowCol, rowCol.data(), rowCol.size()*sizeof(int));
+    copy(this->rowVal, rowVal.data(), rowVal.size()*sizeof(double));
+    copy(this->colStart, colStart.data(), (n+1)*sizeof(int));
+    copy(this->colRow, colRow.data(), colRow.size()*sizeof(int));
+    copy(this->colVal, colVal.data(), colVal.size()*sizeof(double));
+    copy(this->subStart, subStart.data(), subStart.size()*sizeof(int));
+    copy(this->subNodes, subNodes.data(), subNodes.size()*sizeof(int));
+    copy(this->topF, topF.data(), topF.size()*sizeof(int));
+    copy(this->topB, topB.data(), topB.size()*sizeof(int));
+    copy(this->stageF, stageF.data(), stageF.size()*sizeof(Stage));
+    copy(this->stageB, stageB.data(), stageB.size()*sizeof(Stage));
+}
+
+// copy the values of a new numeric factorization with the same symbolic analysis, keeping the
+// tree and the schedule; false (and unchanged) if the factor is not of the same pattern or the block is attached
+template<typename LDLT>
+inline bool TriSolver::refresh(const LDLT& ldlt){
+    const auto& L = ldlt.matrixL().nestedExpression();
+    if(!ready() || own.empty() || (int)L.rows() != n) return false;
+    for(int i=0;i<n;i++){
+        int p = ldlt.permutationP().size() ? (int)ldlt.permutationP().indices()(i) : i;
+        if(perm[i] != p) return false;
+    }
+    int k = 0;
+    for(int j=0;j<n;j++){
+        for(typename std::decay<decltype(L)>::type::InnerIterator it(L,j); it; ++it){
+            if(it.row() <= j) continue;
+            if(k >= head.nnz || colRow[k] != (int)it.row()) return false;
+            k++;
+        }
+        if(colStart[j+1] != k) return false;
+    }
+    if(k != head.nnz) return false;
+
+    double* d = (double*)diag;
+    double* cv = (double*)colVal;
+    double* rv = (double*)rowVal;
+    for(int i=0;i<n;i++) d[i] = (double)ldlt.vectorD()(i);
+    k = 0;
+    for(int j=0;j<n;j++){
+        for(typename std::decay<decltype(L)>::type::InnerIterator it(L,j); it; ++it){
+            if(it.row() > j) cv[k++] = (double)it.value();
+        }
+    }
+    // rows in the order setup() filled them
+    std::vector<int> fill(rowStart, rowStart+n);
+    for(int j=0;j<n;j++){
+        for(int q=colStart[j];q<colStart[j+1];q++) rv[fill[colRow[q]]++] = cv[q];
+    }
+    return true;
+}
+
+// order nodes by level and group the levels into stages
+inline void TriSolver::makeStages(const std::vector<int>& level, std::vector<int>& nodes, std::vector<Stage>& stages, int minWidth){
+    std::stable_sort(nodes.begin(), nodes.end(), [&level](int a, int b){ return level[a] < level[b]; });
+    stages.clear();
+    int m = (int)nodes.size();
+    for(int s=0;s<m;){
+        int e = s;
+        while(e < m && level[nodes[e]] == level[nodes[s]]) e++;
+        int parallel = e-s >= minWidth;
+        if(!parallel && !stages.empty() && !stages.back().parallel){
+            stages.back().end = e;
+        }else{
+            Stage st = {s, e, parallel};
+            stages.push_back(st);
+        }
+        s = e;
+    }
+}
+
+inline MatrixXd TriSolver::solve(const MatrixXd& B) const {
+    int m = (int)B.cols();
+    RowMat Y(n, m);
+    for(int i=0;i<n;i++) Y.row(perm[i]) = B.row(i);
+    double* y = Y.data();
+    auto forward = [&](int i){
+        double* yi = y + (size_t)i*m;
+        for(int k=rowStart[i];k<rowStart[i+1];k++){
+            const double* yj = y + (size_t)rowCol[k]*m;
+            for(int c=0;c<m;c++) yi[c] -= rowVal[k]*yj[c];
+        }
+    };
+    auto backward = [&](int j){
+        double* yj = y + (size_t)j*m;
+        for(int k=colStart[j];k<colStart[j+1];k++){
+            const double* yi = y + (size_t)colRow[k]*m;
+            for(int c=0;c<m;c++) yj[c] -= colVal[k]*yi[c];
+        }
+    };
+#pragma omp parallel
+    {
+        // L y = P b
+#pragma omp for schedule(dynamic)
+        for(int s=0;s<numSub;s++){
+            for(int p=subStart[s];p<subStart[s+1];p++) forward(subNodes[p]);
+        }
+        for(int t=0;t<numStageF;t++){
+            const Stage& st = stageF[t];
+            if(st.parallel){
+#pragma omp for schedule(static)
+                for(int p=st.start;p<st.end;p++) forward(topF[p]);
+            }else{
+#pragma omp single
+                for(int p=st.start;p<st.end;p++) forward(topF[p]);
+            }
+        }
+        // D^{-1}
+#pragma omp for schedule(static)
+        for(int i=0;i<n;i++){
+            for(int c=0;c<m;c++) y[(size_t)i*m+c] /= diag[i];
+        }
+        // L^T x = y
+        for(int t=0;t<numStageB;t++){
+            const Stage& st = stageB[t];
+            if(st.parallel){
+#pragma omp for schedule(static)
+                for(int p=st.start;p<st.end;p++) backward(topB[p]);
+            }else{
+#pragma omp single
+                for(int p=st.start;p<st.end;p++) backward(topB[p]);
+            }
+        }
+#pragma omp for schedule(dynamic)
+        for(int s=0;s<numSub;s++){
+            for(int p=subStart[s+1]-1;p>=subStart[s];p--) backward(subNodes[p]);
+        }
+    }
+    MatrixXd X(n, m);
+    for(int i=0;i<n;i++) X.row(permInv[i]) = Y.row(i);
+    return X;
+}
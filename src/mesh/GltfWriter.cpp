@@ -0,0 +1,149 @@
+/**
+ * @file GltfWriter.cpp
+ * @brief Binary glTF export implementation
+ */
+
+#include "GltfWriter.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cstdint>
+#include <cstdio>
+
+namespace GltfWriter {
+
+std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// Append n x 3 values as float32; min and max are required for POSITION accessors
+static void appendVec3(std::vector<char>& bin, const Eigen::MatrixXd& X, std::string& minMax) {
+    Eigen::MatrixXf Xf = X.cast<float>();
+    Eigen::RowVector3f lo = Xf.colwise().minCoeff(), hi = Xf.colwise().maxCoeff();
+    size_t offset = bin.size();
+    bin.resize(offset + (size_t)Xf.rows() * 3 * sizeof(float));
+    float* dst = reinterpret_cast<float*>(&bin[offset]);
+    for (int i = 0; i < Xf.rows(); i++) {
+        dst[3 * i + 0] = Xf(i, 0);
+        dst[3 * i + 1] = Xf(i, 1);
+        dst[3 * i + 2] = Xf(i, 2);
+    }
+    char buf[256];
+    snprintf(buf, sizeof(buf), "\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]",
+             lo[0], lo[1], lo[2], hi[0], hi[1], hi[2]);
+    minMax = buf;
+}
+
+bool writeMorphGLB(const std::string& path,
+                   const Eigen::MatrixXd& V,
+                   const Eigen::MatrixXi& F,
+                   const std::vector<Eigen::MatrixXd>& targets,
+                   const std::vector<std::string>& targetNames,
+                   const std::string& extras) {
+    int numPts = (int)V.rows();
+    int numFaces = (int)F.rows();
+    if (numPts == 0 || numFaces == 0) {
+        std::cerr << "GltfWriter::writeMorphGLB() - Empty mesh" << std::endl;
+        return false;
+    }
+    for (const auto& t : targets) {
+        if (t.rows() != numPts || t.cols() != 3) {
+            std::cerr << "GltfWriter::writeMorphGLB() - Morph target size mismatch" << std::endl;
+            return false;
+        }
+    }
+
+    // Binary chunk: indices, positions, then one block per target (all 4-byte aligned)
+    std::vector<char> bin((size_t)numFaces * 3 * sizeof(uint32_t));
+    uint32_t* idx = reinterpret_cast<uint32_t*>(bin.data());
+    for (int i = 0; i < numFaces; i++) {
+        for (int j = 0; j < 3; j++) {
+            idx[3 * i + j] = (uint32_t)F(i, j);
+        }
+    }
+    size_t vec3Bytes = (size_t)numPts * 3 * sizeof(float);
+    std::vector<std::string> minMax(targets.size() + 1);
+    appendVec3(bin, V, minMax[0]);
+    for (size_t k = 0; k < targets.size(); k++) {
+        appendVec3(bin, targets[k], minMax[k + 1]);
+    }
+
+    // Bufferview/accessor 0 = indices, 1 = positions, 2 + k = target k
+    std::ostringstream json;
+    json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"NWayBlender\"},"
+         << "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+         << "\"buffers\":[{\"byteLength\":" << bin.size() << "}],\"bufferViews\":["
+         << "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" << (size_t)numFaces * 3 * sizeof(uint32_t)
+         << ",\"target\":34963}";
+    size_t offset = (size_t)numFaces * 3 * sizeof(uint32_t);
+    for (size_t k = 0; k <= targets.size(); k++) {
+        json << ",{\"buffer\":0,\"byteOffset\":" << offset << ",\"byteLength\":" << vec3Bytes << ",\"target\":34962}";
+        offset += vec3Bytes;
+    }
+    json << "],\"accessors\":["
+         << "{\"bufferView\":0,\"componentType\":5125,\"count\":" << numFaces * 3 << ",\"type\":\"SCALAR\"}";
+    for (size_t k = 0; k <= targets.size(); k++) {
+        json << ",{\"bufferView\":" << k + 1 << ",\"componentType\":5126,\"count\":" << numPts
+             << ",\"type\":\"VEC3\"," << minMax[k] << "}";
+    }
+    json << "],\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":1},\"indices\":0,\"mode\":4";
+    if (!targets.empty()) {
+        json << ",\"targets\":[";
+        for (size_t k = 0; k < targets.size(); k++) {
+            json << (k ? "," : "") << "{\"POSITION\":" << k + 2 << "}";
+        }
+        json << "]";
+    }
+    json << "}]";
+    if (!targets.empty()) {
+        json << ",\"weights\":[";
+        for (size_t k = 0; k < targets.size(); k++) {
+            json << (k ? ",0" : "0");
+        }
+        json << "],\"extras\":{\"targetNames\":[";
+        for (size_t k = 0; k < targets.size(); k++) {
+            json << (k ? "," : "") << jsonString(k < targetNames.size() ? targetNames[k] : "target" + std::to_string(k));
+        }
+        json << "]" << (extras.empty() ? "" : ",") << extras << "}";
+    }
+    json << "}]}";
+
+    // Chunks are padded to 4 bytes: JSON with spaces, binary with zeros
+    std::string jsonChunk = json.str();
+    jsonChunk.append((4 - jsonChunk.size() % 4) % 4, ' ');
+    bin.resize((bin.size() + 3) / 4 * 4, 0);
+    uint32_t header[3] = {0x46546C67, 2, (uint32_t)(12 + 8 + jsonChunk.size() + 8 + bin.size())};
+    uint32_t jsonHeader[2] = {(uint32_t)jsonChunk.size(), 0x4E4F534A};
+    uint32_t binHeader[2] = {(uint32_t)bin.size(), 0x004E4942};
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "GltfWriter::writeMorphGLB() - Cannot open " << path << std::endl;
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(jsonHeader), sizeof(jsonHeader));
+    out.write(jsonChunk.data(), jsonChunk.size());
+    out.write(reinterpret_cast<const char*>(binHeader), sizeof(binHeader));
+    out.write(bin.data(), bin.size());
+    if (!out) {
+        std::cerr << "GltfWriter::writeMorphGLB() - Failed to write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace GltfWriter
@@ -0,0 +1,43 @@
+/**
+ * @file GltfWriter.h
+ * @brief Binary glTF (.glb) export of a triangle mesh with morph targets
+ * @section LICENSE The MIT License
+ * @version 1.0
+ * @date 2026
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+
+namespace GltfWriter {
+
+    /**
+     * @brief Write a mesh with morph targets as a single-buffer .glb
+     *
+     * Positions and target deltas are stored as float32, indices as uint32.
+     * The morph target weights of the mesh are all 0.
+     *
+     * @param path Output file path
+     * @param V Vertices (n x 3)
+     * @param F Triangles (m x 3)
+     * @param targets Position delta per morph target (n x 3 each)
+     * @param targetNames Stored in mesh.extras.targetNames
+     * @param extras Additional members of mesh.extras as JSON (e.g. "\"a\":1"), or empty
+     * @return true if successful
+     */
+    bool writeMorphGLB(const std::string& path,
+                       const Eigen::MatrixXd& V,
+                       const Eigen::MatrixXi& F,
+                       const std::vector<Eigen::MatrixXd>& targets,
+                       const std::vector<std::string>& targetNames,
+                       const std::string& extras = "");
+
+    /**
+     * @brief Quote and escape a string for JSON
+     */
+    std::string jsonString(const std::string& s);
+
+} // namespace GltfWriter
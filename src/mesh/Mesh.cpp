@@ -5,10 +5,9 @@
 
 #include "Mesh.h"
 #include "MeshUtils.h"
+#include "MeshWriter.h"
 #include <igl/readOBJ.h>
 #include <igl/readPLY.h>
-#include <igl/writeOBJ.h>
-#include <igl/writePLY.h>
 #include <iostream>
 
 Mesh::Mesh() : numTet(0), dim(0) {
@@ -65,46 +64,98 @@ bool Mesh::loadFromFile(const std::string& path) {
     return true;
 }
 
-bool Mesh::saveToFile(const std::string& path) const {
+bool Mesh::saveToFile(const std::string& path, MeshWriter* writer) const {
     if (!isValid()) {
         std::cerr << "Error: Cannot save invalid mesh" << std::endl;
         return false;
     }
 
-    // Extract file extension
-    size_t dotPos = path.find_last_of(".");
-    if (dotPos == std::string::npos) {
-        std::cerr << "Error: No file extension in " << path << std::endl;
+    MeshWriter temporary;
+    MeshWriter& meshWriter = writer ? *writer : temporary;
+    MeshWriter::Format format;
+    if (!meshWriter.formatOf(path, format)) {
+        std::cerr << "Error: Unsupported file format of " << path << std::endl;
         return false;
     }
 
-    std::string ext = path.substr(dotPos + 1);
+    // Welded meshes are written in the layout of their file
+    bool success = meshWriter.write(path, V, unweldedFaces(), weldMap);
 
-    // Convert extension to lowercase
-    for (char& c : ext) {
-        c = std::tolower(c);
+    if (!success) {
+        std::cerr << "Error: Failed to save mesh to " << path << std::endl;
+        return false;
     }
 
-    bool success = false;
+    std::cout << "Saved mesh to " << path << std::endl;
+    return true;
+}
 
-    if (ext == "obj") {
-        success = igl::writeOBJ(path, V, F);
-    } else if (ext == "ply") {
-        success = igl::writePLY(path, V, F);
-    } else {
-        std::cerr << "Error: Unsupported file format '" << ext << "'" << std::endl;
-        return false;
+int Mesh::weld(double tolerance) {
+    if (!isValid() || isWelded()) {
+        return numVertices();
     }
 
-    if (!success) {
-        std::cerr << "Error: Failed to save mesh to " << path << std::endl;
-        return false;
+    std::vector<int> map;
+    int numWelded = MeshUtils::weldVertices(getVerticesAsVector3d(), tolerance, map);
+    if (numWelded == numVertices()) {
+        return numWelded;
     }
+    int numLoaded = numVertices();
+    applyWeldMap(map, numWelded);
 
-    std::cout << "Saved mesh to " << path << std::endl;
+    std::cout << "Welded mesh '" << name << "': " << numLoaded << " -> "
+              << V.rows() << " vertices, " << F.rows() << " faces" << std::endl;
+    return numWelded;
+}
+
+bool Mesh::weldLike(const Mesh& reference) {
+    if (!reference.isWelded()) {
+        return true;
+    }
+    if (isWelded() || V.rows() != (int)reference.weldMap.size() || F.rows() != reference.unweldedF.rows()) {
+        return false;
+    }
+    applyWeldMap(reference.weldMap, reference.numVertices());
     return true;
 }
 
+void Mesh::applyWeldMap(const std::vector<int>& map, int numWelded) {
+    weldMap = map;
+    unweldedF = F;
+
+    // Position of the first duplicate
+    VertexMatrix weldedV(numWelded, 3);
+    for (int i = (int)V.rows() - 1; i >= 0; i--) {
+        weldedV.row(map[i]) = V.row(i);
+    }
+
+    // Drop faces collapsed by the weld
+    Eigen::MatrixXi weldedF(F.rows(), 3);
+    int numFaces = 0;
+    for (int i = 0; i < F.rows(); i++) {
+        int a = map[F(i, 0)], b = map[F(i, 1)], c = map[F(i, 2)];
+        if (a != b && b != c && c != a) {
+            weldedF.row(numFaces++) << a, b, c;
+        }
+    }
+    V.swap(weldedV);
+    F = weldedF.topRows(numFaces);
+
+    buildTopology();
+}
+
+Eigen::MatrixXd Mesh::unweld(const Eigen::MatrixXd& perVertex) const {
+    if (!isWelded()) {
+        return perVertex;
+    }
+    Eigen::MatrixXd out((int)weldMap.size(), perVertex.cols());
+    #pragma omp parallel for
+    for (int i = 0; i < (int)weldMap.size(); i++) {
+        out.row(i) = perVertex.row(weldMap[i]);
+    }
+    return out;
+}
+
 bool Mesh::computeTetStructure(short tetMode) {
     if (!isValid()) {
         std::cerr << "Error: Cannot compute tet structure for invalid mesh" << std::endl;
@@ -131,19 +182,11 @@ bool Mesh::computeTetStructure(short tetMode) {
     return true;
 }
 
-std::vector<Vector3d> Mesh::getVerticesAsVector3d() const {
-    std::vector<Vector3d> pts(V.rows());
-    for (int i = 0; i < V.rows(); i++) {
-        pts[i] = V.row(i);
-    }
-    return pts;
-}
+// Vector3d has no padding, so the rows of V are laid out as an array of it
+static_assert(sizeof(Vector3d) == 3 * sizeof(double), "Vector3d must be three packed doubles");
 
-void Mesh::updateFromVector3d(const std::vector<Vector3d>& pts) {
-    int n = std::min((int)pts.size(), (int)V.rows());
-    for (int i = 0; i < n; i++) {
-        V.row(i) = pts[i];
-    }
+std::vector<Vector3d> Mesh::getVerticesAsVector3d() const {
+    return std::vector<Vector3d>(vertexArray(), vertexArray() + V.rows());
 }
 
 bool Mesh::isValid() const {
@@ -153,6 +196,8 @@ bool Mesh::isValid() const {
 void Mesh::clear() {
     V.resize(0, 3);
     F.resize(0, 3);
+    weldMap.clear();
+    unweldedF.resize(0, 3);
     tetList.clear();
     tetMatrix.clear();
     tetMatrixInverse.clear();
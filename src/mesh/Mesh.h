@@ -19,6 +19,8 @@ using namespace Eigen;
 
 // edge and vertex types are available from tetrise.h (in global namespace)
 
+class MeshWriter;
+
 /**
  * @brief Mesh data structure using libigl conventions
  *
@@ -27,10 +29,20 @@ using namespace Eigen;
  */
 class Mesh {
 public:
+    /**
+     * @brief Vertex positions (n × 3), row-major so that the xyz of each
+     * vertex are contiguous; the storage is aligned like any Eigen matrix
+     */
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor> VertexMatrix;
+
     // Geometry (libigl format)
-    Eigen::MatrixXd V;                    // Vertices (n × 3)
+    VertexMatrix V;                       // Vertices (n × 3), interleaved
     Eigen::MatrixXi F;                    // Faces (m × 3), triangulated
 
+    // Seam welding (empty = not welded)
+    std::vector<int> weldMap;             // Welded vertex of each vertex of the file
+    Eigen::MatrixXi unweldedF;            // Faces of the file
+
     // Tetrahedral structure (from tetrise.h)
     std::vector<int> tetList;             // Flattened tet indices [4*numTet]
     std::vector<Matrix4d> tetMatrix;      // Tet transformation matrices
@@ -63,11 +75,58 @@ public:
     bool loadFromFile(const std::string& path);
 
     /**
-     * @brief Save mesh to file
+     * @brief Save mesh to file (.obj, or binary .ply)
      * @param path Output file path
+     * @param writer Writer that keeps the serialized faces between calls, e.g.
+     *               for the frames of an animation (nullptr = a temporary one)
      * @return true if successful
      */
-    bool saveToFile(const std::string& path) const;
+    bool saveToFile(const std::string& path, MeshWriter* writer = nullptr) const;
+
+    /**
+     * @brief Weld coincident vertices, e.g. duplicated along UV and normal seams
+     *
+     * V and F become the welded mesh, so that seams do not tear and the
+     * solve system carries no duplicates; faces collapsed by the weld are
+     * dropped. saveToFile() scatters the vertices back to the layout of the
+     * file. See MeshUtils::weldVertices().
+     *
+     * @param tolerance Weld distance, relative to the bounding box diagonal
+     * @return Number of vertices after welding
+     */
+    int weld(double tolerance);
+
+    /**
+     * @brief Weld with the vertex map of a welded mesh of the same file layout
+     *
+     * Blend meshes are welded like the base mesh, whatever their shape; each
+     * welded vertex takes the position of its first duplicate. Does nothing
+     * if reference is not welded.
+     *
+     * @param reference Welded mesh
+     * @return false if the vertex or face count differs from the file layout of reference
+     */
+    bool weldLike(const Mesh& reference);
+
+    /**
+     * @brief Check if the vertices were welded
+     */
+    bool isWelded() const { return !weldMap.empty(); }
+
+    /**
+     * @brief Vertices in the layout of the file (V itself if not welded)
+     */
+    Eigen::MatrixXd unweldedVertices() const { return unweld(V); }
+
+    /**
+     * @brief Scatter per-vertex rows (e.g. displacements) to the layout of the file
+     */
+    Eigen::MatrixXd unweld(const Eigen::MatrixXd& perVertex) const;
+
+    /**
+     * @brief Faces in the layout of the file
+     */
+    const Eigen::MatrixXi& unweldedFaces() const { return isWelded() ? unweldedF : F; }
 
     /**
      * @brief Compute tetrahedral structure for blending
@@ -77,16 +136,25 @@ public:
     bool computeTetStructure(short tetMode);
 
     /**
-     * @brief Get vertices as vector of Vector3d (for compatibility with existing code)
-     * @return Vector of 3D vertices
+     * @brief Vertices as a 3 × n matrix, one column per vertex (no copy)
      */
-    std::vector<Vector3d> getVerticesAsVector3d() const;
+    Eigen::Map<Eigen::Matrix3Xd> points() { return Eigen::Map<Eigen::Matrix3Xd>(V.data(), 3, V.rows()); }
+    Eigen::Map<const Eigen::Matrix3Xd> points() const { return Eigen::Map<const Eigen::Matrix3Xd>(V.data(), 3, V.rows()); }
 
     /**
-     * @brief Update vertex positions from Vector3d array
-     * @param pts New vertex positions
+     * @brief Vertices as an array of numVertices() Vector3d (no copy)
+     *
+     * Valid until V is resized. Indexes like std::vector<Vector3d>, e.g. for
+     * Tetrise::makeTetMatrix().
      */
-    void updateFromVector3d(const std::vector<Vector3d>& pts);
+    Vector3d* vertexArray() { return reinterpret_cast<Vector3d*>(V.data()); }
+    const Vector3d* vertexArray() const { return reinterpret_cast<const Vector3d*>(V.data()); }
+
+    /**
+     * @brief Copy the vertices to a vector of Vector3d, for code that keeps its own copy
+     * @return Vector of 3D vertices
+     */
+    std::vector<Vector3d> getVerticesAsVector3d() const;
 
     /**
      * @brief Check if mesh has valid geometry
@@ -114,4 +182,11 @@ private:
      * @brief Build face, edge, and vertex lists from F matrix
      */
     void buildTopology();
+
+    /**
+     * @brief Replace V and F with the welded mesh
+     * @param map Welded vertex of each vertex
+     * @param numWelded Number of welded vertices
+     */
+    void applyWeldMap(const std::vector<int>& map, int numWelded);
 };
@@ -4,8 +4,10 @@
  */
 
 #include "MeshUtils.h"
+#include "bvh.h"
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 
 namespace MeshUtils {
 
@@ -81,4 +83,108 @@ void computeVertexColors(const std::vector<double>& vertexValues,
     }
 }
 
+bool findMirrorMap(const std::vector<Vector3d>& pts,
+                   int axis,
+                   double tolerance,
+                   std::vector<int>& mirror,
+                   double& plane) {
+    int numPts = (int)pts.size();
+    mirror.clear();
+    if (numPts == 0 || axis < 0 || axis > 2) {
+        return false;
+    }
+
+    Vector3d lo = pts[0], hi = pts[0];
+    for (const auto& p : pts) {
+        lo = lo.cwiseMin(p);
+        hi = hi.cwiseMax(p);
+    }
+    plane = 0.5 * (lo[axis] + hi[axis]);
+    double maxDist = tolerance * (hi - lo).norm();
+
+    BVH tree;
+    tree.buildPoints(pts);
+    std::vector<Vector3d> reflected(pts);
+    for (auto& p : reflected) {
+        p[axis] = 2.0 * plane - p[axis];
+    }
+    std::vector<double> dist;
+    tree.closestBatch(reflected, mirror, dist);
+
+    for (int v = 0; v < numPts; v++) {
+        if (mirror[v] < 0 || dist[v] > maxDist || mirror[mirror[v]] != v) {
+            mirror.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+int weldVertices(const std::vector<Vector3d>& pts,
+                 double tolerance,
+                 std::vector<int>& weldMap) {
+    int numPts = (int)pts.size();
+    weldMap.resize(numPts);
+    if (numPts == 0) {
+        return 0;
+    }
+
+    Vector3d lo = pts[0], hi = pts[0];
+    for (const auto& p : pts) {
+        lo = lo.cwiseMin(p);
+        hi = hi.cwiseMax(p);
+    }
+    double diag = (hi - lo).norm();
+    double maxDist = tolerance * diag;
+    // Cells no smaller than the weld distance, and at most 2^20 per axis so that keys fit in 64 bits
+    double cell = diag > 0.0 ? std::max(maxDist, diag / (1 << 20)) : 1.0;
+    auto cellOf = [&](const Vector3d& p) {
+        return Vector3i(((p - lo) / cell).array().floor().cast<int>());
+    };
+    auto key = [](const Vector3i& c) {
+        return ((uint64_t)c[0] << 42) | ((uint64_t)c[1] << 21) | (uint64_t)c[2];
+    };
+
+    // Spatial hash: vertices sorted by cell, then by index
+    std::vector<std::pair<uint64_t, int>> sorted(numPts);
+    #pragma omp parallel for
+    for (int v = 0; v < numPts; v++) {
+        sorted[v] = std::make_pair(key(cellOf(pts[v])), v);
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    // First vertex within the weld distance (possibly itself)
+    std::vector<int> first(numPts);
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int v = 0; v < numPts; v++) {
+        first[v] = v;
+        Vector3i c = cellOf(pts[v]);
+        for (int dx = -1; dx <= 1; dx++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dz = -1; dz <= 1; dz++) {
+                    Vector3i n = c + Vector3i(dx, dy, dz);
+                    if (n.minCoeff() < 0) {
+                        continue;
+                    }
+                    uint64_t k = key(n);
+                    auto it = std::lower_bound(sorted.begin(), sorted.end(), std::make_pair(k, 0));
+                    for (; it != sorted.end() && it->first == k && it->second < first[v]; ++it) {
+                        if ((pts[it->second] - pts[v]).norm() <= maxDist) {
+                            first[v] = it->second;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // first[v] < v is already numbered
+    int numWelded = 0;
+    for (int v = 0; v < numPts; v++) {
+        weldMap[v] = (first[v] == v) ? numWelded++ : weldMap[first[v]];
+    }
+    return numWelded;
+}
+
 } // namespace MeshUtils
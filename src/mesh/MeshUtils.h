@@ -68,4 +68,40 @@ namespace MeshUtils {
                             double multiplier,
                             Eigen::MatrixXd& colors);
 
+    /**
+     * @brief Detect the mirror vertex map of a bilaterally symmetric mesh
+     *
+     * Reflects every vertex across the plane through the bounding box centre
+     * perpendicular to axis and matches it to the closest vertex.
+     *
+     * @param pts Vertex positions
+     * @param axis Mirror axis (0 = x, 1 = y, 2 = z)
+     * @param tolerance Largest match distance, relative to the bounding box diagonal
+     * @param mirror Output: mirror[v] is the vertex mirroring v (an involution)
+     * @param plane Output: coordinate of the mirror plane along axis
+     * @return true if every vertex has a mirror
+     */
+    bool findMirrorMap(const std::vector<Vector3d>& pts,
+                       int axis,
+                       double tolerance,
+                       std::vector<int>& mirror,
+                       double& plane);
+
+    /**
+     * @brief Weld coincident vertices, e.g. duplicated along UV and normal seams
+     *
+     * Vertices are binned in a spatial hash with cells of the weld distance,
+     * and each is matched against the 27 cells around it in parallel. A
+     * vertex is welded to the first vertex within the weld distance; chains
+     * of such matches form one welded vertex.
+     *
+     * @param pts Vertex positions
+     * @param tolerance Weld distance, relative to the bounding box diagonal
+     * @param weldMap Output: welded vertex of each vertex, numbered in order of first occurrence
+     * @return Number of welded vertices
+     */
+    int weldVertices(const std::vector<Vector3d>& pts,
+                     double tolerance,
+                     std::vector<int>& weldMap);
+
 } // namespace MeshUtils
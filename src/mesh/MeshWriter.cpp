@@ -0,0 +1,220 @@
+/**
+ * @file MeshWriter.cpp
+ * @brief OBJ / PLY export implementation
+ * @section LICENSE The MIT License
+ * @version 1.0
+ * @date 2026
+ */
+
+#include "MeshWriter.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cctype>
+#include <algorithm>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+#ifdef __cpp_lib_to_chars
+#define MESH_WRITER_TO_CHARS
+#endif
+
+// Vertices formatted by one thread at a time; chunks of a batch are written
+// before the next batch is formatted, which bounds the buffered text
+static const int chunkVertices = 16384;
+static const int batchChunks = 64;
+
+// Longest formatted double ("%.17g": sign, 17 digits, point, exponent)
+static const int maxDoubleChars = 32;
+
+// Append x so that it reads back as the same double
+static char* putDouble(char* p, double x) {
+#ifdef MESH_WRITER_TO_CHARS
+    return std::to_chars(p, p + maxDoubleChars, x).ptr;
+#else
+    return p + snprintf(p, maxDoubleChars, "%.17g", x);
+#endif
+}
+
+static char* putInt(char* p, int x) {
+    char digits[12];
+    int n = 0;
+    unsigned int u = x < 0 ? 0u - (unsigned int)x : (unsigned int)x;
+    do {
+        digits[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u > 0);
+    if (x < 0) {
+        *p++ = '-';
+    }
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+static bool hostIsLittleEndian() {
+    const uint16_t one = 1;
+    return *(const unsigned char*)&one == 1;
+}
+
+MeshWriter::MeshWriter()
+    : binaryPly(true)
+    , cachedFormat(FMT_OBJ) {
+}
+
+bool MeshWriter::formatOf(const std::string& path, Format& format) const {
+    size_t dotPos = path.find_last_of(".");
+    if (dotPos == std::string::npos) {
+        return false;
+    }
+    std::string ext = path.substr(dotPos + 1);
+    for (char& c : ext) {
+        c = std::tolower(c);
+    }
+    if (ext == "obj") {
+        format = FMT_OBJ;
+    } else if (ext == "ply") {
+        format = binaryPly ? FMT_PLY_BINARY : FMT_PLY_ASCII;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void MeshWriter::clearCache() {
+    cachedF.resize(0, 0);
+    std::vector<char>().swap(faceBytes);
+}
+
+void MeshWriter::serializeFaces(const Eigen::MatrixXi& F, Format format) {
+    if (format == cachedFormat && cachedF.rows() == F.rows() && cachedF.cols() == F.cols() &&
+        std::memcmp(cachedF.data(), F.data(), F.size() * sizeof(int)) == 0) {
+        return;
+    }
+    int numFaces = (int)F.rows();
+    if (format == FMT_PLY_BINARY) {
+        // Count (uchar) and three int32 per face
+        faceBytes.resize((size_t)numFaces * 13);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < numFaces; i++) {
+            char* p = &faceBytes[(size_t)i * 13];
+            p[0] = 3;
+            for (int j = 0; j < 3; j++) {
+                int32_t v = F(i, j);
+                std::memcpy(p + 1 + 4 * j, &v, 4);
+            }
+        }
+    } else {
+        // "f a b c\n" (1-based) or "3 a b c\n", formatted per chunk of faces
+        int numChunks = (numFaces + chunkVertices - 1) / chunkVertices;
+        std::vector<std::vector<char>> chunks(numChunks);
+        #pragma omp parallel for schedule(dynamic)
+        for (int c = 0; c < numChunks; c++) {
+            int begin = c * chunkVertices;
+            int end = std::min(numFaces, begin + chunkVertices);
+            std::vector<char>& buf = chunks[c];
+            buf.resize((size_t)(end - begin) * 40);
+            char* p = buf.data();
+            for (int i = begin; i < end; i++) {
+                *p++ = format == FMT_OBJ ? 'f' : '3';
+                for (int j = 0; j < 3; j++) {
+                    *p++ = ' ';
+                    p = putInt(p, format == FMT_OBJ ? F(i, j) + 1 : F(i, j));
+                }
+                *p++ = '\n';
+            }
+            buf.resize(p - buf.data());
+        }
+        faceBytes.clear();
+        for (const auto& buf : chunks) {
+            faceBytes.insert(faceBytes.end(), buf.begin(), buf.end());
+        }
+    }
+    cachedF = F;
+    cachedFormat = format;
+}
+
+bool MeshWriter::write(const std::string& path, const Vertices& V, const Eigen::MatrixXi& F,
+                       const std::vector<int>& rowOf) {
+    Format format;
+    if (!formatOf(path, format)) {
+        std::cerr << "MeshWriter: Unsupported file format of " << path << std::endl;
+        return false;
+    }
+    int numPts = rowOf.empty() ? (int)V.rows() : (int)rowOf.size();
+    serializeFaces(F, format);
+
+    FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out) {
+        std::cerr << "MeshWriter: Cannot write " << path << std::endl;
+        return false;
+    }
+    bool ok = true;
+
+    if (format != FMT_OBJ) {
+        std::string header = "ply\nformat ";
+        header += format == FMT_PLY_ASCII ? "ascii" : (hostIsLittleEndian() ? "binary_little_endian" : "binary_big_endian");
+        header += " 1.0\nelement vertex " + std::to_string(numPts) +
+                  "\nproperty double x\nproperty double y\nproperty double z\n"
+                  "element face " + std::to_string(F.rows()) +
+                  "\nproperty list uchar int vertex_indices\nend_header\n";
+        ok = std::fwrite(header.data(), 1, header.size(), out) == header.size();
+    }
+
+    if (format == FMT_PLY_BINARY && rowOf.empty()) {
+        // Rows of V are the vertices as stored
+        size_t bytes = (size_t)numPts * 3 * sizeof(double);
+        ok = ok && std::fwrite(V.data(), 1, bytes, out) == bytes;
+    } else {
+        // Batches of chunks formatted (or gathered) in parallel, then written in order
+        int numChunks = (numPts + chunkVertices - 1) / chunkVertices;
+        std::vector<std::vector<char>> chunks(std::min(numChunks, batchChunks));
+        for (int c0 = 0; c0 < numChunks && ok; c0 += batchChunks) {
+            int c1 = std::min(numChunks, c0 + batchChunks);
+            #pragma omp parallel for schedule(dynamic)
+            for (int c = c0; c < c1; c++) {
+                int begin = c * chunkVertices;
+                int end = std::min(numPts, begin + chunkVertices);
+                std::vector<char>& buf = chunks[c - c0];
+                buf.resize((size_t)(end - begin) * (format == FMT_PLY_BINARY ? 3 * sizeof(double)
+                                                                             : 3 * maxDoubleChars + 8));
+                char* p = buf.data();
+                for (int i = begin; i < end; i++) {
+                    const double* x = V.data() + 3 * (size_t)(rowOf.empty() ? i : rowOf[i]);
+                    if (format == FMT_PLY_BINARY) {
+                        std::memcpy(p, x, 3 * sizeof(double));
+                        p += 3 * sizeof(double);
+                        continue;
+                    }
+                    if (format == FMT_OBJ) {
+                        *p++ = 'v';
+                        *p++ = ' ';
+                    }
+                    p = putDouble(p, x[0]);
+                    *p++ = ' ';
+                    p = putDouble(p, x[1]);
+                    *p++ = ' ';
+                    p = putDouble(p, x[2]);
+                    *p++ = '\n';
+                }
+                buf.resize(p - buf.data());
+            }
+            for (int c = c0; c < c1 && ok; c++) {
+                const std::vector<char>& buf = chunks[c - c0];
+                ok = std::fwrite(buf.data(), 1, buf.size(), out) == buf.size();
+            }
+        }
+    }
+
+    ok = ok && std::fwrite(faceBytes.data(), 1, faceBytes.size(), out) == faceBytes.size();
+    ok = (std::fclose(out) == 0) && ok;
+    if (!ok) {
+        std::cerr << "MeshWriter: Write to " << path << " failed" << std::endl;
+    }
+    return ok;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file MeshWriter.h
+ * @brief Fast OBJ / PLY export of triangle meshes
+ * @section LICENSE The MIT License
+ * @version 1.0
+ * @date 2026
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+
+/**
+ * @brief Writes triangle meshes as OBJ or PLY, formatting the vertices in parallel
+ *
+ * Text vertices are formatted by all threads, one buffer per chunk of
+ * vertices, and the buffers are written in order with large sequential
+ * writes. Numbers are formatted with std::to_chars (shortest round trip)
+ * where the standard library has it, else with "%.17g"; both read back as
+ * the same doubles. Binary PLY, the default for .ply, writes the doubles
+ * as they are and is the fastest.
+ *
+ * The faces are serialized once and kept, so writing more frames of the
+ * same topology only formats the vertices.
+ */
+class MeshWriter {
+public:
+    // Same layout as Mesh::VertexMatrix
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor> Vertices;
+
+    enum Format {
+        FMT_OBJ,
+        FMT_PLY_ASCII,
+        FMT_PLY_BINARY
+    };
+
+    MeshWriter();
+
+    /**
+     * @brief Format for a file name: .obj, or .ply (binary unless setBinaryPly(false))
+     * @return false if the extension is not supported
+     */
+    bool formatOf(const std::string& path, Format& format) const;
+
+    /**
+     * @brief Write .ply files as binary (default) or ASCII
+     */
+    void setBinaryPly(bool binary) { binaryPly = binary; }
+
+    /**
+     * @brief Write a mesh in the format of its file name
+     * @param path Output file (.obj or .ply)
+     * @param V Vertices
+     * @param F Triangles, indexing the vertices of the file
+     * @param rowOf Row of V of each vertex of the file (e.g. Mesh::weldMap); empty = the rows of V
+     * @return true if successful
+     */
+    bool write(const std::string& path, const Vertices& V, const Eigen::MatrixXi& F,
+               const std::vector<int>& rowOf = std::vector<int>());
+
+    /**
+     * @brief Drop the serialized faces
+     */
+    void clearCache();
+
+private:
+    bool binaryPly;
+
+    // Faces serialized for cachedFormat
+    Eigen::MatrixXi cachedF;
+    Format cachedFormat;
+    std::vector<char> faceBytes;
+
+    void serializeFaces(const Eigen::MatrixXi& F, Format format);
+};